@@ -21,6 +21,15 @@ public:
      * @param resusePort 是否复用端口号
      */
     Accepter(EventLoop* loop, const InetAddress& localAddr, bool resusePort);
+
+    /**
+     * @brief 使用已绑定地址的监听套接字构造Accepter对象
+     * @details 用于多进程共享监听套接字，或者从旧进程继承监听套接字，Accepter接管套接字的所有权
+     *
+     * @param loop 事件循环
+     * @param listenfd 已绑定地址的套接字
+     */
+    Accepter(EventLoop* loop, int listenfd);
     Accepter(const Accepter&) = delete;
     Accepter& operator=(const Accepter&) = delete;
     ~Accepter();
@@ -38,12 +47,30 @@ public:
      */
     bool listenning() const { return listenning_; }
 
+    /**
+     * @brief 开启TCP Fast Open，需要在listen之前调用
+     * @details 客户端携带有效的cookie时，SYN中的数据随连接一起交给应用，节省一次往返。
+     * 需要内核参数net.ipv4.tcp_fastopen开启服务端支持（第2位）
+     *
+     * @param queueLen 等待完成握手的TFO请求队列长度，为0时不开启
+     */
+    void setFastOpen(int queueLen) { fastOpenQueueLen_ = queueLen; }
+
     /**
      * @brief 开启监听
      * 
      */
     void listen();
 
+    /**
+     * @brief 停止接收新连接，监听套接字保持打开
+     *
+     */
+    void stop();
+
+    //获取监听套接字
+    int fd() const { return acceptSocket_.fd(); }
+
 private:
     /**
      * @brief 处理连接上的可读事件
@@ -58,8 +85,8 @@ private:
 
     NewConnectionCallback newConnectionCallback_; // 新连接的回调函数
 
-    bool listenning_; // 是否正在监听
-
+    bool listenning_;       // 是否正在监听
+    int  fastOpenQueueLen_; // TCP Fast Open请求队列长度 为0时不开启
 };
 }
 #endif
\ No newline at end of file
@@ -1,6 +1,8 @@
 #ifndef __APOLLO_BUFFER_H__
 #define __APOLLO_BUFFER_H__
 
+#include "timestamp.h"
+#include <stdint.h>
 #include <string>
 #include <vector>
 
@@ -53,14 +55,41 @@ public:
     //向缓冲区中追加数据
     void append(const std::string& data);
 
+    //以网络字节序向缓冲区中追加32位整数
+    void appendInt32(int32_t x);
+
+    //以网络字节序读取32位整数，不移动读指针，需要保证可读数据不少于4字节
+    int32_t peekInt32() const;
+
+    //以网络字节序读取32位整数并移动读指针
+    int32_t readInt32();
+
     //从fd中读取数据到缓冲区
     ssize_t readFd(int fd, int& saveErrno);
 
+    /**
+     * @brief 从fd中读取数据到缓冲区，同时取出内核记录的接收时间戳
+     * @details 使用recvmsg读取SCM_TIMESTAMPING控制消息，需要先在套接字上开启SO_TIMESTAMPING的软件接收时间戳。
+     * 本次读取的数据没有携带时间戳时receiveTime保持不变
+     *
+     * @param fd 文件描述符
+     * @param saveErrno 出错时保存errno
+     * @param receiveTime 输出参数，数据包进入内核协议栈的时间
+     * @return 读取的字节数，出错时返回-1
+     */
+    ssize_t readFd(int fd, int& saveErrno, Timestamp* receiveTime);
+
     //将缓冲区中的可读数据写入到fd中
     ssize_t writeFd(int fd, int& saveErrno);
 
     //与目标缓冲区进行交换
     void swap(Buffer& rhs);
+
+    //返回缓冲区占用的内存大小
+    size_t internalCapacity() const { return buffer_.capacity(); }
+
+    //释放多余的内存，只保留可读数据和reserve字节的可写空间
+    void shrink(size_t reserve);
     
 private:
     /**
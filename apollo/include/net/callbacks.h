@@ -1,15 +1,19 @@
 #ifndef __APOLLO_CALLBACKS_H__
 #define __APOLLO_CALLBACKS_H__
 
+#include <cstdint>
 #include <functional>
 #include <memory>
+#include <string>
 
 namespace apollo 
 {
 
 
 class TcpConnection;
+class UdpChannel;
 class Buffer;
+class InetAddress;
 class Timestamp;
 
 using TcpConnectionPtr      = std::shared_ptr<TcpConnection>;
@@ -19,6 +23,11 @@ using CloseCallback         = std::function<void(const TcpConnectionPtr&)>;
 using WriteCompleteCallback = std::function<void(const TcpConnectionPtr&)>;
 using MessageCallback       = std::function<void(const TcpConnectionPtr&, Buffer*, Timestamp)>;
 using HighWaterMarkCallback = std::function<void(const TcpConnectionPtr&, size_t)>;
+using SharedPayload         = std::shared_ptr<const std::string>; // 多个连接共享的只读发送数据
+using TxTimestampCallback   = std::function<void(const TcpConnectionPtr&, uint32_t, Timestamp)>;
+
+using UdpChannelPtr    = std::shared_ptr<UdpChannel>;
+using DatagramCallback = std::function<void(const UdpChannelPtr&, const InetAddress&, const char*, size_t, Timestamp)>;
 } 
 
 #endif
\ No newline at end of file
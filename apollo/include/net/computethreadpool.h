@@ -0,0 +1,135 @@
+#ifndef __APOLLO_COMPUTETHREADPOOL_H__
+#define __APOLLO_COMPUTETHREADPOOL_H__
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace apollo
+{
+class EventLoop;
+class Thread;
+
+/**
+ * @brief 计算线程池，用于将耗时的业务处理从事件循环线程中卸载出去
+ * @details 每个工作线程拥有两个任务队列：在工作线程中提交的任务进入该线程的本地队列，
+ * 从尾部取出以保持局部性；其他线程提交的任务轮流分配到各个工作线程的外部队列，按提交顺序从头部取出，
+ * 积压时先提交的请求不会被后来的请求饿死。自己的队列都为空时从其他线程队列的头部窃取任务，
+ * 从而在任务耗时不均时保持负载均衡。
+ * 任务完成后可以通过postAndContinue回到发起任务的事件循环中继续处理，
+ * 例如在事件循环中发送计算结果
+ */
+class ComputeThreadPool
+{
+public:
+    using Task = std::function<void()>;
+
+    explicit ComputeThreadPool(const std::string& nameArg = std::string("ComputeThreadPool"));
+    ComputeThreadPool(const ComputeThreadPool&) = delete;
+    ComputeThreadPool& operator=(const ComputeThreadPool&) = delete;
+    ~ComputeThreadPool();
+
+    //设置工作线程数目，需要在第一次start之前调用，为0时任务在提交线程中直接执行
+    void setThreadNum(int numThreads) { numThreads_ = numThreads; }
+
+    //启动线程池
+    void start();
+
+    /**
+     * @brief 停止线程池
+     * @details 已经提交的任务执行完毕后工作线程才会退出，停止后提交的任务会被丢弃。
+     * 任务队列保留到析构，停止后可以再次启动
+     */
+    void stop();
+
+    /**
+     * @brief 提交任务，可在任意线程中调用
+     *
+     * @param task 在工作线程中执行的任务
+     */
+    void post(Task task);
+
+    /**
+     * @brief 提交任务，任务执行完成后在指定的事件循环中执行后续操作
+     *
+     * @param loop 执行后续操作的事件循环，通常为发起任务的事件循环
+     * @param task 在工作线程中执行的任务
+     * @param done 在事件循环中执行的后续操作
+     */
+    void postAndContinue(EventLoop* loop, Task task, Task done);
+
+    /**
+     * @brief 提交有返回值的任务，计算结果传递给事件循环中执行的后续操作
+     *
+     * @param loop 执行后续操作的事件循环
+     * @param func 在工作线程中执行的计算
+     * @param done 在事件循环中接收计算结果的后续操作
+     */
+    template <typename R>
+    void postAndContinue(EventLoop* loop, std::function<R()> func, std::function<void(R&)> done) {
+        std::shared_ptr<R> result = std::make_shared<R>();
+        postAndContinue(loop,
+            [result, func] { *result = func(); },
+            [result, done] { done(*result); });
+    }
+
+    //返回等待执行的任务数目
+    size_t pendingTasks() const { return pending_.load(std::memory_order_relaxed); }
+
+    //返回工作线程之间窃取任务的次数
+    int64_t stealCount() const { return steals_.load(std::memory_order_relaxed); }
+
+    //返回线程池名称
+    const std::string& name() const { return name_; }
+
+    //线程池是否已经启动
+    bool started() const { return running_; }
+
+private:
+    //工作线程的任务队列
+    struct Worker {
+        std::mutex       mtx;   // 保护任务队列
+        std::deque<Task> tasks; // 本地队列 工作线程自己提交的任务 后进先出
+        std::deque<Task> inbox; // 外部队列 其他线程提交的任务 先进先出
+    };
+
+    //工作线程的主循环
+    void threadFunc(size_t index);
+
+    /**
+     * @brief 获取下一个要执行的任务
+     * @details 先从自己本地队列的尾部获取，再从自己外部队列的头部获取，最后从其他线程的队列头部窃取
+     *
+     * @param index 工作线程下标
+     * @param task 获取到的任务
+     * @return 是否获取到任务
+     */
+    bool take(size_t index, Task& task);
+
+    //执行任务并捕获任务中抛出的异常
+    void runTask(const Task& task);
+
+private:
+    std::string      name_;       // 线程池名称
+    int              numThreads_; // 工作线程数目
+    std::atomic_bool running_;    // 线程池是否正在运行
+
+    std::vector<std::unique_ptr<Worker>> workers_; // 每个工作线程的任务队列
+    std::vector<std::unique_ptr<Thread>> threads_; // 工作线程
+
+    std::atomic<size_t>  next_;    // 外部提交任务时下一个分配的工作线程
+    std::atomic<size_t>  pending_; // 所有队列中等待执行的任务数目
+    std::atomic<int64_t> steals_;  // 窃取任务的次数
+
+    std::mutex              sleepMtx_; // 与条件变量配合使用
+    std::condition_variable sleepCond_; // 没有任务时工作线程在此等待
+    std::atomic_int         sleepers_;  // 正在等待的工作线程数目
+};
+}
+
+#endif
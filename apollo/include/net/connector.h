@@ -2,26 +2,49 @@
 #define __APOLLO_CONNECTOR_H__
 
 #include "inetaddress.h"
+#include "timerid.h"
 #include <atomic>
 #include <functional>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
 
 namespace apollo
 {
 class EventLoop;
 class Channel;
+class Resolver;
 
 /**
  * @brief 客户端连接类
- * @details 只负责建立socket连接，不负责创建TcpConnection对象 
- * 且具有自动重连的功能，重连时间会逐渐延长，直到30秒
+ * @details 只负责建立socket连接，不负责创建TcpConnection对象
+ * 且具有自动重连的功能，重连时间会逐渐延长，直到30秒。
+ * 连接过程是完全异步的：非阻塞的connect发起连接后通过EPOLLOUT事件得知连接结果，
+ * 每次连接尝试都可以设置超时时间。存在多个候选地址时，默认按顺序逐个尝试，
+ * 开启并行拨号后会同时向所有候选地址发起连接，最先建立成功的连接胜出，其余连接被关闭。
+ * 以主机名构造时，每次发起连接之前先通过Resolver异步解析，解析得到的所有地址作为候选地址
  */
-class Connector : public std::enable_shared_from_this<Connector> 
+class Connector : public std::enable_shared_from_this<Connector>
 {
 public:
     using NewConnectionCallback = std::function<void(int sockfd)>;
 
     Connector(EventLoop* loop, const InetAddress& serverAddr);
+    Connector(EventLoop* loop, const std::vector<InetAddress>& serverAddrs);
+
+    /**
+     * @brief Construct a new Connector object
+     * @details 每次连接和重连之前解析主机名，解析结果的缓存由resolver负责，
+     * 解析失败时按照退避时间重新连接
+     *
+     * @param loop 事件循环
+     * @param resolver 域名解析器，生命周期需要长于Connector
+     * @param host 服务器的主机名
+     * @param port 服务器的端口号
+     */
+    Connector(EventLoop* loop, Resolver* resolver, const std::string& host, uint16_t port);
     Connector(const Connector&) = delete;
     Connector& operator=(const Connector&) = delete;
     ~Connector();
@@ -29,97 +52,198 @@ public:
     //设置新连接的回调函数
     void setNewConnectionCallback(const NewConnectionCallback& cb) { newConnectionCallback_ = cb; }
 
+    /**
+     * @brief 设置每次连接尝试的超时时间
+     * @details 只覆盖三次握手。以TCP Fast Open发起且已有cookie的连接不等待握手，超时不起作用
+     *
+     * @param seconds 超时时间，单位为秒，为0时不设置超时
+     */
+    void setConnectTimeout(double seconds) { connectTimeout_ = seconds; }
+
+    /**
+     * @brief 是否同时向所有候选地址发起连接
+     * @details 开启TCP Fast Open时不生效，仍然按顺序拨号
+     *
+     * @param on
+     */
+    void setParallelDial(bool on) { parallelDial_ = on; }
+
+    /**
+     * @brief 是否以TCP Fast Open发起连接
+     * @details 以TCP_FASTOPEN_CONNECT发起连接，已有服务器的cookie时connect立即成功，
+     * 连接上第一次发送的数据随SYN一起发出，节省一次往返；没有cookie时与普通连接相同。
+     * 此时服务器不可达等错误在第一次发送之后才会以连接断开的形式出现，
+     * 因此连接超时不起作用；并行拨号时第一个候选地址总会立即胜出，所以开启后改为按顺序拨号
+     *
+     * @param on
+     */
+    void setFastOpen(bool on) { fastOpen_ = on; }
+
     void start();
 
     void restart();
 
     void stop();
 
-     const InetAddress& serverAddress() const { return serverAddr_; }
-    
+    /**
+     * @brief 返回服务器地址
+     * @details 连接建立成功后返回实际连接的地址，否则返回第一个候选地址，
+     * 以主机名构造且尚未解析时返回0.0.0.0和端口号。可在任意线程中调用
+     */
+    InetAddress serverAddress() const {
+        std::lock_guard<std::mutex> locker(addrMtx_);
+        return serverAddrs_[connectedIndex_];
+    }
+
+    //返回服务器的主机名，不以主机名构造时为空
+    const std::string& host() const { return host_; }
+
 private:
     /**
      * @brief 连接状态
-     * 
+     *
      */
     enum States {
         kDisconnected, // 已断开连接
+        kResolving,    // 正在解析主机名
         kConnecting,   // 正在连接
         kConnected     // 已建立连接
     };
 
+    /**
+     * @brief 一次正在进行中的连接尝试
+     *
+     */
+    struct Attempt
+    {
+        int                      sockfd;  // 客户端套接字
+        size_t                   index;   // 所连接的候选地址下标
+        std::shared_ptr<Channel> channel; // 通道
+        TimerId                  timer;   // 连接超时定时器
+    };
+
+    using AttemptMap = std::map<int64_t, Attempt>;
+
     /**
      * @brief 设置连接状态
-     * 
-     * @param s 
+     *
+     * @param s
      */
     void setState(States s) { state_ = s; }
 
+    //是否并行拨号 Fast Open的connect不等待握手 无法比较各候选地址的快慢
+    bool parallelDial() const { return parallelDial_ && !fastOpen_; }
+
     /**
      * @brief 启动连接任务
-     * 
+     *
      */
     void startInLoop();
 
     /**
      * @brief 停止连接任务
-     * 
+     *
      */
     void stopInLoop();
 
     /**
-     * @brief 与服务器建立连接
-     * 
+     * @brief 向所有候选地址或者第一个候选地址发起连接
+     *
+     */
+    void dial();
+
+    /**
+     * @brief 主机名解析完成
+     *
+     * @param addrs 解析得到的地址，解析失败时为空
+     */
+    void handleResolved(const std::vector<InetAddress>& addrs);
+
+    /**
+     * @brief 与指定的候选地址建立连接
+     *
+     * @param index 候选地址下标
      */
-    void connect();
+    void connect(size_t index);
 
     /**
      * @brief 正在连接，打包Channel对象
-     * 
-     * @param sockfd 
+     *
+     * @param sockfd
+     * @param index 候选地址下标
      */
-    void connecting(int sockfd);
+    void connecting(int sockfd, size_t index);
 
     /**
-     * @brief 移除并重置消息通道
-     * 
-     * @return int 返回客户端套接字
+     * @brief 移除连接尝试，并在本轮事件循环结束后销毁其Channel对象
+     *
+     * @param id 连接尝试ID
+     * @param index 传出参数，所连接的候选地址下标
+     * @return int 返回客户端套接字，不存在时返回-1
      */
-    int removeAndResetChannel();
+    int removeAttempt(int64_t id, size_t* index);
 
     /**
-     * @brief 重置消息通道
-     * 
+     * @brief 关闭所有进行中的连接尝试
+     *
      */
-    void resetChannel();
+    void cancelAttempts();
 
     /**
      * @brief 处理可写事件
-     * 
+     *
+     * @param id 连接尝试ID
      */
-    void handleWrite();
+    void handleWrite(int64_t id);
 
     /**
      * @brief 处理错误事件
-     * 
+     *
+     * @param id 连接尝试ID
      */
-    void handleError();
+    void handleError(int64_t id);
+
+    /**
+     * @brief 处理连接超时
+     *
+     * @param id 连接尝试ID
+     */
+    void handleTimeout(int64_t id);
+
+    /**
+     * @brief 一次连接尝试失败
+     * @details 还有其它进行中的尝试时等待其结果，否则尝试下一个候选地址，
+     * 所有候选地址都失败后按照退避时间重新连接
+     * @param sockfd
+     */
+    void attemptFailed(int sockfd);
 
     /**
      * @brief 重新尝试连接
-     * 
-     * @param sockfd 
+     *
      */
-    void retry(int sockfd);
+    void retry();
 
 private:
-    EventLoop*  loop_;       // 事件循环
-    InetAddress serverAddr_; // 服务器地址
+    EventLoop*               loop_;        // 事件循环
+    std::vector<InetAddress> serverAddrs_; // 候选的服务器地址
+    Resolver*                resolver_;    // 域名解析器 不以主机名构造时为空
+    std::string              host_;        // 服务器的主机名
+    uint16_t                 port_;        // 服务器的端口号
 
     std::atomic_bool connect_; // 是否开始连接
     std::atomic_int  state_;   // 连接状态
 
-    std::unique_ptr<Channel> channel_; // 通道
+    AttemptMap attempts_;      // 进行中的连接尝试
+    int64_t    nextAttemptId_; // 下一个连接尝试ID
+
+    size_t             nextIndex_;      // 顺序拨号时下一个要尝试的候选地址
+    size_t             connectedIndex_; // 连接成功的候选地址
+    mutable std::mutex addrMtx_;        // 在事件循环中修改serverAddrs_和connectedIndex_时加锁 供其他线程读取
+
+    double connectTimeout_; // 每次连接尝试的超时时间
+    bool   parallelDial_;   // 是否并行拨号
+    bool   fastOpen_;       // 是否以TCP Fast Open发起连接
 
     NewConnectionCallback newConnectionCallback_; // 新连接的回调函数
 
@@ -129,4 +253,4 @@ private:
     static const int kInitRetryDelayMs; // 初始化重连时间
 };
 }
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,391 @@
+#ifndef __APOLLO_COROUTINE_H__
+#define __APOLLO_COROUTINE_H__
+
+#ifndef APOLLO_COROUTINE
+#error "coroutine.h requires C++20, configure with -DAPOLLO_COROUTINE=ON"
+#endif
+
+#include "buffer.h"
+#include "callbacks.h"
+#include "computethreadpool.h"
+#include "eventloop.h"
+#include "tcpconnection.h"
+#include <coroutine>
+#include <exception>
+#include <memory>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+namespace apollo
+{
+/**
+ * @brief 协程帧的内存池
+ * @details 按64字节分级缓存释放的协程帧，每个线程各自维护空闲链表，
+ * 同一事件循环中反复创建的协程可以复用帧内存而无需调用malloc。超过上限的帧直接向系统申请
+ */
+class FramePool
+{
+public:
+    static void* allocate(size_t size);
+    static void  deallocate(void* ptr, size_t size);
+
+    static const size_t kAlignment = 64;        // 分级的粒度
+    static const size_t kMaxFrame  = 4096;      // 可缓存的最大帧
+    static const size_t kMaxCached = 256;       // 每一级最多缓存的帧数目
+};
+
+template <typename T>
+class Task;
+
+namespace detail
+{
+//协程承诺对象的公共部分：帧内存来自FramePool，结束时恢复等待该协程的调用方
+class PromiseBase
+{
+public:
+    static void* operator new(size_t size) { return FramePool::allocate(size); }
+    static void  operator delete(void* ptr, size_t size) { FramePool::deallocate(ptr, size); }
+
+    //协程创建后先挂起，由co_await或者coSpawn启动
+    std::suspend_always initial_suspend() noexcept { return {}; }
+
+    //协程结束时以对称转移的方式恢复调用方 不会增加调用栈深度
+    struct FinalAwaiter {
+        bool await_ready() noexcept { return false; }
+
+        template <typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> h) noexcept {
+            std::coroutine_handle<> continuation = h.promise().continuation_;
+            return continuation ? continuation : std::noop_coroutine();
+        }
+
+        void await_resume() noexcept { }
+    };
+
+    FinalAwaiter final_suspend() noexcept { return {}; }
+
+    void unhandled_exception() { exception_ = std::current_exception(); }
+
+    void setContinuation(std::coroutine_handle<> continuation) { continuation_ = continuation; }
+
+protected:
+    std::coroutine_handle<> continuation_; // 等待该协程结束的协程
+    std::exception_ptr      exception_;    // 协程中抛出的异常
+};
+
+template <typename T>
+class Promise : public PromiseBase
+{
+public:
+    Task<T> get_return_object();
+
+    template <typename U>
+    void return_value(U&& value) { value_.emplace(std::forward<U>(value)); }
+
+    T result() {
+        if (exception_) {
+            std::rethrow_exception(exception_);
+        }
+        return std::move(*value_);
+    }
+
+private:
+    std::optional<T> value_; // 协程的返回值
+};
+
+template <>
+class Promise<void> : public PromiseBase
+{
+public:
+    Task<void> get_return_object();
+
+    void return_void() { }
+
+    void result() {
+        if (exception_) {
+            std::rethrow_exception(exception_);
+        }
+    }
+};
+}
+
+/**
+ * @brief 惰性启动的协程任务
+ * @details 协程体在被co_await时才开始执行，结束后恢复等待它的协程。
+ * 最外层的任务通过coSpawn在事件循环中启动
+ *
+ * @tparam T 协程的返回值类型
+ */
+template <typename T = void>
+class [[nodiscard]] Task
+{
+public:
+    using promise_type = detail::Promise<T>;
+    using Handle       = std::coroutine_handle<promise_type>;
+
+    explicit Task(Handle handle)
+        : handle_(handle) { }
+    Task(Task&& other) noexcept
+        : handle_(std::exchange(other.handle_, nullptr)) { }
+    Task& operator=(Task&& other) noexcept {
+        if (this != &other) {
+            if (handle_) {
+                handle_.destroy();
+            }
+            handle_ = std::exchange(other.handle_, nullptr);
+        }
+        return *this;
+    }
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+    ~Task() {
+        if (handle_) {
+            handle_.destroy();
+        }
+    }
+
+    //co_await一个任务时启动该任务 并在其结束后恢复当前协程
+    auto operator co_await() noexcept {
+        struct Awaiter {
+            Handle handle;
+
+            bool await_ready() noexcept { return !handle || handle.done(); }
+
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller) noexcept {
+                handle.promise().setContinuation(caller);
+                return handle;
+            }
+
+            T await_resume() { return handle.promise().result(); }
+        };
+        return Awaiter { handle_ };
+    }
+
+private:
+    Handle handle_; // 协程句柄
+};
+
+namespace detail
+{
+template <typename T>
+Task<T> Promise<T>::get_return_object() {
+    return Task<T>(std::coroutine_handle<Promise<T>>::from_promise(*this));
+}
+
+inline Task<void> Promise<void>::get_return_object() {
+    return Task<void>(std::coroutine_handle<Promise<void>>::from_promise(*this));
+}
+
+//coSpawn使用的顶层协程：执行结束后自动销毁
+struct Detached {
+    struct promise_type {
+        static void* operator new(size_t size) { return FramePool::allocate(size); }
+        static void  operator delete(void* ptr, size_t size) { FramePool::deallocate(ptr, size); }
+
+        Detached get_return_object() {
+            return Detached { std::coroutine_handle<promise_type>::from_promise(*this) };
+        }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_never  final_suspend() noexcept { return {}; }
+        void                return_void() { }
+        void                unhandled_exception();
+    };
+
+    std::coroutine_handle<promise_type> handle;
+};
+}
+
+/**
+ * @brief 在事件循环中启动一个顶层协程
+ * @details 协程总是在事件循环的下一轮回调中开始执行，不会在调用方的回调中嵌套执行，
+ * 因此可以在ConnectionCallback中为新连接启动协程。协程中未捕获的异常会被记录到日志
+ *
+ * @param loop 执行协程的事件循环
+ * @param task 协程任务
+ */
+void coSpawn(EventLoop* loop, Task<void> task);
+
+/**
+ * @brief 在事件循环中挂起当前协程一段时间
+ * @details 用法：co_await sleepFor(loop, 0.5); 协程在loop线程中恢复
+ *
+ * @param loop 当前协程所在的事件循环
+ * @param seconds 挂起的时间，单位为秒
+ */
+inline auto sleepFor(EventLoop* loop, double seconds) {
+    struct Awaiter {
+        EventLoop* loop;
+        double     seconds;
+
+        bool await_ready() const noexcept { return seconds <= 0; }
+
+        void await_suspend(std::coroutine_handle<> h) {
+            loop->runAfter(seconds, [h] { h.resume(); });
+        }
+
+        void await_resume() const noexcept { }
+    };
+    return Awaiter { loop, seconds };
+}
+
+/**
+ * @brief 在计算线程池中执行func，完成后回到loop中恢复当前协程
+ * @details 用于在协程中调用耗时的计算或者阻塞的同步接口，例如同步的RPC调用：
+ * auto ok = co_await offload(pool, loop, [&] { stub.Login(&ctl, &req, &rsp, nullptr); return !ctl.Failed(); });
+ * func中抛出的异常会在协程恢复时重新抛出。
+ * 注意GCC 12会将co_await表达式中带有非平凡捕获（如按值捕获std::string）的lambda临时对象析构两次，
+ * 这类lambda需要先保存为局部变量再传入
+ *
+ * @param pool 计算线程池
+ * @param loop 当前协程所在的事件循环
+ * @param func 要执行的函数
+ */
+template <typename F>
+auto offload(ComputeThreadPool& pool, EventLoop* loop, F func) {
+    using R = std::invoke_result_t<F&>;
+
+    struct Awaiter {
+        ComputeThreadPool& pool;
+        EventLoop*         loop;
+        F                  func;
+
+        std::conditional_t<std::is_void_v<R>, bool, std::optional<R>> result {};
+        std::exception_ptr exception;
+
+        bool await_ready() const noexcept { return false; }
+
+        void await_suspend(std::coroutine_handle<> h) {
+            // 协程挂起期间Awaiter位于协程帧中 地址保持不变
+            pool.postAndContinue(loop, [this] {
+                try {
+                    if constexpr (std::is_void_v<R>) {
+                        func();
+                    } else {
+                        result.emplace(func());
+                    }
+                } catch (...) {
+                    exception = std::current_exception();
+                }
+            },
+                [h] { h.resume(); });
+        }
+
+        R await_resume() {
+            if (exception) {
+                std::rethrow_exception(exception);
+            }
+            if constexpr (!std::is_void_v<R>) {
+                return std::move(*result);
+            }
+        }
+    };
+    return Awaiter { pool, loop, std::move(func) };
+}
+
+/**
+ * @brief 以协程方式读写TcpConnection
+ * @details 构造时接管连接的ConnectionCallback、MessageCallback和WriteCompleteCallback，
+ * 读写操作挂起当前协程，数据到达或者发送完成时在连接所属的事件循环中直接恢复协程，
+ * 中间不经过额外的回调队列。同一时刻最多只能有一个读操作和一个写操作在等待。
+ * 协程启动之前到达的数据保留在连接的输入缓冲区中，因此服务器不应再设置会消费数据的MessageCallback。
+ * 必须在连接所属的事件循环线程中创建和使用，通常在coSpawn启动的协程中创建：
+ *
+ *     Task<> echo(TcpConnectionPtr conn) {
+ *         CoConnection c(conn);
+ *         for (;;) {
+ *             std::string data = co_await c.readSome();
+ *             if (data.empty()) break;
+ *             co_await c.write(data);
+ *         }
+ *     }
+ */
+class CoConnection
+{
+public:
+    explicit CoConnection(const TcpConnectionPtr& conn);
+    CoConnection(const CoConnection&) = delete;
+    CoConnection& operator=(const CoConnection&) = delete;
+    ~CoConnection();
+
+    //返回底层的连接对象
+    const TcpConnectionPtr& connection() const { return conn_; }
+
+    //连接是否已经断开
+    bool closed() const { return state_->closed; }
+
+    /**
+     * @brief 读取恰好n字节的数据
+     *
+     * @return 读取到的数据，连接在凑齐n字节之前断开时返回空字符串
+     */
+    auto read(size_t n) { return ReadAwaiter { this, n, false }; }
+
+    /**
+     * @brief 读取当前可读的全部数据，没有数据时挂起直到有数据到达
+     *
+     * @return 读取到的数据，连接断开时返回空字符串
+     */
+    auto readSome() { return ReadAwaiter { this, 1, true }; }
+
+    /**
+     * @brief 读取一个4字节长度前缀的消息
+     *
+     * @return 消息内容，不包含长度前缀，连接断开时返回空
+     */
+    Task<std::optional<std::string>> readFrame();
+
+    /**
+     * @brief 发送数据，数据全部写入内核后恢复协程
+     *
+     * @return 发送成功返回true，连接已断开时返回false
+     */
+    auto write(const std::string& data) { return WriteAwaiter { this, &data }; }
+
+    //关闭连接的写端
+    void shutdown() { conn_->shutdown(); }
+
+private:
+    //连接回调与协程之间共享的状态 回调可能在CoConnection析构后仍被调用
+    struct State {
+        std::coroutine_handle<> reader;       // 等待读取的协程
+        size_t                  want   = 0;   // 读取协程等待的字节数
+        std::coroutine_handle<> writer;       // 等待发送完成的协程
+        bool                    closed = false;
+    };
+
+    struct ReadAwaiter {
+        CoConnection* self;
+        size_t        n;
+        bool          some; // 是否读取全部可读数据
+
+        bool        await_ready() const noexcept { return self->readable() >= n || self->state_->closed; }
+        void        await_suspend(std::coroutine_handle<> h) noexcept;
+        std::string await_resume();
+    };
+
+    struct WriteAwaiter {
+        CoConnection*      self;
+        const std::string* data;
+        bool               sent = false; // 是否已经交给连接发送
+
+        bool await_ready() const noexcept { return !self->conn_->connected(); }
+        void await_suspend(std::coroutine_handle<> h);
+        bool await_resume() const noexcept { return sent && !self->state_->closed; }
+    };
+
+    //输入缓冲区中可读的字节数
+    size_t readable() const { return conn_->inputBuffer()->readableBytes(); }
+
+    static void onConnection(const std::shared_ptr<State>& state, const TcpConnectionPtr& conn);
+    static void onMessage(const std::shared_ptr<State>& state, Buffer* buffer);
+    static void onWriteComplete(const std::shared_ptr<State>& state);
+
+private:
+    TcpConnectionPtr       conn_;  // 连接对象
+    std::shared_ptr<State> state_; // 与连接回调共享的状态
+};
+}
+
+#endif
@@ -6,9 +6,11 @@
 #include "timerid.h"
 #include "timestamp.h"
 #include <atomic>
+#include <deque>
 #include <functional>
 #include <memory>
 #include <mutex>
+#include <typeinfo>
 #include <vector>
 
 namespace apollo
@@ -16,6 +18,21 @@ namespace apollo
 class Channel;
 class Poller;
 class TimerQueue;
+
+/**
+ * @brief 事件循环的心跳，由事件循环线程更新，供Watchdog在其他线程中读取
+ * @details 以shared_ptr共享，事件循环销毁之后Watchdog仍然可以安全地读取并发现其已退出
+ */
+struct LoopHeartbeat {
+    pid_t                              tid       = 0;       // 事件循环所在的线程
+    const void*                        loop      = nullptr; // 事件循环的地址 只用于标识
+    std::atomic<int64_t>               busySince { 0 };     // 本轮poll返回的时间 单位为微秒 阻塞在poll中时为0
+    std::atomic<uint64_t>              iteration { 0 };     // 已经完成的循环次数
+    std::atomic<int>                   fd { -1 };           // 正在处理事件的Channel 不在处理事件时为-1
+    std::atomic<const std::type_info*> functor { nullptr }; // 正在执行的回调函数的类型 不在执行回调时为空
+    std::atomic_bool                   exited { false };    // 事件循环是否已经退出
+};
+
 class EventLoop
 {
 public:
@@ -37,6 +54,12 @@ public:
      */
     Timestamp pollReturnTime() const { return pollReturnTime_; }
 
+    //处理事件和回调函数累计花费的时间，单位为微秒，可在任意线程中读取，两次读取之差除以经过的时间即为负载
+    int64_t busyTime() const { return busyTime_.load(std::memory_order_relaxed); }
+
+    //返回事件循环的心跳，用于检测长时间阻塞的回调，见Watchdog
+    std::shared_ptr<LoopHeartbeat> heartbeat() const { return heartbeat_; }
+
     /**
      * @brief 立即在当前事件循环中执行回调函数
      * 
@@ -51,6 +74,24 @@ public:
      */
     void queueInLoop(Functor cb);
 
+    /**
+     * @brief 在事件循环空闲时执行低优先级的任务，可在任意线程中调用
+     * @details 用于缩减缓冲区、汇总统计、清理缓存等维护工作。一轮poll返回的激活事件不超过setIdlePolicy设置的数目时，
+     * 才在处理完IO和queueInLoop的回调之后按提交顺序执行空闲任务，每轮执行的时间不超过预算，剩余的任务留到下一轮。
+     * 还有空闲任务时poll不会阻塞，持续繁忙时空闲任务会一直推迟。空闲任务的执行时间不计入busyTime
+     *
+     * @param task 要执行的任务
+     */
+    void queueIdle(Functor task);
+
+    /**
+     * @brief 设置执行空闲任务的条件，需要在事件循环线程中调用
+     *
+     * @param maxEvents 一轮poll返回的激活事件不超过该数目时视为空闲，默认为1
+     * @param budget 每轮执行空闲任务的时间预算，单位为秒，每轮至少执行一个任务，默认为1毫秒
+     */
+    void setIdlePolicy(size_t maxEvents, double budget);
+
     /**
      * @brief 在某个指定时间点运行回调函数
      * 
@@ -118,6 +159,9 @@ public:
      */
     bool isInLoopThread() const { return threadId_ == ThreadHelper::ThreadId(); }
 
+    //返回当前线程中的事件循环，当前线程没有事件循环时返回nullptr
+    static EventLoop* getEventLoopOfCurrentThread();
+
 
 private:
     /**
@@ -130,6 +174,12 @@ private:
      * 
      */
     void doPendingFunctors();
+
+    //在预算内执行空闲任务
+    void doIdleFunctors();
+
+    //执行回调函数 并在心跳中记录其类型
+    void runFunctor(const Functor& functor);
     
 
 private:
@@ -140,11 +190,19 @@ private:
 
     std::atomic_bool     callingPendingFunctors_; // 当前loop是否正在执行回调操作
     std::vector<Functor> pendingFunctors_;        // 当前事件循环需要执行的回调函数列表
+    std::vector<Functor> pendingIdleFunctors_;    // 其他线程提交的空闲任务
     std::mutex           mtx_;                    // 保护回调函数列表的线程安全
 
     const pid_t threadId_; // 记录当前loop所在线程的ID
 
-    Timestamp pollReturnTime_; // 激活事件到来的时间戳
+    std::deque<Functor> idleFunctors_;  // 等待执行的空闲任务 只在事件循环线程中访问
+    size_t              idleMaxEvents_; // 激活事件不超过该数目时执行空闲任务
+    int64_t             idleBudget_;    // 每轮执行空闲任务的时间预算 单位为微秒
+
+    Timestamp            pollReturnTime_; // 激活事件到来的时间戳
+    std::atomic<int64_t> busyTime_;       // 处理事件和回调函数累计花费的时间 单位为微秒
+
+    std::shared_ptr<LoopHeartbeat> heartbeat_; // 事件循环的心跳
 
     std::unique_ptr<Poller>     poller_;     // 多路复用器
     std::unique_ptr<TimerQueue> timerQueue_; // 定时器队列
@@ -1,10 +1,14 @@
 #ifndef __APOLLO_EVENTLOOPTHREADPOOL_H__
 #define __APOLLO_EVENTLOOPTHREADPOOL_H__
 
+#include <cstdint>
 #include <functional>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <thread>
+#include <utility>
 #include <vector>
 
 namespace apollo
@@ -12,11 +16,18 @@ namespace apollo
 class EventLoop;
 class EventLoopThread;
 
-//事件循环线程池
+/**
+ * @brief 事件循环线程池
+ * @details 启动之后可以通过addLoop、retireLoop和stopLoop在运行时调整分配任务的线程数目，
+ * 查询事件循环的接口可以在任意线程中调用。停止分配任务的事件循环保持运行直到线程池析构，
+ * 其他线程取得的事件循环指针因此一直有效，向其投递的任务总会执行；之后增加线程时优先复用这些事件循环
+ */
 class EventLoopThreadPool
 {
 public:
     using ThreadInitCallback = std::function<void(EventLoop*)>;
+    using Functor            = std::function<void()>;
+    using LoopCallback       = std::function<void(EventLoop*)>;
 
     /**
      * @brief Construct a new Event Loop Thread Pool object
@@ -53,6 +64,67 @@ public:
      */
     std::vector<EventLoop*> getAllLoop() const;
 
+    /**
+     * @brief 获取key对应的事件循环
+     * @details 以一致性哈希将key映射到SubLoop，同一个key总是映射到同一个事件循环，
+     * 线程数目变化时只有少部分key会映射到其他事件循环。需要在线程池启动后调用
+     *
+     * @param key 分片的键，例如用户ID
+     * @return EventLoop*
+     */
+    EventLoop* getLoopForKey(const std::string& key) const;
+    EventLoop* getLoopForKey(uint64_t key) const;
+
+    /**
+     * @brief 在key对应的事件循环中执行任务
+     * @details 同一个key的任务总是在同一个线程中按提交顺序执行，
+     * 因此任务中访问的按key分片的状态（见LoopLocal）不需要加锁。
+     * 任务总是排队执行，在目标事件循环中调用时也不会立即执行
+     *
+     * @param key 分片的键
+     * @param task 要执行的任务
+     */
+    void runOnKey(const std::string& key, Functor task) const;
+    void runOnKey(uint64_t key, Functor task) const;
+
+    /**
+     * @brief 在运行时增加一个分配任务的事件循环，需要在以至少一个线程启动之后调用
+     * @details 有已经停止的事件循环时复用它，否则启动新线程并通知观察者，
+     * 之后再加入轮询列表和哈希环，getNextLoop与getLoopForKey才会返回它。
+     * 哈希环只增加该线程的虚拟节点，约1/n的key改为映射到新的事件循环，按key分片的状态需要能够容忍这种变化
+     *
+     * @return 加入的事件循环，线程池未启动或者没有SubLoop时返回nullptr
+     */
+    EventLoop* addLoop();
+
+    /**
+     * @brief 将事件循环从轮询列表和哈希环中移除，之后不再分配给新的任务
+     * @details 事件循环继续运行，调用方将其上的连接和状态迁移走之后再调用stopLoop。
+     * 不能移除最后一个SubLoop
+     *
+     * @return 成功移除时返回true
+     */
+    bool retireLoop(EventLoop* loop);
+
+    /**
+     * @brief 标记已经移除并且迁移完毕的事件循环，之后addLoop可以复用它
+     * @details 事件循环不会退出，直到线程池析构时才回收线程。其他线程可能还持有之前取得的指针，
+     * 向其投递的任务照常执行，观察者为它创建的状态也一直保留
+     */
+    void stopLoop(EventLoop* loop);
+
+    /**
+     * @brief 注册新线程的观察者，LoopLocal通过它跟随线程池的变化
+     * @details added在新线程的事件循环对外可见之前、在调整线程池的线程中调用，复用已停止的事件循环时不调用
+     *
+     * @return 观察者的ID，用于注销
+     */
+    int  addObserver(const LoopCallback& added);
+    void removeObserver(int id);
+
+    //当前分配任务的SubLoop数目
+    int threadNum() const;
+
     //线程池是否已经启动
     bool started() const { return started_; }
 
@@ -60,18 +132,45 @@ public:
     const std::string& name() const { return name_; }
 
 private:
-    EventLoop*  mainLoop_;   // 基本事件循环
-    std::string name_;       // 线程池名称
-    bool        started_;    // 线程池是否启动
-    int         numThreads_; // 线程数量
-    int         next_;       // 下一个执行的事件循环
+    //在哈希环上查找hash对应的事件循环
+    EventLoop* getLoopForHash(uint64_t hash) const;
+
+    //创建并启动一个事件循环线程 返回事件循环和线程名称
+    std::pair<EventLoop*, std::string> startThread();
+
+    //将事件循环加入轮询列表和哈希环 需要持有mtx_
+    void publish(EventLoop* loop, const std::string& threadName);
+
+    //事件循环线程
+    struct LoopThread {
+        EventLoop*                       loop;   // 事件循环
+        std::string                      name;   // 线程名称 决定虚拟节点在哈希环上的位置
+        std::unique_ptr<EventLoopThread> thread; // 线程对象
+    };
+
+    using Observers = std::map<int, LoopCallback>;
+
+private:
+    static const int kVirtualNodes = 160; // 每个事件循环在哈希环上的虚拟节点数目
 
-    std::vector<std::unique_ptr<EventLoopThread>> threads_; // 线程对象
+    EventLoop*         mainLoop_;     // 基本事件循环
+    std::string        name_;         // 线程池名称
+    bool               started_;      // 线程池是否启动
+    int                numThreads_;   // 线程数量
+    int                nextThreadId_; // 下一个线程的序号 用于命名
+    size_t             next_;         // 下一个执行的事件循环
+    ThreadInitCallback initCallback_; // 线程初始化回调 运行时增加的线程也会调用
 
-    std::vector<EventLoop*> loops_; // 事件循环对象
+    mutable std::mutex mtx_; // 保护以下成员 线程池的大小可以在运行时调整
 
+    std::vector<LoopThread> threads_; // 启动过的所有线程 线程池析构时才回收
+    std::vector<EventLoop*> loops_;   // 分配任务的事件循环对象
+    std::vector<EventLoop*> stopped_; // 已经停止 可以复用的事件循环
 
+    std::vector<std::pair<uint64_t, EventLoop*>> ring_; // 按哈希值排序的一致性哈希环
 
+    int       nextObserverId_; // 下一个观察者的ID
+    Observers observers_;      // 事件循环增减的观察者
 };
 }
 #endif
\ No newline at end of file
@@ -0,0 +1,441 @@
+#ifndef __APOLLO_FUTURE_H__
+#define __APOLLO_FUTURE_H__
+
+#include "eventloop.h"
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace apollo
+{
+//没有返回值的操作以Unit作为结果类型，即Future<Unit>
+struct Unit {
+};
+
+template <typename T>
+class Future;
+
+template <typename T>
+class Promise;
+
+namespace detail
+{
+//函数以指定参数调用时的返回类型，std::result_of在C++20中已被移除
+template <typename F, typename... Args>
+struct ResultOf {
+    using type = decltype(std::declval<F&>()(std::declval<Args>()...));
+};
+
+//将void映射为Unit
+template <typename R>
+struct Lift {
+    using type = R;
+};
+
+template <>
+struct Lift<void> {
+    using type = Unit;
+};
+
+//调用函数并将结果写入Promise，函数返回void时写入Unit
+template <typename R>
+struct Invoker {
+    template <typename P, typename F, typename... Args>
+    static void run(P& promise, F& func, Args&&... args) {
+        promise.setValue(func(std::forward<Args>(args)...));
+    }
+};
+
+template <>
+struct Invoker<void> {
+    template <typename P, typename F, typename... Args>
+    static void run(P& promise, F& func, Args&&... args) {
+        func(std::forward<Args>(args)...);
+        promise.setValue(Unit());
+    }
+};
+
+/**
+ * @brief Future与Promise之间的共享状态
+ * @details 结果就绪时，若已设置回调则将回调投递到指定事件循环的任务队列中执行，
+ * 未指定事件循环时在设置结果的线程中直接执行
+ */
+template <typename T>
+class SharedState
+{
+public:
+    using Callback = std::function<void()>;
+
+    SharedState()
+        : ready_(false)
+        , hasValue_(false)
+        , loop_(nullptr) { }
+    SharedState(const SharedState&) = delete;
+    SharedState& operator=(const SharedState&) = delete;
+    ~SharedState() {
+        if (hasValue_) {
+            value()->~T();
+        }
+    }
+
+    template <typename U>
+    void setValue(U&& value) {
+        std::unique_lock<std::mutex> lock(mtx_);
+        if (ready_) {
+            throw std::logic_error("promise already satisfied");
+        }
+        new (&storage_) T(std::forward<U>(value));
+        hasValue_ = true;
+        complete(lock);
+    }
+
+    void setException(std::exception_ptr exception) {
+        std::unique_lock<std::mutex> lock(mtx_);
+        if (ready_) {
+            throw std::logic_error("promise already satisfied");
+        }
+        exception_ = exception;
+        complete(lock);
+    }
+
+    //设置结果就绪后执行的回调，只能设置一次
+    void setCallback(EventLoop* loop, Callback cb) {
+        std::unique_lock<std::mutex> lock(mtx_);
+        if (!ready_) {
+            loop_     = loop;
+            callback_ = std::move(cb);
+            return;
+        }
+        lock.unlock();
+        dispatch(loop, std::move(cb));
+    }
+
+    bool ready() {
+        std::lock_guard<std::mutex> lock(mtx_);
+        return ready_;
+    }
+
+    //阻塞等待结果就绪
+    void wait() {
+        std::unique_lock<std::mutex> lock(mtx_);
+        cond_.wait(lock, [this] { return ready_; });
+    }
+
+    //取出结果，结果为异常时重新抛出，需要在结果就绪后调用
+    T take() {
+        std::lock_guard<std::mutex> lock(mtx_);
+        if (exception_) {
+            std::rethrow_exception(exception_);
+        }
+        if (!hasValue_) {
+            throw std::logic_error("future value already taken");
+        }
+        T result(std::move(*value()));
+        value()->~T();
+        hasValue_ = false;
+        return result;
+    }
+
+private:
+    T* value() { return reinterpret_cast<T*>(&storage_); }
+
+    //标记结果就绪 唤醒等待者并派发回调 调用前需持有锁
+    void complete(std::unique_lock<std::mutex>& lock) {
+        ready_          = true;
+        EventLoop* loop = loop_;
+        Callback   cb   = std::move(callback_);
+        callback_       = nullptr;
+        cond_.notify_all();
+        lock.unlock();
+        if (cb) {
+            dispatch(loop, std::move(cb));
+        }
+    }
+
+    static void dispatch(EventLoop* loop, Callback cb) {
+        if (loop) {
+            loop->queueInLoop(std::move(cb));
+        } else {
+            cb();
+        }
+    }
+
+private:
+    std::mutex              mtx_;      // 保护以下成员
+    std::condition_variable cond_;     // 用于阻塞等待结果
+    bool                    ready_;    // 结果是否就绪
+    bool                    hasValue_; // storage_中是否存有结果
+
+    typename std::aligned_storage<sizeof(T), alignof(T)>::type storage_; // 结果
+
+    std::exception_ptr exception_; // 异常结果
+    EventLoop*         loop_;      // 执行回调的事件循环
+    Callback           callback_;  // 结果就绪后的回调
+};
+}
+
+/**
+ * @brief 异步操作的结果
+ * @details Future只能被消费一次：调用get、then或者onComplete之后不再有效。
+ * 后续操作通过then投递到指定事件循环的任务队列中执行，完成时不会阻塞任何线程。
+ * 只有get会在结果未就绪时阻塞，不能在产生结果的事件循环线程中调用
+ *
+ * @tparam T 结果类型，没有结果时使用Unit
+ */
+template <typename T>
+class Future
+{
+public:
+    using value_type = T;
+
+    Future() = default;
+    explicit Future(std::shared_ptr<detail::SharedState<T>> state)
+        : state_(std::move(state)) { }
+    Future(Future&&) = default;
+    Future& operator=(Future&&) = default;
+    Future(const Future&) = delete;
+    Future& operator=(const Future&) = delete;
+
+    //是否关联了共享状态
+    bool valid() const { return static_cast<bool>(state_); }
+
+    //结果是否已经就绪
+    bool ready() const { return state_ && state_->ready(); }
+
+    //阻塞等待结果就绪
+    void wait() const { state_->wait(); }
+
+    /**
+     * @brief 阻塞等待并取出结果
+     * @details 结果为异常时重新抛出，不能在产生结果的事件循环线程中调用，否则会死锁
+     */
+    T get() {
+        std::shared_ptr<detail::SharedState<T>> state = std::move(state_);
+        state->wait();
+        return state->take();
+    }
+
+    /**
+     * @brief 结果就绪后在loop中以结果调用func，返回func结果的Future
+     * @details 结果为异常时不调用func，异常直接传递给返回的Future；func抛出的异常同样如此
+     *
+     * @param loop 执行func的事件循环，为nullptr时在产生结果的线程中直接执行
+     * @param func 接收T的函数，返回void时返回的Future结果类型为Unit
+     */
+    template <typename F>
+    Future<typename detail::Lift<typename detail::ResultOf<F, T>::type>::type> then(EventLoop* loop, F func) {
+        using R = typename detail::ResultOf<F, T>::type;
+        using U = typename detail::Lift<R>::type;
+
+        Promise<U> promise;
+        Future<U>  future = promise.getFuture();
+
+        // 回调持有共享状态 结果就绪时回调会先从共享状态中移出再执行 因此不会残留循环引用
+        std::shared_ptr<detail::SharedState<T>> state = std::move(state_);
+        state->setCallback(loop, [state, promise, func]() mutable {
+            try {
+                detail::Invoker<R>::run(promise, func, state->take());
+            } catch (...) {
+                promise.setException(std::current_exception());
+            }
+        });
+        return future;
+    }
+
+    /**
+     * @brief 结果就绪后在loop中调用func，func接收已就绪的Future
+     * @details 与then不同，结果为异常时同样调用func，可通过get取出结果或者捕获异常
+     *
+     * @param loop 执行func的事件循环，为nullptr时在产生结果的线程中直接执行
+     * @param func 接收Future<T>的函数
+     */
+    template <typename F>
+    void onComplete(EventLoop* loop, F func) {
+        std::shared_ptr<detail::SharedState<T>> state = std::move(state_);
+        state->setCallback(loop, [state, func]() mutable {
+            Future<T> ready(std::move(state));
+            func(ready);
+        });
+    }
+
+private:
+    std::shared_ptr<detail::SharedState<T>> state_; // 共享状态
+};
+
+/**
+ * @brief 异步操作结果的写入端
+ * @details Promise可以复制，所有副本共享同一个结果，结果只能设置一次。
+ * 所有副本都销毁而未设置结果时，等待中的Future不会被唤醒，因此每个Promise都应最终设置结果
+ *
+ * @tparam T 结果类型
+ */
+template <typename T>
+class Promise
+{
+public:
+    Promise()
+        : state_(std::make_shared<detail::SharedState<T>>()) { }
+
+    //返回关联的Future，只能调用一次
+    Future<T> getFuture() { return Future<T>(state_); }
+
+    //设置结果
+    template <typename U>
+    void setValue(U&& value) { state_->setValue(std::forward<U>(value)); }
+
+    //设置异常结果
+    void setException(std::exception_ptr exception) { state_->setException(exception); }
+
+private:
+    std::shared_ptr<detail::SharedState<T>> state_; // 共享状态
+};
+
+//返回已经就绪的Future
+template <typename T>
+Future<typename std::decay<T>::type> makeReadyFuture(T&& value) {
+    Promise<typename std::decay<T>::type> promise;
+    promise.setValue(std::forward<T>(value));
+    return promise.getFuture();
+}
+
+/**
+ * @brief 在事件循环中执行func，返回func结果的Future
+ * @details 与EventLoop::runInLoop相同，在loop线程中调用时直接执行
+ *
+ * @param loop 执行func的事件循环
+ * @param func 无参数的函数，返回void时Future结果类型为Unit
+ */
+template <typename F>
+Future<typename detail::Lift<typename detail::ResultOf<F>::type>::type> runInLoopAsync(EventLoop* loop, F func) {
+    using R = typename detail::ResultOf<F>::type;
+    using U = typename detail::Lift<R>::type;
+
+    Promise<U> promise;
+    Future<U>  future = promise.getFuture();
+    loop->runInLoop([promise, func]() mutable {
+        try {
+            detail::Invoker<R>::run(promise, func);
+        } catch (...) {
+            promise.setException(std::current_exception());
+        }
+    });
+    return future;
+}
+
+/**
+ * @brief 所有Future都就绪后，以全部结果组成的数组完成
+ * @details 任意一个Future的结果为异常时，返回的Future以第一个异常完成
+ *
+ * @param futures 输入的Future，调用后不再有效
+ * @return Future<std::vector<T>> 结果顺序与输入顺序一致
+ */
+template <typename T>
+Future<std::vector<T>> whenAll(std::vector<Future<T>>& futures) {
+    struct Context {
+        std::mutex                      mtx;
+        size_t                          remaining;
+        bool                            failed;
+        std::vector<std::unique_ptr<T>> values;
+        Promise<std::vector<T>>         promise;
+    };
+
+    std::shared_ptr<Context> ctx = std::make_shared<Context>();
+    ctx->remaining               = futures.size();
+    ctx->failed                  = false;
+    ctx->values.resize(futures.size());
+    Future<std::vector<T>> result = ctx->promise.getFuture();
+
+    if (futures.empty()) {
+        ctx->promise.setValue(std::vector<T>());
+        return result;
+    }
+
+    for (size_t i = 0; i < futures.size(); ++i) {
+        futures[i].onComplete(nullptr, [ctx, i](Future<T>& ready) {
+            std::unique_ptr<T> value;
+            std::exception_ptr exception;
+            try {
+                value.reset(new T(ready.get()));
+            } catch (...) {
+                exception = std::current_exception();
+            }
+
+            std::unique_lock<std::mutex> lock(ctx->mtx);
+            if (ctx->failed) {
+                return;
+            }
+            if (exception) {
+                ctx->failed = true;
+                lock.unlock();
+                ctx->promise.setException(exception);
+                return;
+            }
+            ctx->values[i] = std::move(value);
+            if (--ctx->remaining > 0) {
+                return;
+            }
+            lock.unlock();
+
+            std::vector<T> values;
+            values.reserve(ctx->values.size());
+            for (auto& v : ctx->values) {
+                values.push_back(std::move(*v));
+            }
+            ctx->promise.setValue(std::move(values));
+        });
+    }
+    return result;
+}
+
+/**
+ * @brief 任意一个Future就绪后，以其下标和结果完成
+ * @details 最先就绪的Future结果为异常时，返回的Future以该异常完成
+ *
+ * @param futures 输入的Future，不能为空，调用后不再有效
+ * @return Future<std::pair<size_t, T>> 最先就绪的下标与结果
+ */
+template <typename T>
+Future<std::pair<size_t, T>> whenAny(std::vector<Future<T>>& futures) {
+    struct Context {
+        std::mutex                    mtx;
+        bool                          done;
+        Promise<std::pair<size_t, T>> promise;
+    };
+
+    std::shared_ptr<Context> ctx = std::make_shared<Context>();
+    ctx->done                    = false;
+    Future<std::pair<size_t, T>> result = ctx->promise.getFuture();
+
+    if (futures.empty()) {
+        ctx->promise.setException(std::make_exception_ptr(std::invalid_argument("whenAny on empty futures")));
+        return result;
+    }
+
+    for (size_t i = 0; i < futures.size(); ++i) {
+        futures[i].onComplete(nullptr, [ctx, i](Future<T>& ready) {
+            {
+                std::lock_guard<std::mutex> lock(ctx->mtx);
+                if (ctx->done) {
+                    return;
+                }
+                ctx->done = true;
+            }
+            try {
+                ctx->promise.setValue(std::make_pair(i, ready.get()));
+            } catch (...) {
+                ctx->promise.setException(std::current_exception());
+            }
+        });
+    }
+    return result;
+}
+}
+
+#endif
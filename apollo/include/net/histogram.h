@@ -0,0 +1,90 @@
+#ifndef __APOLLO_HISTOGRAM_H__
+#define __APOLLO_HISTOGRAM_H__
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace apollo
+{
+/**
+ * @brief HDR风格的直方图，用于统计延迟等数值的分布
+ * @details 采用对数线性分桶：小于128的数值每个数值一个桶，此后每个2的幂区间再均分为64个桶，
+ * 因此任意数值的相对误差不超过1/64，内存占用与记录的数值数目无关。
+ * 数值的单位由使用方决定，例如微秒。该类不是线程安全的，
+ * 多线程统计时每个线程各自记录，最后通过merge进行汇总
+ */
+class Histogram
+{
+public:
+    static const int64_t kDefaultMaxValue = int64_t(1) << 40; // 默认可记录的最大数值
+
+    /**
+     * @brief Construct a new Histogram object
+     *
+     * @param maxValue 可记录的最大数值，超出的数值按最大数值记录
+     */
+    explicit Histogram(int64_t maxValue = kDefaultMaxValue);
+
+    /**
+     * @brief 记录一个数值
+     *
+     * @param value 数值，小于0时按0记录
+     * @param count 记录的次数
+     */
+    void record(int64_t value, int64_t count = 1);
+
+    //合并另一个直方图中的记录，两者的最大数值需要相同
+    void merge(const Histogram& other);
+
+    //清空所有记录
+    void reset();
+
+    //返回记录的数值数目
+    int64_t count() const { return count_; }
+
+    //返回记录的最小数值
+    int64_t min() const { return count_ == 0 ? 0 : min_; }
+
+    //返回记录的最大数值
+    int64_t max() const { return max_; }
+
+    //返回记录的平均数值
+    double mean() const { return count_ == 0 ? 0.0 : static_cast<double>(sum_) / count_; }
+
+    /**
+     * @brief 返回百分位数
+     * @details 返回的是百分位所在桶的上界，不会超过记录的最大数值
+     *
+     * @param percentile 百分位，取值范围为[0, 100]
+     */
+    int64_t percentile(double percentile) const;
+
+    /**
+     * @brief 以文本形式返回常用的统计值
+     *
+     * @return std::string 例如 count=100 min=1 mean=2.5 p50=2 p90=4 p99=8 p999=9 max=9
+     */
+    std::string toString() const;
+
+private:
+    //返回数值所在桶的下标
+    static size_t bucketIndex(int64_t value);
+
+    //返回桶的上界
+    static int64_t bucketUpperBound(size_t index);
+
+private:
+    static const int kSubBucketBits  = 7;                       // 线性区间的位数
+    static const int kSubBucketCount = 1 << kSubBucketBits;     // 线性区间的桶数目
+    static const int kSubBucketHalf  = kSubBucketCount / 2;     // 每个2的幂区间的桶数目
+
+    int64_t              maxValue_; // 可记录的最大数值
+    std::vector<int64_t> counts_;   // 每个桶中的数值数目
+    int64_t              count_;    // 记录的数值数目
+    int64_t              sum_;      // 记录的数值之和
+    int64_t              min_;      // 记录的最小数值
+    int64_t              max_;      // 记录的最大数值
+};
+}
+#endif
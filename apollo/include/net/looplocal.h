@@ -0,0 +1,114 @@
+#ifndef __APOLLO_LOOPLOCAL_H__
+#define __APOLLO_LOOPLOCAL_H__
+
+#include "eventloop.h"
+#include "eventloopthreadpool.h"
+#include <atomic>
+#include <cassert>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace apollo
+{
+/**
+ * @brief 事件循环局部存储
+ * @details 为线程池中的每个事件循环各创建一个T对象，在事件循环线程中通过get访问本循环的对象。
+ * 配合EventLoopThreadPool::runOnKey使用时，同一个key的状态只会在一个线程中被访问，
+ * 可以直接存放在不加锁的容器中：
+ *
+ *     LoopLocal<std::unordered_map<std::string, Session>> sessions(pool);
+ *     pool.runOnKey(userId, [&sessions, userId] { sessions.get()[userId].touch(); });
+ *
+ * 必须在线程池启动之后构造。线程池在运行时启动新线程时自动创建对应的对象，停止的事件循环保留其对象，
+ * 迟到的任务仍然可以访问，复用时继续使用。构造、析构与调整线程池需要在同一个线程中进行（通常是MainLoop）。
+ * 索引在调整时整体替换，旧的索引保留到析构，因此get只需要一次原子读取而不需要加锁
+ *
+ * @tparam T 每个事件循环持有的对象类型
+ */
+template <typename T>
+class LoopLocal
+{
+public:
+    using Factory = std::function<std::unique_ptr<T>(EventLoop*)>;
+
+    //为每个事件循环默认构造一个T
+    explicit LoopLocal(EventLoopThreadPool& pool)
+        : LoopLocal(pool, [](EventLoop*) { return std::unique_ptr<T>(new T()); }) { }
+
+    /**
+     * @brief 为每个事件循环调用factory创建对象
+     *
+     * @param pool 已经启动的事件循环线程池，生命周期需要长于LoopLocal
+     * @param factory 以事件循环为参数创建对象的函数，在构造线程或者调整线程池的线程中调用
+     */
+    LoopLocal(EventLoopThreadPool& pool, const Factory& factory)
+        : pool_(pool)
+        , factory_(factory)
+        , index_(nullptr) {
+        for (EventLoop* loop : pool.getAllLoop()) {
+            values_.emplace_back(loop, factory(loop));
+        }
+        publish();
+        observerId_ = pool_.addObserver(std::bind(&LoopLocal::add, this, std::placeholders::_1));
+    }
+    LoopLocal(const LoopLocal&) = delete;
+    LoopLocal& operator=(const LoopLocal&) = delete;
+    ~LoopLocal() { pool_.removeObserver(observerId_); }
+
+    //返回当前事件循环的对象，只能在线程池的事件循环线程中调用
+    T& get() const { return at(EventLoop::getEventLoopOfCurrentThread()); }
+
+    //返回指定事件循环的对象，在其他线程中访问时需要自行同步
+    T& at(EventLoop* loop) const {
+        const Index& index = *index_.load(std::memory_order_acquire);
+        // 事件循环的数目通常不超过CPU核心数 线性查找比哈希表更快
+        for (const auto& value : index) {
+            if (value.first == loop) {
+                return *value.second;
+            }
+        }
+        assert(false && "EventLoop does not belong to the pool");
+        return *index.front().second;
+    }
+
+    //对每个事件循环的对象调用func，在其他线程中访问时需要自行同步
+    template <typename F>
+    void forEach(F func) const {
+        for (const auto& value : *index_.load(std::memory_order_acquire)) {
+            func(value.first, *value.second);
+        }
+    }
+
+private:
+    using Index = std::vector<std::pair<EventLoop*, T*>>;
+
+    //线程池启动了新线程
+    void add(EventLoop* loop) {
+        values_.emplace_back(loop, factory_(loop));
+        publish();
+    }
+
+    //根据values_生成新的索引并替换
+    void publish() {
+        std::unique_ptr<Index> index(new Index());
+        for (const auto& value : values_) {
+            index->emplace_back(value.first, value.second.get());
+        }
+        index_.store(index.get(), std::memory_order_release);
+        indexes_.push_back(std::move(index));
+    }
+
+private:
+    EventLoopThreadPool& pool_;       // 所属的线程池
+    Factory              factory_;    // 创建对象的函数
+    int                  observerId_; // 在线程池中注册的观察者ID
+
+    std::vector<std::pair<EventLoop*, std::unique_ptr<T>>> values_;  // 每个事件循环对应的对象
+    std::atomic<const Index*>                              index_;   // 当前的索引
+    std::vector<std::unique_ptr<const Index>>              indexes_; // 所有生成过的索引
+};
+}
+
+#endif
@@ -0,0 +1,123 @@
+#ifndef __APOLLO_RATELIMITER_H__
+#define __APOLLO_RATELIMITER_H__
+
+#include "inetaddress.h"
+#include "timestamp.h"
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+namespace apollo
+{
+//限速参数，速率为0的一项不限制
+struct RateLimit {
+    double bytesPerSecond    = 0;   // 每秒读取的字节数
+    double messagesPerSecond = 0;   // 每秒处理的消息数
+    double burstSeconds      = 1.0; // 允许的突发量 以多少秒的配额计算
+
+    //是否限制了任意一项
+    bool enabled() const { return bytesPerSecond > 0 || messagesPerSecond > 0; }
+};
+
+/**
+ * @brief 令牌桶
+ * @details 令牌按rate匀速补充，最多积累burst个。consume允许透支：读到数据之后才知道字节数，
+ * 先取走令牌，再根据欠下的令牌计算需要暂停多久，暂停期间数据留在内核中，不会丢弃
+ */
+class TokenBucket
+{
+public:
+    /**
+     * @brief Construct a new Token Bucket object
+     *
+     * @param rate 每秒补充的令牌数，为0时不限制
+     * @param burst 令牌的最大积累量
+     */
+    explicit TokenBucket(double rate = 0, double burst = 0);
+
+    //是否限制
+    bool enabled() const { return rate_ > 0; }
+
+    /**
+     * @brief 取走n个令牌
+     *
+     * @param n 令牌数
+     * @param now 当前时间
+     * @return double 令牌恢复为非负还需要等待的时间，单位为秒，不需要等待时为0
+     */
+    double consume(double n, Timestamp now);
+
+private:
+    double    rate_;   // 每秒补充的令牌数
+    double    burst_;  // 令牌的最大积累量
+    double    tokens_; // 当前的令牌数 透支时为负
+    Timestamp last_;   // 上一次补充令牌的时间
+};
+
+/**
+ * @brief 字节数和消息数两个令牌桶组成的限速器，线程安全
+ * @details 同一对端IP的多个连接可能属于不同的事件循环，共享同一个限速器
+ */
+class RateLimiter
+{
+public:
+    explicit RateLimiter(const RateLimit& limit);
+    RateLimiter(const RateLimiter&) = delete;
+    RateLimiter& operator=(const RateLimiter&) = delete;
+
+    /**
+     * @brief 记录读取的字节数和消息数
+     *
+     * @param bytes 字节数
+     * @param messages 消息数
+     * @param now 当前时间
+     * @return double 需要暂停读取的时间，单位为秒，不需要暂停时为0
+     */
+    double consume(size_t bytes, size_t messages, Timestamp now);
+
+private:
+    std::mutex  mtx_;      // 保护两个令牌桶
+    TokenBucket bytes_;    // 字节数的令牌桶
+    TokenBucket messages_; // 消息数的令牌桶
+};
+
+/**
+ * @brief 按对端IP分配的限速器，线程安全
+ * @details 同一IP的所有连接共享一个RateLimiter。记录的IP数目不超过maxPeers，
+ * 超出时淘汰最久没有新连接的IP，其已有的连接继续使用原来的限速器，之后的新连接使用新的限速器。
+ * 内存占用因此不超过maxPeers个限速器加上仍然存活的连接所持有的限速器
+ */
+class PeerRateLimiter
+{
+public:
+    /**
+     * @brief Construct a new Peer Rate Limiter object
+     *
+     * @param limit 每个IP的限速参数
+     * @param maxPeers 最多记录的IP数目
+     */
+    PeerRateLimiter(const RateLimit& limit, size_t maxPeers);
+    PeerRateLimiter(const PeerRateLimiter&) = delete;
+    PeerRateLimiter& operator=(const PeerRateLimiter&) = delete;
+
+    //取得对端IP的限速器，不存在时创建
+    std::shared_ptr<RateLimiter> acquire(const InetAddress& peerAddr);
+
+    //返回记录的IP数目
+    size_t size() const;
+
+private:
+    using PeerList = std::list<std::pair<uint32_t, std::shared_ptr<RateLimiter>>>;
+
+    const RateLimit limit_;    // 每个IP的限速参数
+    const size_t    maxPeers_; // 最多记录的IP数目
+
+    mutable std::mutex                               mtx_;   // 保护以下成员
+    PeerList                                         lru_;   // 按最近一次新连接的时间排列 最近的在前
+    std::unordered_map<uint32_t, PeerList::iterator> peers_; // IP到lru_中位置的索引
+};
+}
+
+#endif
@@ -0,0 +1,111 @@
+#ifndef __APOLLO_RESOLVER_H__
+#define __APOLLO_RESOLVER_H__
+
+#include "computethreadpool.h"
+#include "inetaddress.h"
+#include "timestamp.h"
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace apollo
+{
+class EventLoop;
+
+/**
+ * @brief 异步域名解析器
+ * @details getaddrinfo在内部的计算线程池中执行，结果通过queueInLoop交给发起解析的事件循环，
+ * 事件循环线程不会因为解析而阻塞。解析结果按主机名缓存，成功的结果保存ttl，失败的结果保存negativeTtl，
+ * 期间对同一主机名的解析直接使用缓存；同一主机名同时发起的多次解析只调用一次getaddrinfo。
+ * 数字形式的IP地址不经过线程池。解析遵循系统的配置，/etc/hosts中的名称同样可以解析。
+ * 只解析IPv4地址，与InetAddress保持一致
+ */
+class Resolver
+{
+public:
+    //解析完成的回调函数，解析失败时地址列表为空
+    using ResolveCallback = std::function<void(const std::vector<InetAddress>&)>;
+
+    /**
+     * @brief Construct a new Resolver object
+     *
+     * @param numThreads 执行getaddrinfo的线程数目
+     */
+    explicit Resolver(int numThreads = 2);
+    Resolver(const Resolver&) = delete;
+    Resolver& operator=(const Resolver&) = delete;
+    ~Resolver();
+
+    /**
+     * @brief 设置缓存的有效期
+     *
+     * @param ttl 解析成功的结果的有效期，单位为秒
+     * @param negativeTtl 解析失败的结果的有效期，单位为秒，为0时不缓存失败的结果
+     */
+    void setCacheTtl(double ttl, double negativeTtl);
+
+    //设置最多缓存的主机名数目
+    void setMaxCacheSize(size_t size);
+
+    /**
+     * @brief 解析主机名，可在任意线程中调用
+     * @details 回调函数总是通过loop->queueInLoop执行，即使结果来自缓存，
+     * 因此不会在调用resolve的函数中嵌套执行
+     *
+     * @param loop 执行回调函数的事件循环
+     * @param host 主机名或者数字形式的IPv4地址
+     * @param port 填入解析结果的端口号
+     * @param cb 解析完成的回调函数
+     */
+    void resolve(EventLoop* loop, const std::string& host, uint16_t port, const ResolveCallback& cb);
+
+    //清空缓存
+    void clearCache();
+
+    //返回命中缓存的次数
+    uint64_t cacheHits() const;
+
+    //返回调用getaddrinfo的次数
+    uint64_t lookups() const;
+
+private:
+    //等待解析结果的调用方
+    struct Waiter {
+        EventLoop*      loop; // 执行回调函数的事件循环
+        uint16_t        port; // 调用方请求的端口号
+        ResolveCallback cb;   // 回调函数
+    };
+
+    //一个主机名的缓存
+    struct CacheEntry {
+        std::vector<in_addr> addrs;   // 解析得到的地址 为空表示解析失败
+        Timestamp            expires; // 过期时间
+    };
+
+    //在线程池中调用getaddrinfo
+    void lookup(const std::string& host);
+
+    //将地址和端口号组合后交给调用方
+    static void deliver(const Waiter& waiter, const std::vector<in_addr>& addrs);
+
+    //缓存已满时移除过期的条目 仍然已满时移除最早过期的条目 需要持有mtx_
+    void evictLocked();
+
+private:
+    ComputeThreadPool pool_; // 执行getaddrinfo的线程池
+
+    mutable std::mutex                                   mtx_;          // 保护以下成员
+    double                                               ttl_;          // 解析成功的结果的有效期
+    double                                               negativeTtl_;  // 解析失败的结果的有效期
+    size_t                                               maxCacheSize_; // 最多缓存的主机名数目
+    std::unordered_map<std::string, CacheEntry>          cache_;        // 解析结果的缓存
+    std::unordered_map<std::string, std::vector<Waiter>> inflight_;     // 正在解析的主机名及其调用方
+    uint64_t                                             cacheHits_;    // 命中缓存的次数
+    uint64_t                                             lookups_;      // 调用getaddrinfo的次数
+};
+}
+
+#endif
@@ -41,6 +41,18 @@ public:
     //设置TCP保活选项的开启与关闭
     void setKeepAlive(bool on);
 
+    //设置零拷贝发送选项的开启与关闭，返回内核是否支持
+    bool setZeroCopy(bool on);
+
+    //在监听套接字上开启TCP Fast Open，queueLen为等待完成握手的TFO请求队列长度，返回内核是否支持
+    bool setTcpFastOpen(int queueLen);
+
+    //开启内核软件时间戳，rx为接收时间戳，tx为发送时间戳，两者都为false时关闭，返回内核是否支持
+    bool setTimestamping(bool rx, bool tx);
+
+    //设置TCP_NOTSENT_LOWAT，内核发送缓冲区中未发出的数据低于bytes时才可写，为0时恢复系统默认值
+    bool setNotSentLowat(unsigned int bytes);
+
 
 private:
     const int sockfd_;
@@ -0,0 +1,155 @@
+#ifndef __APOLLO_SUPERVISOR_H__
+#define __APOLLO_SUPERVISOR_H__
+
+#include "inetaddress.h"
+#include "tcpserver.h"
+#include "timestamp.h"
+#include <functional>
+#include <memory>
+#include <signal.h>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+namespace apollo
+{
+class EventLoop;
+
+/**
+ * @brief 多进程服务器的管理进程
+ * @details 管理进程创建监听套接字后派生多个工作进程，工作进程共享监听套接字并各自运行事件循环，
+ * 工作进程异常退出后由管理进程重新派生。管理进程通过信号进行控制：
+ * SIGTERM、SIGQUIT、SIGINT 通知所有工作进程优雅退出，工作进程停止接收新连接，
+ * 等待已有连接关闭或者超时后退出，所有工作进程退出后管理进程退出；
+ * SIGUSR2 进行热升级，重新执行当前的可执行文件，并通过SCM_RIGHTS将监听套接字传递给新的管理进程，
+ * 新的管理进程派生出工作进程后通知旧的管理进程，旧的工作进程随后优雅退出。
+ *
+ * 使用方式：
+ * @code
+ * Supervisor supervisor("echo", argc, argv);
+ * supervisor.listen(InetAddress(8000));
+ * supervisor.setWorkerNum(4);
+ * supervisor.setServerFactory([](EventLoop* loop, int listenfd, size_t) {
+ *     std::unique_ptr<TcpServer> server(new TcpServer(loop, listenfd, "echo"));
+ *     server->setMessageCallback(onMessage);
+ *     return server;
+ * });
+ * return supervisor.run();
+ * @endcode
+ * run需要在创建任何线程之前调用，以保证所有线程都屏蔽了用于控制的信号
+ */
+class Supervisor
+{
+public:
+    /**
+     * @brief 在工作进程中为监听套接字创建服务器的回调函数
+     * @details 服务器由Supervisor负责启动以及优雅关闭
+     *
+     * @param loop 工作进程的事件循环
+     * @param listenfd 监听套接字，服务器接管其所有权
+     * @param index 监听地址的下标，与调用listen的顺序一致
+     */
+    using ServerFactory = std::function<std::unique_ptr<TcpServer>(EventLoop* loop, int listenfd, size_t index)>;
+
+    /**
+     * @brief Construct a new Supervisor object
+     *
+     * @param name 服务名称
+     * @param argc 命令行参数个数，用于热升级时重新执行程序
+     * @param argv 命令行参数
+     */
+    Supervisor(const std::string& name, int argc, char* argv[]);
+    Supervisor(const Supervisor&) = delete;
+    Supervisor& operator=(const Supervisor&) = delete;
+    ~Supervisor();
+
+    //设置工作进程数量，默认为CPU核心数
+    void setWorkerNum(int num) { workerNum_ = num; }
+
+    //设置工作进程优雅退出时等待连接关闭的最长时间，单位为秒
+    void setDrainTimeout(double seconds) { drainTimeout_ = seconds; }
+
+    //设置创建服务器的回调函数
+    void setServerFactory(const ServerFactory& cb) { serverFactory_ = cb; }
+
+    /**
+     * @brief 添加监听地址
+     * @details 热升级后启动的进程会直接复用旧进程中地址相同的监听套接字
+     *
+     * @param addr 监听地址
+     */
+    void listen(const InetAddress& addr);
+
+    /**
+     * @brief 启动管理进程
+     * @details 在管理进程与工作进程中都会返回
+     *
+     * @return int 进程的退出码
+     */
+    int run();
+
+private:
+    /**
+     * @brief 工作进程的状态
+     *
+     */
+    struct Worker
+    {
+        pid_t     pid;       // 进程ID，为0时表示尚未派生
+        Timestamp spawnTime; // 派生的时间
+    };
+
+    //从旧的管理进程中继承监听套接字
+    bool inheritListeners();
+
+    //创建尚未继承的监听套接字
+    void createListeners();
+
+    //派生工作进程
+    void spawnWorker(size_t slot);
+
+    //工作进程的主流程
+    int runWorker();
+
+    //回收退出的工作进程
+    void reapWorkers();
+
+    //处理管理进程收到的信号
+    void handleSignal(int signo);
+
+    //开始热升级
+    void upgrade();
+
+    //处理与新的管理进程之间的通信
+    void handleUpgradeRead();
+
+    //通知所有工作进程优雅退出
+    void stopWorkers();
+
+private:
+    const std::string        name_;    // 服务名称
+    std::string              exePath_; // 可执行文件的路径
+    std::vector<std::string> argv_;    // 命令行参数
+
+    int           workerNum_;     // 工作进程数量
+    double        drainTimeout_;  // 优雅退出的超时时间
+    ServerFactory serverFactory_; // 创建服务器的回调函数
+
+    std::vector<InetAddress> listenAddrs_; // 监听地址
+    std::vector<int>         listenFds_;   // 监听套接字
+    std::vector<int>         inherited_;   // 从旧进程继承的监听套接字
+
+    std::vector<Worker> workers_; // 工作进程
+
+    sigset_t origMask_;   // 启动前的信号屏蔽字
+    int      signalFd_;   // 管理进程的信号描述符
+    int      readyFd_;    // 与旧的管理进程通信的套接字，热升级启动时有效
+    int      upgradeFd_;  // 与新的管理进程通信的套接字
+    pid_t    upgradePid_; // 新的管理进程ID
+    bool     upgraded_;   // 新的管理进程是否已就绪
+    bool     stopping_;   // 是否正在退出
+    bool     isWorker_;   // 当前是否是工作进程
+    size_t   workerSlot_; // 工作进程的编号
+};
+}
+#endif
@@ -8,6 +8,7 @@
 #include <atomic>
 #include <mutex>
 #include <string>
+#include <vector>
 
 namespace apollo
 {
@@ -25,6 +26,29 @@ public:
      * @param nameArg 客户端名称
      */
     TcpClient(EventLoop* loop, const InetAddress& serverAddr, const std::string& nameArg);
+
+    /**
+     * @brief Construct a new Tcp Client object
+     * @details 提供多个候选的服务器地址，连接断开后重新从第一个地址开始尝试
+     *
+     * @param loop 事件循环
+     * @param serverAddrs 候选的服务器地址
+     * @param nameArg 客户端名称
+     */
+    TcpClient(EventLoop* loop, const std::vector<InetAddress>& serverAddrs, const std::string& nameArg);
+
+    /**
+     * @brief Construct a new Tcp Client object
+     * @details 连接之前通过resolver异步解析主机名，解析得到的所有地址作为候选地址，
+     * 解析不会阻塞事件循环
+     *
+     * @param loop 事件循环
+     * @param resolver 域名解析器，生命周期需要长于TcpClient
+     * @param host 服务器的主机名
+     * @param port 服务器的端口号
+     * @param nameArg 客户端名称
+     */
+    TcpClient(EventLoop* loop, Resolver* resolver, const std::string& host, uint16_t port, const std::string& nameArg);
     TcpClient(const TcpClient&) = delete;
     TcpClient& operator=(const TcpClient&) = delete;
     ~TcpClient();
@@ -84,7 +108,35 @@ public:
      */
     void enableRetry() { retry_ = true; }
 
+    /**
+     * @brief 设置每次连接尝试的超时时间，需要在connect之前调用
+     * @details 开启TCP Fast Open且已有cookie时不起作用
+     *
+     * @param seconds 超时时间，单位为秒，为0时不设置超时
+     */
+    void setConnectTimeout(double seconds) { connector_->setConnectTimeout(seconds); }
+
+    /**
+     * @brief 是否同时向所有候选地址发起连接，需要在connect之前调用
+     * @details 开启TCP Fast Open时不生效
+     *
+     * @param on
+     */
+    void setParallelDial(bool on) { connector_->setParallelDial(on); }
+
+    /**
+     * @brief 是否以TCP Fast Open发起连接，需要在connect之前调用
+     * @details 见Connector::setFastOpen，适合建立连接后立即发送请求的短连接。
+     * 开启后按顺序拨号，已有cookie时连接超时不起作用
+     *
+     * @param on
+     */
+    void setFastOpen(bool on) { connector_->setFastOpen(on); }
+
 private:
+    //各个公有构造函数创建好连接器后委托给此构造函数
+    TcpClient(EventLoop* loop, const ConnectorPtr& connector, const std::string& nameArg);
+
     /**
      * @brief 新连接的回调函数
      * 
@@ -0,0 +1,217 @@
+#ifndef __APOLLO_TCPCLIENTPOOL_H__
+#define __APOLLO_TCPCLIENTPOOL_H__
+
+#include "callbacks.h"
+#include "eventloop.h"
+#include "eventloopthreadpool.h"
+#include "inetaddress.h"
+#include "tcpclient.h"
+#include "timerid.h"
+#include "timestamp.h"
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace apollo
+{
+/**
+ * @brief 按照服务端地址管理的TCP长连接池
+ * @details 每个服务端地址对应一组TcpClient，这些客户端被轮询地分配到线程池的各个事件循环上。
+ * 使用方通过acquire租用一个已建立的连接，使用完成后通过release归还，连接在归还后保持打开以供下次复用。
+ * 连接断开后由TcpClient基于Connector的退避策略自动重连，连接池会定期进行健康检查：
+ * 补齐最小连接数、回收空闲过久的多余连接，并让等待超时的租用请求失败
+ */
+class TcpClientPool
+{
+public:
+    using ThreadInitCallback = std::function<void(EventLoop*)>;
+
+    /**
+     * @brief 租用连接的回调函数
+     * @details 在连接所属的事件循环中调用，等待超时或者连接池关闭时传入空指针
+     */
+    using LeaseCallback = std::function<void(const TcpConnectionPtr&)>;
+
+    /**
+     * @brief Construct a new Tcp Client Pool object
+     *
+     * @param loop 事件循环，用于执行健康检查，不能为空
+     * @param name 连接池名称
+     */
+    TcpClientPool(EventLoop* loop, const std::string& name);
+    TcpClientPool(const TcpClientPool&) = delete;
+    TcpClientPool& operator=(const TcpClientPool&) = delete;
+    ~TcpClientPool();
+
+    //设置线程初始化回调函数
+    void setThreadInitCallback(const ThreadInitCallback& cb) { threadInitCallback_ = cb; }
+
+    //设置线程池的线程数量，为0时所有连接都位于MainLoop中
+    void setThreadNum(int numThreads);
+
+    //设置每个服务端地址保持的最小连接数
+    void setMinConnections(int num) { minConnections_ = num; }
+
+    //设置每个服务端地址允许的最大连接数
+    void setMaxConnections(int num) { maxConnections_ = num; }
+
+    //设置健康检查的时间间隔，单位为秒
+    void setHealthCheckInterval(double seconds) { healthCheckInterval_ = seconds; }
+
+    //设置多余连接的最长空闲时间，单位为秒
+    void setMaxIdleTime(double seconds) { maxIdleTime_ = seconds; }
+
+    //设置租用请求的最长等待时间，单位为秒
+    void setLeaseTimeout(double seconds) { leaseTimeout_ = seconds; }
+
+    //设置连接建立与断开的回调函数
+    void setConnectionCallback(const ConnectionCallback& cb) { connectionCallback_ = cb; }
+
+    //设置读写消息的回调函数
+    void setMessageCallback(const MessageCallback& cb) { messageCallback_ = cb; }
+
+    //设置消息发送完成的回调函数
+    void setWriteCompleteCallback(const WriteCompleteCallback& cb) { writeCompleteCallback_ = cb; }
+
+    /**
+     * @brief 启动线程池以及健康检查定时器
+     *
+     */
+    void start();
+
+    /**
+     * @brief 预先与服务端建立最小数量的连接
+     *
+     * @param serverAddr 服务端地址
+     */
+    void warmup(const InetAddress& serverAddr);
+
+    /**
+     * @brief 租用一个与服务端之间的连接
+     * @details 可以在任意线程中调用，有空闲连接时直接租用，否则在未达到最大连接数时新建连接，
+     * 并将请求加入等待队列，直到有连接建立或者被归还
+     *
+     * @param serverAddr 服务端地址
+     * @param cb 租用成功的回调函数
+     */
+    void acquire(const InetAddress& serverAddr, LeaseCallback cb);
+
+    /**
+     * @brief 归还租用的连接
+     *
+     * @param conn 连接对象
+     */
+    void release(const TcpConnectionPtr& conn);
+
+    //返回指定服务端地址上的空闲连接数目
+    size_t idleConnections(const InetAddress& serverAddr);
+
+    //返回指定服务端地址上被租用的连接数目
+    size_t leasedConnections(const InetAddress& serverAddr);
+
+private:
+    using TcpClientPtr = std::shared_ptr<TcpClient>;
+
+    /**
+     * @brief 空闲连接
+     */
+    struct IdleConnection
+    {
+        TcpConnectionPtr conn;      // 连接对象
+        Timestamp        idleSince; // 开始空闲的时间
+    };
+
+    /**
+     * @brief 等待中的租用请求
+     */
+    struct Waiter
+    {
+        LeaseCallback callback;  // 租用成功的回调函数
+        Timestamp     waitSince; // 开始等待的时间
+    };
+
+    /**
+     * @brief 一个服务端地址上的所有连接
+     */
+    struct Endpoint
+    {
+        explicit Endpoint(const InetAddress& addr)
+            : serverAddr(addr) { }
+
+        InetAddress                     serverAddr; // 服务端地址
+        std::vector<TcpClientPtr>       clients;    // 该地址上的所有客户端
+        std::deque<IdleConnection>      idle;       // 空闲连接
+        std::unordered_set<std::string> leased;     // 被租用的连接名称
+        std::deque<Waiter>              waiters;    // 等待中的租用请求
+    };
+
+    using EndpointMap = std::unordered_map<std::string, std::unique_ptr<Endpoint>>;
+
+    //获取或者创建服务端地址对应的连接集合，需要在加锁的情况下调用
+    Endpoint* getEndpoint(const InetAddress& serverAddr);
+
+    //为服务端地址新建一个客户端，需要在加锁的情况下调用
+    void addClient(Endpoint* endpoint);
+
+    //关闭并销毁连接所属的客户端，需要在加锁的情况下调用
+    void removeClient(Endpoint* endpoint, const TcpConnectionPtr& conn);
+
+    //在连接所属的事件循环中将连接交给租用者
+    void dispatch(const LeaseCallback& cb, const TcpConnectionPtr& conn);
+
+    //将可用的连接交给等待者或者放入空闲队列，需要在加锁的情况下调用
+    bool offer(Endpoint* endpoint, const TcpConnectionPtr& conn, LeaseCallback* cb);
+
+    //客户端连接建立与断开的回调函数
+    void onConnection(const std::string& key, const TcpConnectionPtr& conn);
+
+    //健康检查
+    void healthCheck();
+
+    struct Teardown;
+
+    /**
+     * @brief 在客户端所属的事件循环中销毁一组客户端并关闭其连接
+     * @details 客户端销毁后强制关闭连接，连接销毁之后通知teardown
+     *
+     * @param loop 客户端所属的事件循环
+     * @param clients 客户端对象，调用方不能再持有其引用
+     * @param cb 替换掉指向连接池的连接回调函数
+     * @param teardown 调用方投递前已计入一次，为空时不通知
+     */
+    static void closeClients(EventLoop* loop, const std::shared_ptr<std::vector<TcpClientPtr>>& clients,
+        const ConnectionCallback& cb, const std::shared_ptr<Teardown>& teardown);
+
+private:
+    EventLoop*        loop_; // 执行健康检查的事件循环
+    const std::string name_; // 连接池名称
+
+    std::shared_ptr<EventLoopThreadPool> threadPool_; // 线程池
+
+    int    minConnections_;      // 每个地址的最小连接数
+    int    maxConnections_;      // 每个地址的最大连接数
+    double healthCheckInterval_; // 健康检查的时间间隔
+    double maxIdleTime_;         // 多余连接的最长空闲时间
+    double leaseTimeout_;        // 租用请求的最长等待时间
+
+    ConnectionCallback    connectionCallback_;    // 连接回调函数
+    MessageCallback       messageCallback_;       // 读写消息回调函数
+    WriteCompleteCallback writeCompleteCallback_; // 消息发送完成回调函数
+    ThreadInitCallback    threadInitCallback_;    // 线程初始化回调
+
+    bool    started_;       // 连接池是否启动
+    TimerId healthTimer_;   // 健康检查定时器
+    int     nextClientId_;  // 下一个客户端ID
+
+    EndpointMap endpoints_; // 所有服务端地址上的连接
+    std::mutex  mtx_;       // 保护endpoints_的线程安全
+
+    std::shared_ptr<Teardown> teardown_; // 尚未完成的销毁任务
+};
+}
+#endif
@@ -4,7 +4,9 @@
 #include "buffer.h"
 #include "callbacks.h"
 #include "inetaddress.h"
+#include "ratelimiter.h"
 #include <atomic>
+#include <deque>
 #include <memory>
 #include <string>
 #include "timestamp.h"
@@ -15,6 +17,17 @@ class Channel;
 class EventLoop;
 class Socket;
 
+//内核TCP_INFO中与传输延迟相关的字段
+struct TcpInfo {
+    uint32_t rtt;          // 平滑往返时间 单位为微秒
+    uint32_t rttVar;       // 往返时间的平均偏差 单位为微秒
+    uint32_t retransmits;  // 尚未确认的重传报文段数目
+    uint32_t totalRetrans; // 连接建立以来累计重传的报文段数目
+    uint32_t cwnd;         // 拥塞窗口 单位为报文段
+    uint32_t unacked;      // 已发送未确认的报文段数目
+    uint32_t notsentBytes; // 内核发送缓冲区中尚未发出的字节数
+};
+
 //TCP连接管理类
 class TcpConnection : public std::enable_shared_from_this<TcpConnection>
 {
@@ -35,7 +48,7 @@ public:
     ~TcpConnection();
 
     //获取所属的事件循环
-    EventLoop* getLoop() const { return loop_; }
+    EventLoop* getLoop() const { return loop_.load(std::memory_order_acquire); }
 
     //获取连接名称
     const std::string& name() const { return name_; }
@@ -49,9 +62,142 @@ public:
     //连接是否建立成功
     bool connected() const { return state_ == kConnected; }
 
-    //发送数据
+    //连接是否已经断开
+    bool disconnected() const { return state_ == kDisconnected; }
+
+    //事件循环是否仍然持有连接，即已经建立而尚未销毁，只能在所属的事件循环线程中调用
+    bool ownedByLoop() const { return static_cast<bool>(self_); }
+
+    //获取输入缓冲区，只能在所属的事件循环线程中访问
+    Buffer* inputBuffer() { return &inputBuffer_; }
+
+    //读取内核中连接的TCP_INFO快照，可在任意线程中调用，失败时返回false
+    bool tcpInfo(TcpInfo* info) const;
+
+    //从套接字读取的字节数，以下计数只在所属的事件循环线程中更新和读取
+    uint64_t bytesReceived() const { return bytesReceived_; }
+
+    //写入套接字的字节数
+    uint64_t bytesSent() const { return bytesSent_; }
+
+    //调用MessageCallback的次数
+    uint64_t messagesReceived() const { return messagesReceived_; }
+
+    //通过send发送的消息数目
+    uint64_t messagesSent() const { return messagesSent_; }
+
+    //发送数据，可在任意线程中调用
     void send(const std::string& message);
 
+    /**
+     * @brief 发送多个连接共享的数据，可在任意线程中调用
+     * @details 未能立即写入内核的部分以引用的形式排队，不拷贝数据，
+     * 发送时与输出缓冲区中的数据一起通过writev写出。调用后不能再修改payload的内容
+     *
+     * @param payload 共享的数据
+     */
+    void send(const SharedPayload& payload);
+
+    //发送数据，开启零拷贝且数据足够大时转为共享数据发送以避免拷贝，可在任意线程中调用
+    void send(std::string&& message);
+
+    /**
+     * @brief 发送优先消息，可在任意线程中调用
+     * @details 输出队列中有排队的数据时，优先消息插到正在发送的消息之后、其余排队消息之前，
+     * 不会打断任何一条消息。配合setLatencyMode使用，排队的数据大多留在用户态，插队才有效果
+     *
+     * @param message 消息内容
+     */
+    void sendPriority(const std::string& message);
+
+    /**
+     * @brief 开启或关闭低延迟发送模式
+     * @details 以TCP_NOTSENT_LOWAT限制内核发送缓冲区中尚未发出的数据，超出部分留在连接的输出队列中，
+     * 由EPOLLOUT驱动写出。这样排队的数据不会在内核中变旧，后到的优先消息可以插队，
+     * 高水位回调看到的积压也反映了真实的拥塞。只能在所属的事件循环线程中调用
+     *
+     * @param lowat 内核中未发出数据的上限，单位为字节，通常取几个MSS到几十KB，为0时关闭
+     * @return 内核是否支持TCP_NOTSENT_LOWAT
+     */
+    bool setLatencyMode(size_t lowat);
+
+    /**
+     * @brief 开启或关闭零拷贝发送
+     * @details 开启后不小于threshold字节的共享数据以MSG_ZEROCOPY发送，内核直接引用数据所在的内存页，
+     * 连接持有数据的引用，直到从套接字的错误队列中读到内核的完成通知。
+     * 内核回退为拷贝时（例如本机回环连接）自动关闭零拷贝。只能在所属的事件循环线程中调用
+     *
+     * @param threshold 使用零拷贝的最小字节数，为0时关闭零拷贝
+     * @return 内核是否支持SO_ZEROCOPY
+     */
+    bool setZeroCopy(size_t threshold);
+
+    /**
+     * @brief 开启或关闭内核软件时间戳
+     * @details 开启后MessageCallback的receiveTime为本次读到的最后一个数据包进入内核协议栈的时间，
+     * 而不再是epoll_wait返回的时间。结合getLoop()->pollReturnTime()可以区分数据在套接字接收队列中等待的时间
+     * （pollReturnTime - receiveTime）与事件循环分派的延迟（now - pollReturnTime）。
+     * 设置cb时同时开启发送时间戳，数据包交给网卡驱动时以写出的字节序号调用cb，
+     * 序号从开启时起累计，等于该次写入的最后一个字节的偏移。只能在所属的事件循环线程中调用
+     *
+     * @param on 是否开启
+     * @param cb 发送时间戳的回调函数，为空时只开启接收时间戳
+     * @return 内核是否支持SO_TIMESTAMPING
+     */
+    bool setTimestamping(bool on, const TxTimestampCallback& cb = TxTimestampCallback());
+
+    /**
+     * @brief 将本连接收到的数据转发给other
+     * @details 数据通过所属事件循环的管道池以splice在内核中从本连接的套接字移动到other的套接字，
+     * 不再经过输入缓冲区，也不再调用MessageCallback。other的内核发送缓冲区写满时暂停读取本连接，
+     * 由TCP流量控制将背压传递给对端。双向代理需要两个连接分别调用，两个连接必须属于同一个事件循环，
+     * 转发期间不应再通过send向other发送数据。本连接读到EOF时，管道中的数据全部写入other后关闭other的写端
+     * 并关闭本连接；other断开后转发停止，本连接恢复普通的读取
+     *
+     * @param other 转发的目标连接
+     */
+    void forwardTo(const TcpConnectionPtr& other);
+
+    /**
+     * @brief 将连接迁移到另一个事件循环，只能在所属的事件循环线程中调用
+     * @details 迁移排队到原事件循环本轮的事件处理结束之后执行，因此可以在连接的回调函数中调用。
+     * 执行时将Channel从Poller中移除，连接所属的事件循环切换为loop，再在loop中重新注册读写事件后调用cb。
+     * 输入输出缓冲区、排队的数据和计数随连接对象一起转移，不需要拷贝。
+     * 迁移前已经投递到原事件循环的发送、关闭等操作会被转交给新的事件循环，保持原有的顺序。
+     * 用户自己在原事件循环中注册的与该连接相关的定时器需要自行处理
+     *
+     * @param loop 目标事件循环
+     * @param cb 在目标事件循环中完成注册后调用；排队期间连接开始转发数据或者正在关闭而放弃迁移时，
+     * 在原事件循环中调用，连接已经断开时不调用
+     * @return 连接未建立、正在转发数据、已经在迁移中或者已经属于loop时不迁移，返回false
+     */
+    bool migrateTo(EventLoop* loop, const ConnectionCallback& cb = ConnectionCallback());
+
+    /**
+     * @brief 设置读取限速，只能在所属的事件循环线程中或者连接建立之前调用
+     * @details 每次读取之后从本连接的限速器和对端IP共享的限速器中取走令牌，任一限速器透支时停止关注读事件，
+     * 令牌补足后再恢复读取。未读取的数据留在内核接收缓冲区中，由TCP流量控制让对端放慢发送，数据不会丢弃。
+     * 转发模式下不限速
+     *
+     * @param limit 本连接的限速参数，各项为0时不限制
+     * @param peerLimiter 对端IP共享的限速器，为空时不限制
+     */
+    void setRateLimit(const RateLimit& limit, const std::shared_ptr<RateLimiter>& peerLimiter = nullptr);
+
+    /**
+     * @brief 报告本次MessageCallback解析出的完整消息数目，只能在MessageCallback中调用
+     * @details 用于按消息数限速，未报告时每次MessageCallback计为一条消息
+     *
+     * @param n 消息数目
+     */
+    void countMessages(size_t n) {
+        reportedMessages_ += n;
+        messagesReported_ = true;
+    }
+
+    //读取是否因为限速而暂停
+    bool readThrottled() const { return readThrottled_; }
+
     //关闭连接
     void shutdown();
 
@@ -92,9 +238,37 @@ private:
         kDisconnecting // 正在断开连接
     };
 
+    //为Channel设置事件回调
+    void setupChannel();
+
+    //在原事件循环中切换到目标事件循环
+    void migrateInLoop(EventLoop* loop, const ConnectionCallback& cb);
+
+    //迁移后在新的事件循环中注册事件
+    void attachInLoop(bool reading, bool writing, const ConnectionCallback& cb);
+
+    //投递到原事件循环的任务执行时连接是否已经迁移走，此时任务需要转交给新的事件循环；
+    //在新的事件循环中注册完成之前同样返回true，任务重新排队到注册之后
+    bool migratedAway() const;
+
+    //缓冲区在突发流量中扩大后 提交空闲任务缩减缓冲区
+    void shrinkBuffersWhenIdle();
+
+    //缩减占用内存过多而数据已经不多的缓冲区
+    void shrinkBuffers();
+
     //处理读事件
     void handleRead(Timestamp receiveTime);
 
+    //从限速器中取走本次读取的令牌 透支时暂停读取
+    void throttleRead(size_t bytes, size_t messages);
+
+    //设置恢复读取的定时器
+    void armResumeTimer(double delay);
+
+    //限速的暂停时间结束后恢复读取，id与最近一次设置的定时器不符时忽略
+    void resumeRead(uint64_t id);
+
     //处理写事件
     void handleWrite();
 
@@ -112,6 +286,70 @@ private:
      */
     void sendInLoop(const void* message, size_t len);
 
+    //在事件循环中发送其他线程提交的数据
+    void sendInLoop(const std::string& message);
+
+    //在事件循环中发送共享的数据
+    void sendInLoop(const SharedPayload& payload);
+
+    //在事件循环中发送优先消息
+    void sendPriorityInLoop(const std::string& message);
+
+    /**
+     * @brief 发送数据，未发送的部分排入输出队列
+     * @param data 数据首地址
+     * @param len 数据长度
+     * @param payload data所属的共享数据，为空时未发送的部分需要拷贝
+     */
+    void sendInLoop(const char* data, size_t len, const SharedPayload& payload);
+
+    //等待发送的字节数，包括优先消息、输出缓冲区和共享数据队列
+    size_t pendingOutputBytes() const {
+        return priorityBuffer_.readableBytes() + outputBuffer_.readableBytes() + outputChunkBytes_;
+    }
+
+    //写出排队的数据，优先消息在两条普通消息之间写出，返回写出的字节数
+    ssize_t flushOutput(int& saveErrno);
+
+    //以writev写出输出缓冲区和共享数据队列中不超过limit字节的数据，返回写出的字节数
+    ssize_t writeOutput(int& saveErrno, size_t limit);
+
+    //从排队消息的长度中扣除已经写出的n字节
+    void retireOutputMessages(size_t n);
+
+    //len字节的共享数据是否以零拷贝方式发送
+    bool useZeroCopy(size_t len) const { return zeroCopyThreshold_ > 0 && len >= zeroCopyThreshold_; }
+
+    //记录一次零拷贝发送引用的数据 在内核完成通知之前保持其有效
+    void pinZeroCopy(const SharedPayload& payload) { zeroCopyPending_.push_back(std::make_pair(zeroCopyNextId_, payload)); }
+
+    //读取错误队列中的零拷贝完成通知和发送时间戳，返回读到的通知数目
+    int reapErrorQueue();
+
+    //错误队列中是否可能有通知
+    bool expectErrorQueue() const { return zeroCopyNextId_ > 0 || !zeroCopyPending_.empty() || txTimestampCallback_; }
+
+    //在事件循环中开始转发
+    void forwardToInLoop(const TcpConnectionPtr& other);
+
+    //转发模式下处理读事件 将套接字中的数据移动到管道并写入目标连接
+    void handleForwardRead(Timestamp receiveTime);
+
+    //将管道中的数据写入目标连接，返回管道是否已经排空
+    bool drainForwardPipe(const TcpConnectionPtr& target);
+
+    //作为转发目标时写入源连接管道中的数据，返回是否已经全部写入
+    bool drainForwardSource();
+
+    //管道排空后恢复读取，若已读到EOF则结束转发
+    void resumeForwardRead();
+
+    //转发的目标连接已经关闭
+    void forwardTargetClosed();
+
+    //停止转发并归还管道
+    void stopForwarding();
+
      /**
      * @brief 在事件循环中关闭连接
      * 
@@ -132,11 +370,13 @@ private:
     void setState(StateE state) { state_ = state; }
 
 private:
-    EventLoop*        loop_; // 连接所属的事件循环
+    std::atomic<EventLoop*> loop_; // 连接所属的事件循环 迁移时改变
     const std::string name_; // 连接名称
 
-    std::atomic_int state_;   // 连接状态
-    bool            reading_; // 是否正在读取数据
+    std::atomic_int state_;     // 连接状态
+    bool            reading_;   // 是否正在读取数据
+    bool            migrating_; // 是否有排队等待执行的迁移
+    bool            attaching_; // 已经切换事件循环 但尚未在新的事件循环中注册读写事件
 
     std::unique_ptr<Socket>  socket_;  // 套接字
     std::unique_ptr<Channel> channel_; // 通道
@@ -155,7 +395,50 @@ private:
     Buffer inputBuffer_;  // 输入缓冲区
     Buffer outputBuffer_; // 输出缓冲区
 
+    uint64_t bytesReceived_;    // 从套接字读取的字节数
+    uint64_t bytesSent_;        // 写入套接字的字节数
+    uint64_t messagesReceived_; // 调用MessageCallback的次数
+    uint64_t messagesSent_;     // 通过send发送的消息数目
+
+    //排队等待发送的共享数据
+    struct OutputChunk {
+        SharedPayload data;   // 共享的数据
+        size_t        offset; // 已经发送的字节数
+    };
+
+    std::deque<OutputChunk> outputChunks_;    // 位于输出缓冲区之后的共享数据队列
+    size_t                  outputChunkBytes_; // 共享数据队列中等待发送的字节数
+
+    Buffer             priorityBuffer_;     // 等待插队发送的优先消息
+    std::deque<size_t> outputMessages_;     // 输出队列中每条消息尚未写出的字节数 用于确定插队的位置
+    bool               outputHeadStarted_;  // 输出队列的第一条消息是否已经写出了一部分
+    bool               shrinkQueued_;       // 是否已经提交了缩减缓冲区的空闲任务
+
+    std::unique_ptr<RateLimiter> rateLimiter_;      // 本连接的限速器 不限速时为空
+    std::shared_ptr<RateLimiter> peerRateLimiter_;  // 对端IP共享的限速器 不限速时为空
+    bool                         readThrottled_;    // 是否因为限速暂停了读取
+    Timestamp                    throttledUntil_;   // 暂停读取的结束时间
+    uint64_t                     throttleId_;       // 最近一次设置的恢复读取定时器的序号
+    size_t                       reportedMessages_; // 本次MessageCallback报告的消息数目
+    bool                         messagesReported_; // 本次MessageCallback是否报告了消息数目
+
+    using ZeroCopyList = std::deque<std::pair<uint32_t, SharedPayload>>;
+
+    std::atomic<size_t> zeroCopyThreshold_; // 使用零拷贝发送的最小字节数 为0时不使用
+    uint32_t            zeroCopyNextId_;    // 下一次零拷贝发送的序号 与内核的计数一致
+    ZeroCopyList        zeroCopyPending_;   // 等待内核完成通知的数据及其发送序号
+
+    bool                timestamping_;        // 是否开启了内核时间戳
+    TxTimestampCallback txTimestampCallback_; // 发送时间戳回调函数
+
+    TcpConnectionPtr self_; // 事件循环持有的自身引用，只在所属的事件循环中访问
 
+    bool                         forwarding_;     // 是否正在将数据转发给其他连接
+    bool                         forwardEof_;     // 转发时是否已经读到EOF
+    int                          forwardPipe_[2]; // 转发使用的管道
+    size_t                       forwardPending_; // 管道中尚未写入目标连接的字节数
+    std::weak_ptr<TcpConnection> forwardTarget_;  // 转发的目标连接
+    std::weak_ptr<TcpConnection> forwardSource_;  // 向本连接转发数据的源连接
 };
 }
 #endif
\ No newline at end of file
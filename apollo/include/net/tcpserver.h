@@ -6,20 +6,46 @@
 #include "callbacks.h"
 #include "eventloop.h"
 #include "eventloopthreadpool.h"
+#include "future.h"
+#include "histogram.h"
 #include "inetaddress.h"
+#include "looplocal.h"
+#include "ratelimiter.h"
 #include "tcpconnection.h"
+#include "timerid.h"
 #include <atomic>
 #include <functional>
 #include <memory>
 #include <unordered_map>
+#include <unordered_set>
 
 namespace apollo
 {
+//各连接传输指标的分布，由TcpServer周期性采样TCP_INFO得到
+struct TcpInfoStats {
+    Histogram rtt;          // 平滑往返时间 单位为微秒
+    Histogram rttVar;       // 往返时间的平均偏差 单位为微秒
+    Histogram retransmits;  // 两次采样之间每个连接新增的重传报文段数目
+    Histogram cwnd;         // 拥塞窗口 单位为报文段
+    Histogram unacked;      // 已发送未确认的报文段数目
+    Histogram notsentBytes; // 内核发送缓冲区中尚未发出的字节数
+
+    //合并另一份统计
+    void merge(const TcpInfoStats& other);
+
+    //清空所有记录
+    void reset();
+
+    //以多行文本的形式返回各项指标的统计值
+    std::string toString() const;
+};
+
 //TCP服务器类
 class TcpServer
 {
 public:
     using ThreadInitCallback = std::function<void(EventLoop*)>;
+    using DrainCallback      = std::function<void()>;
 
     enum Option 
     {
@@ -37,6 +63,16 @@ public:
      */
     TcpServer(EventLoop* loop, const InetAddress& localAddr,
         const std::string& name, Option option = kNoReusePort);
+
+    /**
+     * @brief 使用已绑定地址的监听套接字创建TCP服务器对象
+     * @details 用于多进程模式下共享监听套接字，服务器接管套接字的所有权
+     *
+     * @param loop 事件循环，不能为空
+     * @param listenfd 已绑定地址的监听套接字
+     * @param name 服务器名称
+     */
+    TcpServer(EventLoop* loop, int listenfd, const std::string& name);
     TcpServer(const TcpServer&) = delete;
     TcpServer& operator=(const TcpServer&) = delete;
     ~TcpServer();
@@ -55,6 +91,17 @@ public:
      */
     void setThreadNum(int numThreads = std::thread::hardware_concurrency());
 
+    //返回SubLoop线程池，可用于按key分派任务，需要在start之后使用
+    std::shared_ptr<EventLoopThreadPool> threadPool() const { return threadPool_; }
+
+    /**
+     * @brief 开启TCP Fast Open，需要在start之前调用
+     * @details 见Accepter::setFastOpen
+     *
+     * @param queueLen 等待完成握手的TFO请求队列长度
+     */
+    void setFastOpen(int queueLen) { accepter_->setFastOpen(queueLen); }
+
     /**
      * @brief 开启服务器监听
      * 
@@ -82,6 +129,121 @@ public:
      */
     void setWriteCompleteCallback(const WriteCompleteCallback& cb) { writeCompleteCallback_ = cb; }
 
+    /**
+     * @brief 向所有连接发送同一条消息，可在任意线程中调用
+     * @details 消息只保存一份，每个SubLoop只投递一个任务，由其向自己管理的连接发送消息的引用，
+     * 跨线程的任务数与事件循环数目相同而与连接数目无关。需要在start之后调用
+     *
+     * @param payload 共享的消息，调用后不能再修改其内容
+     */
+    void broadcast(const SharedPayload& payload);
+    void broadcast(const std::string& message);
+
+    /**
+     * @brief 开启TCP_INFO周期采样，需要在start之前调用
+     * @details 每个SubLoop按interval读取自己管理的所有连接的TcpInfo并记录到本循环的统计中，
+     * 采样在各自的事件循环中进行，不需要加锁。延迟升高时对比rtt、retransmits与notsentBytes的分布，
+     * 可以区分网络往返、丢包重传与本端发送积压
+     *
+     * @param interval 采样间隔，单位为秒，为0时不采样
+     */
+    void setTcpInfoSampling(double interval) { tcpInfoInterval_ = interval; }
+
+    /**
+     * @brief 汇总所有SubLoop的采样结果，可在任意线程中调用
+     * @details 每个SubLoop在自己的线程中取出统计，全部完成后合并为一份结果
+     *
+     * @param reset 取出之后是否清空各SubLoop的统计，用于按周期输出
+     * @return 合并后的统计，未开启采样时各项为空
+     */
+    Future<TcpInfoStats> tcpInfoStats(bool reset = false);
+
+    /**
+     * @brief 将连接迁移到另一个SubLoop，可在任意线程中调用
+     * @details 见TcpConnection::migrateTo。迁移总是排队到连接所属的事件循环中执行，
+     * 在连接的回调函数中调用时，本次回调返回后才迁移。迁移期间开始的广播可能不会发给该连接
+     *
+     * @param conn 本服务器管理的连接
+     * @param loop 线程池中的目标事件循环
+     */
+    void migrate(const TcpConnectionPtr& conn, EventLoop* loop);
+
+    /**
+     * @brief 开启自动负载均衡，需要在start之前调用
+     * @details MainLoop每隔interval收集各SubLoop的负载（处理事件和回调的时间占比）以及各连接这段时间内读写的字节数。
+     * 最忙与最闲的SubLoop负载相差超过threshold时，按字节数占比估计最忙的SubLoop中每个连接的负载，
+     * 选择最接近负载差一半的连接迁移到最闲的SubLoop。迁移只在能缩小差距时进行，
+     * 单个连接占满一个SubLoop的情况无法通过迁移改善
+     *
+     * @param interval 检查间隔，单位为秒
+     * @param threshold 触发迁移的负载差，取值范围为(0, 1]
+     */
+    void setRebalancing(double interval, double threshold = 0.2) {
+        rebalanceInterval_  = interval;
+        rebalanceThreshold_ = threshold;
+    }
+
+    /**
+     * @brief 调整SubLoop的数目，可在任意线程中调用
+     * @details start之前等同于setThreadNum。运行时增加的SubLoop立即参与新连接的分配，
+     * 已有的连接由负载均衡逐步迁移过去；减少时先停止向被移除的SubLoop分配连接，
+     * 再将其上的连接迁移到其余的SubLoop，正在转发或者正在关闭而无法迁移的连接等待其自行关闭，
+     * 超时后强制关闭，全部移走之后停止该SubLoop，之后增加SubLoop时优先复用。只支持以至少一个SubLoop启动的服务器
+     *
+     * @param numThreads SubLoop的数目，至少为1
+     */
+    void resize(int numThreads);
+
+    /**
+     * @brief 开启按负载自动调整SubLoop数目，需要在start之前调用，并通过setRebalancing开启负载统计
+     * @details 每次负载均衡检查时，平均负载超过scaleUp则增加一个SubLoop；
+     * 去掉一个SubLoop后剩余SubLoop的平均负载仍低于scaleDown则移除负载最低的SubLoop。
+     * 两个判断都以调整之后的负载为准，只要scaleDown小于scaleUp就不会来回调整。
+     * 每次调整之后等待几个检查间隔，使连接的分布和负载统计稳定下来
+     *
+     * @param minThreads SubLoop的最少数目
+     * @param maxThreads SubLoop的最多数目
+     * @param scaleUp 增加SubLoop的平均负载
+     * @param scaleDown 减少SubLoop的平均负载
+     */
+    void setAutoScaling(int minThreads, int maxThreads, double scaleUp = 0.75, double scaleDown = 0.3) {
+        minThreads_    = minThreads;
+        maxThreads_    = maxThreads;
+        scaleUpLoad_   = scaleUp;
+        scaleDownLoad_ = scaleDown;
+    }
+
+    /**
+     * @brief 设置每个连接的读取限速，需要在start之前调用
+     * @details 连接超出限速时暂停读取，数据留在内核中由TCP流量控制施加背压，不会丢弃，
+     * 见TcpConnection::setRateLimit
+     *
+     * @param limit 每个连接的字节数和消息数限速
+     */
+    void setConnectionRateLimit(const RateLimit& limit) { connectionRateLimit_ = limit; }
+
+    /**
+     * @brief 设置每个对端IP的读取限速，需要在start之前调用
+     * @details 同一IP的所有连接共享一组令牌桶，无论它们属于哪个SubLoop。
+     * 最多记录maxPeers个IP，超出时淘汰最久没有新连接的IP
+     *
+     * @param limit 每个IP的字节数和消息数限速
+     * @param maxPeers 最多记录的IP数目
+     */
+    void setPeerRateLimit(const RateLimit& limit, size_t maxPeers = 65536) {
+        peerRateLimiter_.reset(limit.enabled() ? new PeerRateLimiter(limit, maxPeers) : nullptr);
+    }
+
+    /**
+     * @brief 优雅地关闭服务器
+     * @details 停止接收新连接，等待已有的连接由对端关闭，超时后强制关闭剩余的连接，
+     * 所有连接都关闭后在MainLoop中调用回调函数
+     *
+     * @param timeout 等待连接关闭的最长时间，单位为秒
+     * @param cb 所有连接关闭后的回调函数
+     */
+    void drain(double timeout, const DrainCallback& cb);
+
 private:
     //连接器接收到客户端连接后 将客户端连接打包成TcpConnection分发给SubLoop
     void newConnection(int sockfd, const InetAddress& peerAddr);
@@ -92,10 +254,78 @@ private:
     //移除连接
     void removeConnectionInLoop(const TcpConnectionPtr& conn);
 
-    
+    //在SubLoop中登记并建立连接
+    void connectEstablishedInLoop(const TcpConnectionPtr& conn);
+
+    //在SubLoop中注销并销毁连接
+    void connectDestroyedInLoop(const TcpConnectionPtr& conn);
+
+    //在SubLoop中向其管理的所有连接发送消息
+    void broadcastInLoop(const SharedPayload& payload);
+
+    //在连接所属的SubLoop中注销并迁移连接
+    void migrateInLoop(const TcpConnectionPtr& conn, EventLoop* loop);
+
+    //连接迁移完成后在目标SubLoop中登记
+    void connectMigratedInLoop(const TcpConnectionPtr& conn, uint32_t totalRetrans);
+
+    //在SubLoop中采样其管理的所有连接
+    void sampleTcpInfoInLoop();
+
+    //在SubLoop中取出本循环的采样结果
+    TcpInfoStats collectTcpInfoInLoop(bool reset);
+
+    //一个SubLoop在上一个检查间隔中的负载
+    struct LoopLoad {
+        EventLoop*                                         loop;        // 事件循环
+        double                                             utilization; // 处理事件和回调的时间占比
+        uint64_t                                           bytes;       // 所有连接读写的字节数
+        std::vector<std::pair<TcpConnectionPtr, uint64_t>> connections; // 每个连接读写的字节数
+    };
+
+    //在MainLoop中收集各SubLoop的负载
+    void rebalance();
+
+    //在SubLoop中统计本循环的负载
+    LoopLoad loadInLoop();
+
+    //在MainLoop中根据各SubLoop的负载选择要迁移的连接
+    void rebalanceWith(const std::vector<LoopLoad>& loads);
+
+    //根据负载增减SubLoop 发生调整时返回true
+    bool autoScale(const std::vector<LoopLoad>& loads);
+
+    //在MainLoop中调整SubLoop的数目
+    void resizeInLoop(int numThreads);
+
+    //在MainLoop中停止向SubLoop分配连接 并开始迁移其上的连接
+    void retireLoopInLoop(EventLoop* loop);
+
+    //在被移除的SubLoop中迁移连接 超过deadline后强制关闭无法迁移的连接
+    void evacuateInLoop(Timestamp deadline);
+
+    //SubLoop上的连接全部移走后在MainLoop中停止该SubLoop
+    void stopLoopInLoop(EventLoop* loop);
+
+    //在MainLoop中开始关闭服务器
+    void drainInLoop(double timeout, const DrainCallback& cb);
+
+    //等待超时 强制关闭剩余的连接
+    void forceCloseAll();
+
+    //包装在SubLoop中延后执行的任务 服务器析构之后不再执行
+    std::function<void()> guard(const std::function<void()>& func) const;
 
 private:
     using ConnectionMap = std::unordered_map<std::string, TcpConnectionPtr>;
+    using ConnectionSet = std::unordered_set<TcpConnectionPtr>;
+
+    //每个SubLoop的TCP_INFO采样状态
+    struct TcpInfoSampler {
+        TcpInfoStats                                        stats;        // 本循环的采样结果
+        std::unordered_map<const TcpConnection*, uint32_t> totalRetrans; // 上次采样时各连接累计的重传数
+        TimerId                                             timer;        // 采样定时器
+    };
 
     EventLoop*        loop_;   // 事件循环
     const std::string ipPort_; // IP地址和端口号表示的字符串
@@ -114,6 +344,39 @@ private:
 
     int           nextConnId_;  // 下一个连接ID
     ConnectionMap connections_; // 保存所有客户端连接
+
+    std::unique_ptr<LoopLocal<ConnectionSet>> loopConnections_; // 每个SubLoop管理的连接 只在该SubLoop中访问
+
+    double                                     tcpInfoInterval_; // TCP_INFO采样间隔 为0时不采样
+    std::unique_ptr<LoopLocal<TcpInfoSampler>> tcpInfoSamplers_; // 每个SubLoop的采样状态 只在该SubLoop中访问
+
+    //每个SubLoop上一次统计负载时的状态
+    struct LoadTracker {
+        int64_t                                             busyTime = 0; // 事件循环累计的忙碌时间
+        Timestamp                                           time;         // 统计的时间
+        std::unordered_map<const TcpConnection*, uint64_t> bytes;        // 各连接累计读写的字节数
+    };
+
+    double                                  rebalanceInterval_;  // 负载均衡的检查间隔 为0时不进行负载均衡
+    double                                  rebalanceThreshold_; // 触发迁移的负载差
+    TimerId                                 rebalanceTimer_;     // 负载均衡定时器
+    std::unique_ptr<LoopLocal<LoadTracker>> loadTrackers_;       // 每个SubLoop的负载统计状态 只在该SubLoop中访问
+
+    int    minThreads_;    // 自动调整时SubLoop的最少数目
+    int    maxThreads_;    // 自动调整时SubLoop的最多数目 为0时不自动调整
+    double scaleUpLoad_;   // 增加SubLoop的平均负载
+    double scaleDownLoad_; // 减少SubLoop的平均负载
+    int    scaleCooldown_; // 距离下一次自动调整还需等待的检查次数
+    int    retiring_;      // 正在移除的SubLoop数目 只在MainLoop中访问
+
+    RateLimit                        connectionRateLimit_; // 每个连接的读取限速
+    std::unique_ptr<PeerRateLimiter> peerRateLimiter_;     // 按对端IP分配的限速器 不限速时为空
+
+    bool          draining_;      // 是否正在关闭服务器
+    TimerId       drainTimer_;    // 关闭服务器的超时定时器
+    DrainCallback drainCallback_; // 所有连接关闭后的回调函数
+
+    std::shared_ptr<bool> alive_; // 析构时释放 SubLoop中的定时任务通过其弱引用判断服务器是否存在
 };
 }
 #endif
\ No newline at end of file
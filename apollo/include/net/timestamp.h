@@ -53,6 +53,13 @@ inline Timestamp addTime(Timestamp timestamp, double seconds)
     int64_t delta = static_cast<int64_t>(seconds * Timestamp::kMicroSecondsPerSecond);
     return Timestamp(timestamp.microSecondsSinceEpoch() + delta);
 }
+
+//计算两个时间点之间的间隔，单位为秒
+inline double timeDifference(Timestamp high, Timestamp low) 
+{
+    int64_t diff = high.microSecondsSinceEpoch() - low.microSecondsSinceEpoch();
+    return static_cast<double>(diff) / Timestamp::kMicroSecondsPerSecond;
+}
 } 
 
 #endif
\ No newline at end of file
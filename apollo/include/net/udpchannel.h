@@ -0,0 +1,204 @@
+#ifndef __APOLLO_UDPCHANNEL_H__
+#define __APOLLO_UDPCHANNEL_H__
+
+#include "callbacks.h"
+#include "inetaddress.h"
+#include "timestamp.h"
+#include <atomic>
+#include <memory>
+#include <string>
+#include <sys/socket.h>
+#include <vector>
+
+namespace apollo
+{
+class Channel;
+class EventLoop;
+class Socket;
+
+/**
+ * @brief UDP数据报通道
+ * @details 一个UdpChannel对应一个UDP套接字，且只属于一个事件循环。
+ * 读事件到来时使用recvmmsg批量接收数据报，发送的数据报先缓存在发送队列中，
+ * 在本轮事件循环结束时通过sendmmsg批量发送，内核缓冲区已满时等待EPOLLOUT事件再继续发送
+ */
+class UdpChannel : public std::enable_shared_from_this<UdpChannel>
+{
+public:
+    static const int    kMaxBatch             = 64;              // recvmmsg/sendmmsg一次最多处理的数据报数量
+    static const int    kMaxGroBatch          = 8;               // 开启GRO时一次最多接收的聚合报文数量
+    static const int    kMaxGsoSegments       = 64;              // 开启GSO时单次发送最多合并的数据报数量
+    static const size_t kDefaultDatagramSize  = 2048;            // 默认的单个数据报接收缓冲区大小
+    static const size_t kMaxGroSize           = 65536;           // 开启GRO时单个聚合报文的接收缓冲区大小
+    static const size_t kDefaultMaxQueueBytes = 4 * 1024 * 1024; // 默认的发送队列字节数上限
+
+    /**
+     * @brief Construct a new Udp Channel object
+     *
+     * @param loop 所属的事件循环
+     * @param name 通道名称
+     */
+    UdpChannel(EventLoop* loop, const std::string& name);
+    UdpChannel(const UdpChannel&) = delete;
+    UdpChannel& operator=(const UdpChannel&) = delete;
+    ~UdpChannel();
+
+    //获取所属的事件循环
+    EventLoop* getLoop() const { return loop_; }
+
+    //获取通道名称
+    const std::string& name() const { return name_; }
+
+    //返回UDP套接字描述符
+    int fd() const;
+
+    /**
+     * @brief 绑定本地地址
+     *
+     * @param localAddr 本地地址
+     * @param reusePort 是否开启SO_REUSEPORT，多个事件循环各自绑定同一端口时需要开启
+     */
+    void bindAddress(const InetAddress& localAddr, bool reusePort = false);
+
+    /**
+     * @brief 设置默认的对端地址，客户端使用
+     * @details 连接之后内核只会上报该对端发来的数据报，调用send时无需再指定对端
+     *
+     * @param peerAddr 对端地址
+     */
+    void connect(const InetAddress& peerAddr);
+
+    /**
+     * @brief 开启UDP_GRO，内核会将同一个流上的多个数据报聚合后一次性上报
+     * @details 需要在start之前调用，内核不支持时返回false
+     */
+    bool setGro(bool on);
+
+    /**
+     * @brief 开启UDP_SEGMENT，发送队列中连续的、发往同一对端且长度相同的数据报会合并成一次发送
+     * @details 内核不支持时返回false
+     */
+    bool setGso(bool on);
+
+    //设置单个数据报的最大接收长度，需要在start之前调用
+    void setMaxDatagramSize(size_t size) { maxDatagramSize_ = size; }
+
+    /**
+     * @brief 设置发送队列的字节数上限，需要在所属的事件循环线程中或者开始发送之前调用
+     * @details 等待EPOLLOUT期间排队的数据报超过上限时，新的数据报直接丢弃并计数，与UDP本身的语义一致
+     *
+     * @param bytes 发送队列中数据报的总字节数上限
+     */
+    void setMaxQueueBytes(size_t bytes) { maxQueueBytes_ = bytes; }
+
+    //返回因发送队列已满而丢弃的数据报数目，可在任意线程中调用
+    uint64_t droppedDatagrams() const { return droppedDatagrams_.load(std::memory_order_relaxed); }
+
+    //设置接收数据报的回调函数
+    void setMessageCallback(DatagramCallback cb) { messageCallback_ = std::move(cb); }
+
+    //开始接收数据报
+    void start();
+
+    //停止接收数据报并将通道从事件循环中移除
+    void stop();
+
+    /**
+     * @brief 向指定对端发送数据报
+     * @details 可以在任意线程中调用，数据报会在所属事件循环中批量发送
+     *
+     * @param peerAddr 对端地址
+     * @param data 数据报首地址
+     * @param len 数据报长度
+     */
+    void sendTo(const InetAddress& peerAddr, const void* data, size_t len);
+
+    //向指定对端发送数据报
+    void sendTo(const InetAddress& peerAddr, const std::string& message);
+
+    //向connect所设置的默认对端发送数据报
+    void send(const std::string& message);
+
+private:
+    /**
+     * @brief 待发送的数据报
+     */
+    struct Datagram
+    {
+        InetAddress peerAddr; // 对端地址
+        std::string data;     // 数据报内容
+    };
+
+    //在事件循环中开始接收数据报
+    void startInLoop();
+
+    //在事件循环中停止接收数据报
+    void stopInLoop();
+
+    //在事件循环中将数据报加入发送队列
+    void sendInLoop(const InetAddress& peerAddr, const std::string& message);
+
+    //将数据报加入发送队列，并在本轮事件循环结束时批量发送
+    void enqueue(const InetAddress& peerAddr, const char* data, size_t len);
+
+    //批量发送发送队列中的数据报
+    void flush();
+
+    //从发送队列中移除已经发送或者发送失败的count个数据报
+    void retire(size_t count);
+
+    /**
+     * @brief 从发送队列的first位置开始组织一个sendmmsg批次
+     *
+     * @param first 发送队列中的起始下标
+     * @return int 返回批次中的消息数目
+     */
+    int fillSendBatch(size_t first);
+
+    //处理读事件
+    void handleRead(Timestamp receiveTime);
+
+    //处理写事件
+    void handleWrite();
+
+    //处理错误事件
+    void handleError();
+
+private:
+    EventLoop*        loop_; // 通道所属的事件循环
+    const std::string name_; // 通道名称
+
+    std::unique_ptr<Socket>  socket_;  // UDP套接字
+    std::unique_ptr<Channel> channel_; // 通道
+
+    InetAddress peerAddr_; // connect所设置的默认对端地址
+
+    bool   connected_;       // 是否设置了默认对端
+    bool   started_;         // 是否已经开始接收
+    bool   gro_;             // 是否开启UDP_GRO
+    bool   gso_;             // 是否开启UDP_SEGMENT
+    bool   flushPending_;    // 是否已经在事件循环中注册了批量发送任务
+    size_t maxDatagramSize_; // 单个数据报的最大接收长度
+
+    DatagramCallback messageCallback_; // 接收数据报的回调函数
+
+    // 接收批次所使用的缓冲区，在start时按照批次大小一次性分配
+    std::vector<char>        recvBuffer_;
+    std::vector<mmsghdr>     recvMsgs_;
+    std::vector<iovec>       recvIovecs_;
+    std::vector<sockaddr_in> recvAddrs_;
+    std::vector<char>        recvControl_;
+
+    // 发送队列以及发送批次所使用的缓冲区
+    std::vector<Datagram>    sendQueue_;
+    size_t                   sendIndex_;        // 发送队列中下一个待发送的数据报
+    size_t                   queueBytes_;       // 发送队列中尚未发送的字节数
+    size_t                   maxQueueBytes_;    // 发送队列的字节数上限
+    std::atomic<uint64_t>    droppedDatagrams_; // 因发送队列已满而丢弃的数据报数目
+    std::vector<mmsghdr>     sendMsgs_;
+    std::vector<iovec>       sendIovecs_;
+    std::vector<size_t>      sendCounts_; // 每个消息中所合并的数据报数目
+    std::vector<char>        sendControl_;
+};
+}
+#endif
@@ -0,0 +1,91 @@
+#ifndef __APOLLO_UDPSERVER_H__
+#define __APOLLO_UDPSERVER_H__
+
+#include "callbacks.h"
+#include "eventloop.h"
+#include "eventloopthreadpool.h"
+#include "inetaddress.h"
+#include "udpchannel.h"
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace apollo
+{
+/**
+ * @brief UDP服务器类
+ * @details 每个事件循环各自持有一个绑定在同一端口上的UdpChannel，
+ * 当事件循环多于一个时开启SO_REUSEPORT，由内核按照四元组将数据报分发到不同的事件循环
+ */
+class UdpServer
+{
+public:
+    using ThreadInitCallback = std::function<void(EventLoop*)>;
+
+    /**
+     * @brief 创建一个UDP服务器对象
+     *
+     * @param loop 事件循环，不能为空
+     * @param localAddr 本地地址
+     * @param name 服务器名称
+     */
+    UdpServer(EventLoop* loop, const InetAddress& localAddr, const std::string& name);
+    UdpServer(const UdpServer&) = delete;
+    UdpServer& operator=(const UdpServer&) = delete;
+    ~UdpServer();
+
+    //设置线程初始化回调函数
+    void setThreadInitCallback(const ThreadInitCallback& cb) { threadInitCallback_ = cb; }
+
+    /**
+     * @brief 设置线程池的线程数量
+     *
+     * @param numThreads 线程数量，为0时所有数据报都在MainLoop中处理
+     */
+    void setThreadNum(int numThreads);
+
+    //设置接收数据报的回调函数
+    void setMessageCallback(const DatagramCallback& cb) { messageCallback_ = cb; }
+
+    //开启UDP_GRO，需要在start之前调用
+    void setGro(bool on) { gro_ = on; }
+
+    //开启UDP_SEGMENT，需要在start之前调用
+    void setGso(bool on) { gso_ = on; }
+
+    //设置单个数据报的最大接收长度，需要在start之前调用
+    void setMaxDatagramSize(size_t size) { maxDatagramSize_ = size; }
+
+    /**
+     * @brief 启动服务器
+     *
+     */
+    void start();
+
+    /**
+     * @brief 返回所有事件循环上的UDP通道
+     * @details 可以用于主动向对端发送数据报
+     */
+    const std::vector<UdpChannelPtr>& channels() const { return channels_; }
+
+private:
+    EventLoop*        loop_;      // 事件循环
+    const InetAddress localAddr_; // 本地地址
+    const std::string name_;      // 服务器名称
+
+    std::shared_ptr<EventLoopThreadPool> threadPool_; // 线程池
+
+    DatagramCallback   messageCallback_;    // 接收数据报的回调函数
+    ThreadInitCallback threadInitCallback_; // 线程初始化回调
+
+    bool   gro_;             // 是否开启UDP_GRO
+    bool   gso_;             // 是否开启UDP_SEGMENT
+    size_t maxDatagramSize_; // 单个数据报的最大接收长度
+
+    std::atomic_bool started_; // 服务器是否启动
+
+    std::vector<UdpChannelPtr> channels_; // 每个事件循环上的UDP通道
+};
+}
+#endif
@@ -0,0 +1,115 @@
+#ifndef __APOLLO_WATCHDOG_H__
+#define __APOLLO_WATCHDOG_H__
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+namespace apollo
+{
+class EventLoop;
+class EventLoopThreadPool;
+class Thread;
+struct LoopHeartbeat;
+
+//一次事件循环阻塞的现场
+struct StallReport {
+    const void*              loop;     // 阻塞的事件循环 只用于标识 报告时可能已经销毁
+    pid_t                    tid;      // 事件循环所在的线程
+    double                   duration; // 本轮循环已经持续的时间 单位为秒
+    int                      fd;       // 正在处理事件的Channel 不在处理事件时为-1
+    std::string              functor;  // 正在执行的回调函数的类型 不在执行回调时为空
+    std::vector<std::string> stack;    // 事件循环线程的调用栈 未能取得时为空
+
+    //以多行文本的形式返回报告
+    std::string toString() const;
+};
+
+/**
+ * @brief 检测长时间阻塞的事件循环
+ * @details 后台线程每隔interval检查一次各事件循环的心跳，某一轮循环从poll返回后超过threshold仍未结束时，
+ * 向事件循环线程发送信号，在信号处理函数中以backtrace取得调用栈，连同正在处理的Channel和回调函数的类型一起报告。
+ * 同一轮循环只报告一次。默认的回调以WARN级别输出到日志，链接时加上-rdynamic才能在调用栈中看到函数名：
+ *
+ *     Watchdog watchdog(0.2);
+ *     watchdog.watch(*server.threadPool());
+ *     watchdog.start();
+ *
+ * 信号处理函数使用SIGRTMIN+1，并以SA_RESTART注册，被打断的nanosleep等不会自动重启的系统调用会提前返回
+ */
+class Watchdog
+{
+public:
+    using StallCallback = std::function<void(const StallReport&)>;
+
+    /**
+     * @brief Construct a new Watchdog object
+     *
+     * @param threshold 判定为阻塞的时间，单位为秒
+     * @param interval 检查的间隔，单位为秒，为0时取threshold的四分之一
+     */
+    explicit Watchdog(double threshold = 0.2, double interval = 0);
+    Watchdog(const Watchdog&) = delete;
+    Watchdog& operator=(const Watchdog&) = delete;
+    ~Watchdog();
+
+    //设置发现阻塞时的回调函数，在Watchdog线程中调用，需要在start之前设置
+    void setStallCallback(const StallCallback& cb) { stallCallback_ = cb; }
+
+    //监视一个事件循环，可在任意线程中调用，事件循环退出后自动停止监视
+    void watch(EventLoop* loop);
+
+    /**
+     * @brief 监视线程池中的所有事件循环
+     * @details 线程池在运行时增加的事件循环也会被监视，线程池的生命周期需要长于Watchdog
+     */
+    void watch(EventLoopThreadPool& pool);
+
+    //启动检查线程
+    void start();
+
+    //停止检查线程
+    void stop();
+
+    //返回已经报告的阻塞次数
+    uint64_t stalls() const;
+
+private:
+    //检查线程的主函数
+    void threadFunc();
+
+    //检查所有事件循环的心跳
+    void check();
+
+    //向事件循环线程发送信号并取得调用栈，事件循环已经离开第iteration轮循环时返回空
+    static std::vector<std::string> captureStack(const std::shared_ptr<LoopHeartbeat>& heartbeat, uint64_t iteration);
+
+private:
+    //被监视的事件循环
+    struct Watched {
+        std::shared_ptr<LoopHeartbeat> heartbeat; // 事件循环的心跳
+        uint64_t                        reported; // 上一次报告的循环序号
+    };
+
+    const int64_t threshold_; // 判定为阻塞的时间 单位为微秒
+    const double  interval_;  // 检查的间隔 单位为秒
+
+    StallCallback stallCallback_; // 发现阻塞时的回调函数
+
+    mutable std::mutex      mtx_;     // 保护以下成员
+    std::condition_variable cond_;    // 用于提前结束等待
+    bool                    running_; // 检查线程是否在运行
+    std::vector<Watched>    watched_; // 被监视的事件循环
+    uint64_t                stalls_;  // 已经报告的阻塞次数
+
+    std::vector<std::pair<EventLoopThreadPool*, int>> observers_; // 在线程池中注册的观察者
+    std::unique_ptr<Thread>                           thread_;    // 检查线程
+};
+}
+
+#endif
@@ -8,12 +8,14 @@
 
 namespace apollo
 {
+class ComputeThreadPool;
 class EventLoop;
 
 
 //RPC服务提供者
 class RpcProvider
 {
+public:
     RpcProvider();
     RpcProvider(const RpcProvider&) = delete;
     RpcProvider& operator=(const RpcProvider&) = delete;
@@ -22,15 +24,21 @@ class RpcProvider
     //发布RPC方法
     void notifyService(google::protobuf::Service* service);
 
+    /**
+     * @brief 设置执行RPC方法的计算线程数目，需要在run之前调用
+     * @details 默认为0，即在IO线程中直接调用服务方法；大于0时服务方法在计算线程池中执行，
+     * 耗时的服务方法不会阻塞同一事件循环上的其他连接
+     *
+     * @param numThreads 计算线程数目
+     */
+    void setComputeThreadNum(int numThreads);
+
     void run();
 
 private:
     //连接创建与销毁的回调函数
     void onConnection(const TcpConnectionPtr& conn);
 
-    //读写消息回调函数
-    void onMessage(const TcpConnectionPtr& conn, Buffer* buffer, Timestamp receiveTime);
-
     /**
      * @brief 读写消息回调函数
      * 
@@ -44,11 +52,12 @@ private:
      * @brief 序列化RPC的响应和网络发送
      * 
      */
-    void sendRpcResponse(const TcpConnectionPtr&, google::protobuf::Message*);
+    void sendRpcResponse(TcpConnectionPtr, google::protobuf::Message*);
 
     
 private:
-    std::unique_ptr<EventLoop> loop_; // 事件循环
+    std::unique_ptr<EventLoop>         loop_;        // 事件循环
+    std::unique_ptr<ComputeThreadPool> computePool_; // 执行服务方法的计算线程池
 
     using MethodMap = std::unordered_map<std::string, const google::protobuf::MethodDescriptor*>;
 
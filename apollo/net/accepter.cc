@@ -1,6 +1,7 @@
 #include "accepter.h"
 #include "inetaddress.h"
 #include "log.h"
+#include <fcntl.h>
 #include <sys/socket.h>
 #include <unistd.h>
 using namespace apollo;
@@ -23,7 +24,8 @@ Accepter::Accepter(EventLoop* loop, const InetAddress& localAddr, bool resusePor
     : loop_(loop)
     , acceptSocket_(createNonblocking())
     , acceptChannel_(loop, acceptSocket_.fd())
-    , listenning_(false) 
+    , listenning_(false)
+    , fastOpenQueueLen_(0) 
 {
     acceptSocket_.setReuseAddr(true);
     acceptSocket_.setReusePort(resusePort);
@@ -31,6 +33,19 @@ Accepter::Accepter(EventLoop* loop, const InetAddress& localAddr, bool resusePor
     acceptChannel_.setReadCallback(std::bind(&Accepter::handleRead, this));
 }
 
+Accepter::Accepter(EventLoop* loop, int listenfd)
+    : loop_(loop)
+    , acceptSocket_(listenfd)
+    , acceptChannel_(loop, acceptSocket_.fd())
+    , listenning_(false)
+    , fastOpenQueueLen_(0)
+{
+    // 继承而来的套接字不一定是非阻塞的
+    int flags = ::fcntl(listenfd, F_GETFL, 0);
+    ::fcntl(listenfd, F_SETFL, flags | O_NONBLOCK);
+    acceptChannel_.setReadCallback(std::bind(&Accepter::handleRead, this));
+}
+
 Accepter::~Accepter() 
 {
     acceptChannel_.disableAll();
@@ -40,10 +55,22 @@ Accepter::~Accepter()
 void Accepter::listen() 
 {
     listenning_ = true;
+    if (fastOpenQueueLen_ > 0 && !acceptSocket_.setTcpFastOpen(fastOpenQueueLen_)) {
+        LOG_FMT_WARN(g_logger, "TCP Fast Open not supported: %d", errno);
+    }
     acceptSocket_.listen();
     acceptChannel_.enableReading();
 }
 
+void Accepter::stop()
+{
+    if (listenning_)
+    {
+        listenning_ = false;
+        acceptChannel_.disableAll();
+    }
+}
+
 void Accepter::handleRead() 
 {
     InetAddress peerAddr;
@@ -59,8 +86,9 @@ void Accepter::handleRead()
             ::close(connfd);
         }
     } 
-    else 
+    else if (errno != EAGAIN)
     {
+        // 多个进程共享同一个监听套接字时 未抢到连接的进程会返回EAGAIN
         LOG_FMT_ERROR(g_logger, "accept new client error: %d", errno);
     }
 }
\ No newline at end of file
@@ -1,4 +1,8 @@
 #include "buffer.h"
+#include <arpa/inet.h>
+#include <linux/errqueue.h>
+#include <string.h>
+#include <sys/socket.h>
 #include <sys/uio.h>
 #include <unistd.h>
 using namespace apollo;
@@ -41,7 +45,28 @@ void Buffer::append(const std::string& data) {
     append(data.c_str(), data.size());
 }
 
+void Buffer::appendInt32(int32_t x) {
+    int32_t be32 = static_cast<int32_t>(htonl(static_cast<uint32_t>(x)));
+    append(reinterpret_cast<const char*>(&be32), sizeof(be32));
+}
+
+int32_t Buffer::peekInt32() const {
+    int32_t be32 = 0;
+    ::memcpy(&be32, peek(), sizeof(be32));
+    return static_cast<int32_t>(ntohl(static_cast<uint32_t>(be32)));
+}
+
+int32_t Buffer::readInt32() {
+    int32_t result = peekInt32();
+    retrieve(sizeof(result));
+    return result;
+}
+
 ssize_t Buffer::readFd(int fd, int& saveErrno) {
+    return readFd(fd, saveErrno, nullptr);
+}
+
+ssize_t Buffer::readFd(int fd, int& saveErrno, Timestamp* receiveTime) {
     char  extrabuf[65536] = { 0 };
     iovec vec[2];
 
@@ -52,8 +77,39 @@ ssize_t Buffer::readFd(int fd, int& saveErrno) {
     vec[1].iov_base = extrabuf;
     vec[1].iov_len  = sizeof(extrabuf);
 
-    const int     iovcnt = (writeable < sizeof(extrabuf)) ? 2 : 1;
-    const ssize_t n      = ::readv(fd, vec, iovcnt);
+    const int iovcnt = (writeable < sizeof(extrabuf)) ? 2 : 1;
+    ssize_t   n      = 0;
+    if (receiveTime == nullptr) {
+        n = ::readv(fd, vec, iovcnt);
+    } else {
+        // 控制消息缓冲区需要按cmsghdr对齐
+        union {
+            char    buf[CMSG_SPACE(sizeof(scm_timestamping))];
+            cmsghdr align;
+        } control;
+
+        msghdr msg {};
+        msg.msg_iov        = vec;
+        msg.msg_iovlen     = iovcnt;
+        msg.msg_control    = control.buf;
+        msg.msg_controllen = sizeof(control.buf);
+
+        n = ::recvmsg(fd, &msg, 0);
+        if (n > 0) {
+            for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+                if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPING) {
+                    // 软件时间戳位于ts[0] ts[2]为硬件时间戳
+                    scm_timestamping tss;
+                    ::memcpy(&tss, CMSG_DATA(cmsg), sizeof(tss));
+                    if (tss.ts[0].tv_sec != 0 || tss.ts[0].tv_nsec != 0) {
+                        *receiveTime = Timestamp(static_cast<int64_t>(tss.ts[0].tv_sec) * Timestamp::kMicroSecondsPerSecond
+                                                 + tss.ts[0].tv_nsec / 1000);
+                    }
+                }
+            }
+        }
+    }
+
     if (n < 0) {
         saveErrno = errno;
     } else if (n <= static_cast<ssize_t>(writeable)) {
@@ -80,6 +136,15 @@ void Buffer::swap(Buffer& rhs) {
     std::swap(writerIndex_, rhs.writerIndex_);
 }
 
+void Buffer::shrink(size_t reserve) {
+    size_t            readable = readableBytes();
+    std::vector<char> buf(kCheapPrepend + readable + reserve);
+    std::copy(peek(), peek() + readable, buf.begin() + kCheapPrepend);
+    buffer_.swap(buf);
+    readerIndex_ = kCheapPrepend;
+    writerIndex_ = readerIndex_ + readable;
+}
+
 void Buffer::makeSpace(size_t len) {
     if (writeableBytes() + prependabelBytes() - kCheapPrepend < len) {
         // 如果空闲区域不满足长度大小 则扩容
@@ -78,7 +78,7 @@ void Channel::update() {
 
 void Channel::handleEventWithGurad(Timestamp reveiveTime) 
 {
-    LOG_FMT_INFO(g_logger, "channel handleEvent revents: %d", revents_);
+    LOG_FMT_DEBUG(g_logger, "channel handleEvent revents: %d", revents_);
 
     if ((revents_ & EPOLLHUP) && !(revents_ & EPOLLIN)) 
     {
@@ -0,0 +1,185 @@
+#include "computethreadpool.h"
+#include "eventloop.h"
+#include "log.h"
+#include "thread.h"
+#include <exception>
+using namespace apollo;
+
+// 当前线程所属的计算线程池及其在线程池中的下标 用于将任务提交到自己的队列
+thread_local ComputeThreadPool* t_computePool  = nullptr;
+thread_local size_t             t_computeIndex = 0;
+
+ComputeThreadPool::ComputeThreadPool(const std::string& nameArg)
+    : name_(nameArg)
+    , numThreads_(0)
+    , running_(false)
+    , next_(0)
+    , pending_(0)
+    , steals_(0)
+    , sleepers_(0) {
+}
+
+ComputeThreadPool::~ComputeThreadPool() {
+    stop();
+}
+
+void ComputeThreadPool::start() {
+    if (running_) {
+        return;
+    }
+
+    // 任务队列只在第一次启动时创建 之后不再修改 post可以在任意线程中访问
+    if (workers_.empty()) {
+        for (int i = 0; i < numThreads_; ++i) {
+            workers_.emplace_back(new Worker);
+        }
+    }
+    numThreads_ = static_cast<int>(workers_.size());
+    running_    = true;
+
+    for (int i = 0; i < numThreads_; ++i) {
+        threads_.emplace_back(new Thread(std::bind(&ComputeThreadPool::threadFunc, this, i),
+            name_ + std::to_string(i)));
+        threads_.back()->start();
+    }
+    LOG_FMT_INFO(g_logger, "ComputeThreadPool %s started with %d threads", name_.c_str(), numThreads_);
+}
+
+void ComputeThreadPool::stop() {
+    if (!running_) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(sleepMtx_);
+        running_ = false;
+    }
+    // post在队列锁内检查running_ 依次获取一遍队列锁 之前检查通过的任务都已入队并计数 工作线程退出前会执行完
+    for (auto& worker : workers_) {
+        std::lock_guard<std::mutex> lock(worker->mtx);
+    }
+    sleepCond_.notify_all();
+
+    for (auto& thread : threads_) {
+        thread->join();
+    }
+    threads_.clear();
+}
+
+void ComputeThreadPool::post(Task task) {
+    if (numThreads_ == 0) {
+        // 没有工作线程时在当前线程中直接执行
+        runTask(task);
+        return;
+    }
+    if (!running_) {
+        LOG_FMT_WARN(g_logger, "ComputeThreadPool %s is stopped, task dropped", name_.c_str());
+        return;
+    }
+
+    // 工作线程提交的任务放入自己的本地队列 以保持局部性 其他线程提交的任务放入外部队列 按提交顺序执行
+    bool   local = t_computePool == this;
+    size_t index = local
+        ? t_computeIndex
+        : next_.fetch_add(1, std::memory_order_relaxed) % workers_.size();
+    {
+        // 在队列锁内计数 保证任务被取走之前计数已经增加
+        std::lock_guard<std::mutex> lock(workers_[index]->mtx);
+        // 与stop中依次获取队列锁相对应 检查通过的任务一定会被执行
+        if (!running_) {
+            LOG_FMT_WARN(g_logger, "ComputeThreadPool %s is stopped, task dropped", name_.c_str());
+            return;
+        }
+        (local ? workers_[index]->tasks : workers_[index]->inbox).push_back(std::move(task));
+        pending_.fetch_add(1);
+    }
+
+    // 与threadFunc中先增加sleepers_再检查pending_的顺序相对应 保证不会错过唤醒
+    if (sleepers_.load() > 0) {
+        std::lock_guard<std::mutex> lock(sleepMtx_);
+        sleepCond_.notify_one();
+    }
+}
+
+void ComputeThreadPool::postAndContinue(EventLoop* loop, Task task, Task done) {
+    post([loop, task, done] {
+        task();
+        loop->queueInLoop(done);
+    });
+}
+
+void ComputeThreadPool::threadFunc(size_t index) {
+    t_computePool  = this;
+    t_computeIndex = index;
+
+    Task task;
+    for (;;) {
+        if (take(index, task)) {
+            runTask(task);
+            task = nullptr;
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleepMtx_);
+        sleepers_.fetch_add(1);
+        sleepCond_.wait(lock, [this] { return pending_.load() > 0 || !running_; });
+        sleepers_.fetch_sub(1);
+        // 停止后仍需执行完已提交的任务
+        if (!running_ && pending_.load() == 0) {
+            break;
+        }
+    }
+
+    t_computePool = nullptr;
+}
+
+bool ComputeThreadPool::take(size_t index, Task& task) {
+    if (pending_.load() == 0) {
+        return false;
+    }
+
+    {
+        Worker&                     self = *workers_[index];
+        std::lock_guard<std::mutex> lock(self.mtx);
+        if (!self.tasks.empty()) {
+            task = std::move(self.tasks.back());
+            self.tasks.pop_back();
+            pending_.fetch_sub(1);
+            return true;
+        }
+        if (!self.inbox.empty()) {
+            task = std::move(self.inbox.front());
+            self.inbox.pop_front();
+            pending_.fetch_sub(1);
+            return true;
+        }
+    }
+
+    // 从下一个工作线程开始依次尝试窃取 避免所有线程争抢同一个队列
+    for (size_t i = 1; i < workers_.size(); ++i) {
+        Worker&                      victim = *workers_[(index + i) % workers_.size()];
+        std::unique_lock<std::mutex> lock(victim.mtx, std::try_to_lock);
+        if (!lock.owns_lock()) {
+            continue;
+        }
+        // 优先窃取等待最久的外部任务
+        std::deque<Task>& queue = victim.inbox.empty() ? victim.tasks : victim.inbox;
+        if (!queue.empty()) {
+            task = std::move(queue.front());
+            queue.pop_front();
+            pending_.fetch_sub(1);
+            steals_.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+void ComputeThreadPool::runTask(const Task& task) {
+    try {
+        task();
+    } catch (const std::exception& e) {
+        LOG_FMT_ERROR(g_logger, "ComputeThreadPool %s task threw exception: %s", name_.c_str(), e.what());
+    } catch (...) {
+        LOG_FMT_ERROR(g_logger, "ComputeThreadPool %s task threw unknown exception", name_.c_str());
+    }
+}
@@ -0,0 +1,457 @@
+#include "connector.h"
+#include "channel.h"
+#include "eventloop.h"
+#include "log.h"
+#include "resolver.h"
+#include <algorithm>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <unistd.h>
+using namespace apollo;
+
+const int Connector::kMaxRetryDelayMs  = 30 * 1000;
+const int Connector::kInitRetryDelayMs = 500;
+
+
+static int createNonblocking()
+{
+    int sockfd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (sockfd < 0)
+    {
+        LOG_FMT_FATAL(g_logger, "failed to create socket, errno: %d", errno);
+    }
+    return sockfd;
+}
+
+/**
+ * @brief 是否是自我连接
+ *
+ * @param sockfd
+ */
+bool isSelfConnect(int sockfd)
+{
+    sockaddr_in localAddr, peerAddr;
+    socklen_t   addrlen = sizeof(localAddr);
+    bzero(&localAddr, addrlen);
+    bzero(&peerAddr, addrlen);
+
+    if (::getsockname(sockfd, reinterpret_cast<sockaddr*>(&localAddr), &addrlen) < 0) {
+        LOG_ERROR(g_logger) << "failed to get local addr";
+    }
+    addrlen = sizeof(peerAddr);
+    if (::getpeername(sockfd, reinterpret_cast<sockaddr*>(&peerAddr), &addrlen) < 0)
+    {
+        // 以TCP Fast Open发起的连接在第一次发送数据之前尚未发出SYN 不可能是自连接
+        if (errno == ENOTCONN) {
+            return false;
+        }
+        LOG_ERROR(g_logger) << "failed to get peer addr";
+    }
+
+    if (localAddr.sin_family == AF_INET)
+    {
+        return localAddr.sin_port == peerAddr.sin_port
+            && localAddr.sin_addr.s_addr == peerAddr.sin_addr.s_addr;
+    }
+    return false;
+}
+
+/**
+ * @brief 获取套接字上的错误码
+ *
+ * @param sockfd
+ */
+static int getSocketError(int sockfd)
+{
+    int       optval;
+    socklen_t optlen = sizeof(optval);
+    if (::getsockopt(sockfd, SOL_SOCKET, SO_ERROR, &optval, &optlen) < 0) {
+        return errno;
+    }
+    return optval;
+}
+
+Connector::Connector(EventLoop* loop, const InetAddress& serverAddr)
+    : Connector(loop, std::vector<InetAddress> { serverAddr }) {
+}
+
+Connector::Connector(EventLoop* loop, const std::vector<InetAddress>& serverAddrs)
+    : loop_(loop)
+    , serverAddrs_(serverAddrs)
+    , resolver_(nullptr)
+    , port_(0)
+    , connect_(false)
+    , state_(kDisconnected)
+    , nextAttemptId_(1)
+    , nextIndex_(0)
+    , connectedIndex_(0)
+    , connectTimeout_(0.0)
+    , parallelDial_(false)
+    , fastOpen_(false)
+    , retryDelayMs_(kInitRetryDelayMs) {
+    if (serverAddrs_.empty()) {
+        LOG_FATAL(g_logger) << "Connector needs at least one server address";
+        serverAddrs_.push_back(InetAddress());
+    }
+    LOG_FMT_DEBUG(g_logger, "Connector ctor at %p", this);
+}
+
+Connector::Connector(EventLoop* loop, Resolver* resolver, const std::string& host, uint16_t port)
+    : Connector(loop, InetAddress(port, "0.0.0.0")) {
+    resolver_ = resolver;
+    host_     = host;
+    port_     = port;
+}
+
+Connector::~Connector()
+{
+    LOG_FMT_DEBUG(g_logger, "Connector dtor at %p", this);
+}
+
+void Connector::start()
+{
+    connect_ = true;
+    loop_->runInLoop(std::bind(&Connector::startInLoop, shared_from_this()));
+}
+
+void Connector::restart()
+{
+    setState(kDisconnected);
+    retryDelayMs_ = kInitRetryDelayMs;
+    connect_      = true;
+    startInLoop();
+}
+
+void Connector::stop()
+{
+    connect_ = false;
+    // 持有自身的引用 防止所属的TcpClient在任务执行前将其销毁
+    loop_->queueInLoop(std::bind(&Connector::stopInLoop, shared_from_this()));
+}
+
+void Connector::startInLoop()
+{
+    if (!connect_)
+    {
+        LOG_DEBUG(g_logger) << "can not connect";
+        return;
+    }
+    if (state_ != kDisconnected)
+    {
+        return;
+    }
+
+    // 每次连接之前重新解析 使主机名对应地址的变化在重连时生效
+    if (resolver_ != nullptr)
+    {
+        setState(kResolving);
+        resolver_->resolve(loop_, host_, port_,
+            std::bind(&Connector::handleResolved, shared_from_this(), std::placeholders::_1));
+        return;
+    }
+    dial();
+}
+
+void Connector::handleResolved(const std::vector<InetAddress>& addrs)
+{
+    // 解析期间连接已被停止
+    if (state_ != kResolving)
+    {
+        return;
+    }
+    setState(kDisconnected);
+    if (!connect_)
+    {
+        return;
+    }
+    if (addrs.empty())
+    {
+        LOG_FMT_WARN(g_logger, "failed to resolve %s", host_.c_str());
+        retry();
+        return;
+    }
+
+    {
+        // serverAddress可能正在其他线程中读取
+        std::lock_guard<std::mutex> locker(addrMtx_);
+        serverAddrs_    = addrs;
+        connectedIndex_ = 0;
+    }
+    dial();
+}
+
+void Connector::dial()
+{
+    nextIndex_ = 0;
+    if (parallelDial())
+    {
+        // 同时向所有候选地址发起连接
+        for (size_t i = 0; i < serverAddrs_.size(); ++i)
+        {
+            connect(i);
+        }
+    }
+    else
+    {
+        // 与attemptFailed相同 立即失败的候选地址直接跳过
+        connect(nextIndex_);
+        while (attempts_.empty() && ++nextIndex_ < serverAddrs_.size())
+        {
+            connect(nextIndex_);
+        }
+    }
+
+    // 所有候选地址都无法发起连接时 按照退避时间重新连接
+    if (attempts_.empty() && state_ == kDisconnected)
+    {
+        retry();
+    }
+}
+
+void Connector::stopInLoop()
+{
+    if (state_ == kResolving)
+    {
+        // 解析结果到达时会被忽略
+        setState(kDisconnected);
+    }
+    else if (state_ == kConnecting)
+    {
+        setState(kDisconnected);
+        cancelAttempts();
+    }
+}
+
+void Connector::connect(size_t index)
+{
+    const InetAddress& serverAddr = serverAddrs_[index];
+
+    int sockfd = createNonblocking();
+    if (fastOpen_) {
+        int optval = 1;
+        if (::setsockopt(sockfd, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, &optval, sizeof(optval)) < 0) {
+            LOG_FMT_WARN(g_logger, "TCP_FASTOPEN_CONNECT not supported: %d", errno);
+        }
+    }
+    int ret       = ::connect(sockfd, (sockaddr*)(serverAddr.getSockAddr()), sizeof(sockaddr_in));
+    int saveErrno = (ret == 0) ? 0 : errno;
+
+    switch (saveErrno)
+    {
+    case 0:
+    case EINPROGRESS: // 正在连接
+    case EINTR:       // 阻塞于慢系统调用时，捕获到中断信号
+    case EISCONN:     // 连接成功
+        LOG_FMT_INFO(g_logger, "connect to %s errno: %d", serverAddr.toIpPort().c_str(), saveErrno);
+        connecting(sockfd, index);
+        break;
+    case EAGAIN:        // 临时端口不足
+    case EADDRINUSE:    // 监听的端口已被使用
+    case EADDRNOTAVAIL: // 配置的IP不对
+    case ECONNREFUSED:  // 指定的端口没有服务器监听
+    case ENETUNREACH:   // 目标主机不可达
+        LOG_FMT_INFO(g_logger, "connect to %s need try again: %d", serverAddr.toIpPort().c_str(), saveErrno);
+        ::close(sockfd);
+        break;
+    case EACCES:       // 无权限
+    case EPERM:        // 操作不被允许
+    case EAFNOSUPPORT: // 该系统不支持IPv6
+    case EALREADY:     // 套接字非阻塞且进程已有待处理的连接
+    case EBADF:        // 无效的文件描述符
+    case EFAULT:       // 操作套接字时参数无效
+    case ENOTSOCK:     // 不是一个套接字
+        LOG_FMT_ERROR(g_logger, "connect to %s error: %d", serverAddr.toIpPort().c_str(), saveErrno);
+        ::close(sockfd);
+        break;
+    default:
+        LOG_FMT_ERROR(g_logger, "Unexpected error when connect to %s: %d", serverAddr.toIpPort().c_str(), saveErrno);
+        ::close(sockfd);
+        break;
+    }
+}
+
+void Connector::connecting(int sockfd, size_t index)
+{
+    LOG_FMT_INFO(g_logger, "client connecting: %d", sockfd);
+    setState(kConnecting);
+
+    int64_t  id      = nextAttemptId_++;
+    Attempt& attempt = attempts_[id];
+    attempt.sockfd   = sockfd;
+    attempt.index    = index;
+    attempt.channel.reset(new Channel(loop_, sockfd));
+    // Channel由任务延后释放 可能晚于Connector 处理事件时通过tie确认Connector仍然存在
+    attempt.channel->tie(shared_from_this());
+    attempt.channel->setWriteCallback(std::bind(&Connector::handleWrite, this, id));
+    attempt.channel->setErrorCallback(std::bind(&Connector::handleError, this, id));
+    // 关注socket上的可写事件 非阻塞connect的结果通过EPOLLOUT事件通知
+    attempt.channel->enableWriting();
+
+    if (connectTimeout_ > 0.0)
+    {
+        attempt.timer = loop_->runAfter(connectTimeout_,
+            std::bind(&Connector::handleTimeout, shared_from_this(), id));
+    }
+}
+
+int Connector::removeAttempt(int64_t id, size_t* index)
+{
+    AttemptMap::iterator iter = attempts_.find(id);
+    if (iter == attempts_.end())
+    {
+        return -1;
+    }
+
+    Attempt& attempt = iter->second;
+    attempt.channel->disableAll();
+    attempt.channel->remove();
+    if (connectTimeout_ > 0.0)
+    {
+        loop_->cancel(attempt.timer);
+    }
+
+    // 不能在此处销毁Channel对象，因为此时可能还处在Channel::handleEvent函数中
+    // 由函数对象持有Channel 在本轮事件循环的回调任务执行完后将其释放
+    std::shared_ptr<Channel> channel(attempt.channel);
+    loop_->queueInLoop([channel]() {});
+
+    int sockfd = attempt.sockfd;
+    if (index != nullptr)
+    {
+        *index = attempt.index;
+    }
+    attempts_.erase(iter);
+    return sockfd;
+}
+
+void Connector::cancelAttempts()
+{
+    while (!attempts_.empty())
+    {
+        int sockfd = removeAttempt(attempts_.begin()->first, nullptr);
+        ::close(sockfd);
+    }
+}
+
+void Connector::handleWrite(int64_t id)
+{
+    // 连接可写表示连接建立成功
+    if (state_ != kConnecting)
+    {
+        return;
+    }
+
+    // 从Poller中移除该套接字 并重置Channel对象
+    size_t index  = 0;
+    int    sockfd = removeAttempt(id, &index);
+    if (sockfd < 0)
+    {
+        return;
+    }
+
+    // 可写不一定连接成功 使用getsockopt确认连接是否建立成功
+    // 因为错误事件也会触发可读可写事件 成功指挥触发可写事件 因此只需注册可写事件即可
+    int err = getSocketError(sockfd);
+
+    if (err) {
+        LOG_FMT_WARN(g_logger, "connect to %s failed: %d",
+            serverAddrs_[index].toIpPort().c_str(), err);
+        attemptFailed(sockfd);
+    } else if (isSelfConnect(sockfd)) {
+        // 自连接
+        LOG_WARN(g_logger) << "handle write self connect";
+        attemptFailed(sockfd);
+    } else {
+        // 最先建立成功的连接胜出 关闭其它候选地址上的连接尝试
+        cancelAttempts();
+        setState(kConnected);
+        {
+            std::lock_guard<std::mutex> locker(addrMtx_);
+            connectedIndex_ = index;
+        }
+        if (connect_) {
+            // 连接成功 执行相应的回调函数
+            newConnectionCallback_(sockfd);
+        } else {
+            ::close(sockfd);
+        }
+    }
+}
+
+void Connector::handleError(int64_t id)
+{
+    LOG_ERROR(g_logger) << "handle error, state: " << state_;
+    if (state_ == kConnecting)
+    {
+        int sockfd = removeAttempt(id, nullptr);
+        if (sockfd >= 0)
+        {
+            LOG_FMT_ERROR(g_logger, "connect error: %d", getSocketError(sockfd));
+            attemptFailed(sockfd);
+        }
+    }
+}
+
+void Connector::handleTimeout(int64_t id)
+{
+    if (state_ != kConnecting)
+    {
+        return;
+    }
+
+    size_t index  = 0;
+    int    sockfd = removeAttempt(id, &index);
+    if (sockfd >= 0)
+    {
+        LOG_FMT_WARN(g_logger, "connect to %s timeout after %.3f s",
+            serverAddrs_[index].toIpPort().c_str(), connectTimeout_);
+        attemptFailed(sockfd);
+    }
+}
+
+void Connector::attemptFailed(int sockfd)
+{
+    ::close(sockfd);
+
+    // 并行拨号时等待其它连接尝试的结果
+    if (!attempts_.empty())
+    {
+        return;
+    }
+
+    setState(kDisconnected);
+
+    // 顺序拨号时立即尝试下一个候选地址
+    if (!parallelDial() && connect_)
+    {
+        while (++nextIndex_ < serverAddrs_.size())
+        {
+            connect(nextIndex_);
+            if (!attempts_.empty())
+            {
+                return;
+            }
+        }
+    }
+
+    retry();
+}
+
+void Connector::retry()
+{
+    setState(kDisconnected);
+    if (connect_)
+    {
+        LOG_FMT_INFO(g_logger, "retry connecting to %s in %d ms",
+            host_.empty() ? serverAddrs_[0].toIpPort().c_str() : host_.c_str(), retryDelayMs_);
+        loop_->runAfter(retryDelayMs_ / 1000.0,
+            std::bind(&Connector::startInLoop, shared_from_this()));
+        retryDelayMs_ = std::min(retryDelayMs_ * 2, kMaxRetryDelayMs);
+    }
+    else
+    {
+        LOG_DEBUG(g_logger) << "don't connect";
+    }
+}
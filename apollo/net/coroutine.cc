@@ -0,0 +1,180 @@
+#ifdef APOLLO_COROUTINE
+
+#include "coroutine.h"
+#include "log.h"
+#include <arpa/inet.h>
+#include <string.h>
+using namespace apollo;
+
+namespace
+{
+// 空闲的协程帧
+struct FreeFrame {
+    FreeFrame* next;
+};
+
+// 每个线程缓存的空闲帧 线程退出时归还给系统
+struct FrameCache {
+    static const size_t kClasses = FramePool::kMaxFrame / FramePool::kAlignment;
+
+    FreeFrame* heads[kClasses]  = {};
+    size_t     counts[kClasses] = {};
+
+    ~FrameCache() {
+        for (size_t i = 0; i < kClasses; ++i) {
+            while (heads[i]) {
+                FreeFrame* frame = heads[i];
+                heads[i]         = frame->next;
+                ::operator delete(frame);
+            }
+        }
+    }
+};
+
+thread_local FrameCache t_frameCache;
+
+// 返回帧大小对应的分级下标
+size_t classIndex(size_t size) {
+    return (size + FramePool::kAlignment - 1) / FramePool::kAlignment - 1;
+}
+}
+
+void* FramePool::allocate(size_t size) {
+    if (size > kMaxFrame) {
+        return ::operator new(size);
+    }
+    size_t     index = classIndex(size);
+    FreeFrame* frame = t_frameCache.heads[index];
+    if (frame) {
+        t_frameCache.heads[index] = frame->next;
+        --t_frameCache.counts[index];
+        return frame;
+    }
+    // 按分级的上界申请 以便被同一分级中的其他帧复用
+    return ::operator new((index + 1) * kAlignment);
+}
+
+void FramePool::deallocate(void* ptr, size_t size) {
+    if (size > kMaxFrame) {
+        ::operator delete(ptr);
+        return;
+    }
+    size_t index = classIndex(size);
+    if (t_frameCache.counts[index] >= kMaxCached) {
+        ::operator delete(ptr);
+        return;
+    }
+    FreeFrame* frame          = static_cast<FreeFrame*>(ptr);
+    frame->next               = t_frameCache.heads[index];
+    t_frameCache.heads[index] = frame;
+    ++t_frameCache.counts[index];
+}
+
+void detail::Detached::promise_type::unhandled_exception() {
+    try {
+        throw;
+    } catch (const std::exception& e) {
+        LOG_FMT_ERROR(g_logger, "coroutine exited with exception: %s", e.what());
+    } catch (...) {
+        LOG_ERROR(g_logger) << "coroutine exited with unknown exception";
+    }
+}
+
+static detail::Detached runDetached(Task<void> task) {
+    co_await task;
+}
+
+void apollo::coSpawn(EventLoop* loop, Task<void> task) {
+    std::coroutine_handle<> handle = runDetached(std::move(task)).handle;
+    loop->queueInLoop([handle] { handle.resume(); });
+}
+
+CoConnection::CoConnection(const TcpConnectionPtr& conn)
+    : conn_(conn)
+    , state_(std::make_shared<State>()) {
+    state_->closed = !conn_->connected();
+    conn_->setConnectionCallback(std::bind(&CoConnection::onConnection, state_, std::placeholders::_1));
+    conn_->setMessageCallback(std::bind(&CoConnection::onMessage, state_, std::placeholders::_2));
+    conn_->setWriteCompleteCallback(std::bind(&CoConnection::onWriteComplete, state_));
+}
+
+CoConnection::~CoConnection() {
+    // 回调仍然持有共享状态 清空等待者后回调不会再恢复已销毁的协程
+    state_->reader = nullptr;
+    state_->writer = nullptr;
+}
+
+void CoConnection::ReadAwaiter::await_suspend(std::coroutine_handle<> h) noexcept {
+    self->state_->reader = h;
+    self->state_->want   = n;
+}
+
+std::string CoConnection::ReadAwaiter::await_resume() {
+    Buffer* buffer = self->conn_->inputBuffer();
+    if (some) {
+        return buffer->retrieveAllAsString();
+    }
+    if (buffer->readableBytes() < n) {
+        return std::string();
+    }
+    return buffer->retrieveAsString(n);
+}
+
+void CoConnection::WriteAwaiter::await_suspend(std::coroutine_handle<> h) {
+    self->state_->writer = h;
+    sent                 = true;
+    // 数据全部写入内核后WriteCompleteCallback会在下一轮回调中恢复协程
+    self->conn_->send(*data);
+}
+
+Task<std::optional<std::string>> CoConnection::readFrame() {
+    std::string header = co_await read(sizeof(int32_t));
+    if (header.empty()) {
+        co_return std::nullopt;
+    }
+
+    int32_t be32 = 0;
+    ::memcpy(&be32, header.data(), sizeof(be32));
+    int32_t len = static_cast<int32_t>(::ntohl(be32));
+    if (len < 0) {
+        LOG_FMT_ERROR(g_logger, "connection %s invalid frame length %d", conn_->name().c_str(), len);
+        co_return std::nullopt;
+    }
+    if (len == 0) {
+        co_return std::string();
+    }
+
+    std::string body = co_await read(static_cast<size_t>(len));
+    if (body.empty()) {
+        co_return std::nullopt;
+    }
+    co_return body;
+}
+
+void CoConnection::onConnection(const std::shared_ptr<State>& state, const TcpConnectionPtr& conn) {
+    if (conn->connected()) {
+        return;
+    }
+    state->closed = true;
+    // 恢复读协程可能导致CoConnection析构 因此每次都重新读取等待者
+    if (std::coroutine_handle<> h = std::exchange(state->reader, nullptr)) {
+        h.resume();
+    }
+    if (std::coroutine_handle<> h = std::exchange(state->writer, nullptr)) {
+        h.resume();
+    }
+}
+
+void CoConnection::onMessage(const std::shared_ptr<State>& state, Buffer* buffer) {
+    if (state->reader && buffer->readableBytes() >= state->want) {
+        std::exchange(state->reader, nullptr).resume();
+    }
+}
+
+void CoConnection::onWriteComplete(const std::shared_ptr<State>& state) {
+    if (std::coroutine_handle<> h = std::exchange(state->writer, nullptr)) {
+        h.resume();
+    }
+}
+
+#endif
@@ -25,6 +25,10 @@ EventLoop::EventLoop()
     , quit_(false)
     , callingPendingFunctors_(false)
     , threadId_(ThreadHelper::ThreadId())
+    , idleMaxEvents_(1)
+    , idleBudget_(1000)
+    , busyTime_(0)
+    , heartbeat_(std::make_shared<LoopHeartbeat>())
     , poller_(Poller::newDefaultPoller(this))
     , timerQueue_(new TimerQueue(this))
     , wakeupFd_(createEvnetFd())
@@ -40,6 +44,8 @@ EventLoop::EventLoop()
     {
         t_loopInThisThread = this;
     }
+    heartbeat_->tid  = threadId_;
+    heartbeat_->loop = this;
 
     // 设置wakeupfd的事件类型以及发生事件时所需要执行的回调操作
     wakeupChannel_->setReadCallback(std::bind(&EventLoop::handleRead, this));
@@ -53,6 +59,11 @@ EventLoop::~EventLoop()
     wakeupChannel_->remove();
     ::close(wakeupFd_);
     t_loopInThisThread = nullptr;
+    heartbeat_->exited.store(true, std::memory_order_release);
+}
+
+EventLoop* EventLoop::getEventLoopOfCurrentThread() {
+    return t_loopInThisThread;
 }
 
 void EventLoop::loop()
@@ -65,13 +76,18 @@ void EventLoop::loop()
      while (!quit_) 
      {
         activeChannels_.clear();
-        pollReturnTime_ = poller_->poll(kPollTimeMs, &activeChannels_);
+        // 还有空闲任务时只检查一次IO而不阻塞
+        heartbeat_->busySince.store(0, std::memory_order_relaxed);
+        pollReturnTime_ = poller_->poll(idleFunctors_.empty() ? kPollTimeMs : 0, &activeChannels_);
+        heartbeat_->busySince.store(pollReturnTime_.microSecondsSinceEpoch(), std::memory_order_relaxed);
         for (Channel* channel : activeChannels_) 
         {
             // Poller监听那些Channel发生了事件，然后上报给EventLoop
             // 并通知Channel处理相应的事件
+            heartbeat_->fd.store(channel->fd(), std::memory_order_relaxed);
             channel->handleEvent(pollReturnTime_);
         }
+        heartbeat_->fd.store(-1, std::memory_order_relaxed);
         /**
          * 执行当前EventLoop需要处理的回调函数集合，其过程如下：
          * 启动MainLoop ==> 客户端到来 ==> MainLoop接收客户端连接 ==>
@@ -81,6 +97,15 @@ void EventLoop::loop()
          * SubLoop执行MainLoop所注册的回调函数
          */
         doPendingFunctors();
+
+        // 只有事件循环线程写入 不需要原子的读改写
+        int64_t busy = Timestamp::now().microSecondsSinceEpoch() - pollReturnTime_.microSecondsSinceEpoch();
+        busyTime_.store(busyTime_.load(std::memory_order_relaxed) + busy, std::memory_order_relaxed);
+
+        if (activeChannels_.size() <= idleMaxEvents_) {
+            doIdleFunctors();
+        }
+        heartbeat_->iteration.store(heartbeat_->iteration.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
     }
 
     LOG_FMT_INFO(g_logger, "EventLoop %p stop looping", this);
@@ -125,6 +150,29 @@ void EventLoop::queueInLoop(Functor cb) {
     }
 }
 
+void EventLoop::queueIdle(Functor task) {
+    if (isInLoopThread()) {
+        idleFunctors_.push_back(std::move(task));
+        return;
+    }
+
+    bool wasEmpty;
+    {
+        std::lock_guard<std::mutex> locker(mtx_);
+        wasEmpty = pendingIdleFunctors_.empty();
+        pendingIdleFunctors_.push_back(std::move(task));
+    }
+    // 已有待取走的空闲任务时 事件循环已经被唤醒过
+    if (wasEmpty) {
+        wakeup();
+    }
+}
+
+void EventLoop::setIdlePolicy(size_t maxEvents, double budget) {
+    idleMaxEvents_ = maxEvents;
+    idleBudget_    = static_cast<int64_t>(budget * Timestamp::kMicroSecondsPerSecond);
+}
+
 TimerId EventLoop::runAt(Timestamp time, TimerCallback cb) {
     return timerQueue_->addTimer(std::move(cb), time, 0.0);
 }
@@ -174,6 +222,7 @@ void EventLoop::handleRead() {
 void EventLoop::doPendingFunctors() 
 {
     std::vector<Functor> functors;
+    std::vector<Functor> idleFunctors;
     callingPendingFunctors_ = true;
 
     // 防止MainLoop向SubLoop下发任务时时延过长
@@ -182,12 +231,34 @@ void EventLoop::doPendingFunctors()
     {
         std::lock_guard<std::mutex> locker(mtx_);
         functors.swap(pendingFunctors_);
+        idleFunctors.swap(pendingIdleFunctors_);
+    }
+    for (auto& functor : idleFunctors) {
+        idleFunctors_.push_back(std::move(functor));
     }
 
     for (const auto& functor : functors) {
-        functor();
+        runFunctor(functor);
     }
     callingPendingFunctors_ = false;
 }
 
+void EventLoop::doIdleFunctors() {
+    if (idleFunctors_.empty()) {
+        return;
+    }
 
+    int64_t start = Timestamp::now().microSecondsSinceEpoch();
+    do {
+        // 任务中可能继续提交空闲任务 先从队列中取出
+        Functor task = std::move(idleFunctors_.front());
+        idleFunctors_.pop_front();
+        runFunctor(task);
+    } while (!idleFunctors_.empty() && Timestamp::now().microSecondsSinceEpoch() - start < idleBudget_);
+}
+
+void EventLoop::runFunctor(const Functor& functor) {
+    heartbeat_->functor.store(&functor.target_type(), std::memory_order_relaxed);
+    functor();
+    heartbeat_->functor.store(nullptr, std::memory_order_relaxed);
+}
@@ -1,13 +1,41 @@
 #include "eventloopthreadpool.h"
+#include "eventloop.h"
 #include "eventloopthread.h"
+#include <algorithm>
+#include <cassert>
 using namespace apollo;
 
+namespace
+{
+// 64位FNV-1a哈希 结果与平台和标准库实现无关
+uint64_t fnv1a(const char* data, size_t len) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; ++i) {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// 对哈希值做一次雪崩混合 使相邻的整数key均匀分布在哈希环上
+uint64_t mix(uint64_t hash) {
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+}
+
 EventLoopThreadPool::EventLoopThreadPool(EventLoop* baseLoop, const std::string& nameArg)
     : mainLoop_(baseLoop)
     , name_(nameArg)
     , started_(false)
     , numThreads_(0)
-    , next_(0) {
+    , nextThreadId_(0)
+    , next_(0)
+    , nextObserverId_(1) {
 }
 
 EventLoopThreadPool::~EventLoopThreadPool() {
@@ -20,16 +48,14 @@ void EventLoopThreadPool::setThreadNum(int numThreads) {
 void EventLoopThreadPool::start(const ThreadInitCallback& cb) 
 {
     started_=true;
+    initCallback_ = cb;
 
     for(int i=0;i<numThreads_ ;++i)
     {
-        char buf[name_.size() + 32];
-        snprintf(buf, sizeof(buf), "%s%d", name_.c_str(), i);
-
-        EventLoopThread* t = new EventLoopThread(cb, buf);
-        threads_.push_back(std::unique_ptr<EventLoopThread>(t));
         // 创建新线程绑定SubLoop 并返回该SubLoop的地址
-        loops_.push_back(t->startLoop());
+        std::pair<EventLoop*, std::string> started = startThread();
+        std::lock_guard<std::mutex> locker(mtx_);
+        publish(started.first, started.second);
     }
 
     // 如果整个服务端只有一个线程
@@ -38,14 +64,116 @@ void EventLoopThreadPool::start(const ThreadInitCallback& cb)
     }
 }
 
+std::pair<EventLoop*, std::string> EventLoopThreadPool::startThread() {
+    char buf[name_.size() + 32];
+    snprintf(buf, sizeof(buf), "%s%d", name_.c_str(), nextThreadId_++);
+
+    std::unique_ptr<EventLoopThread> thread(new EventLoopThread(initCallback_, buf));
+    EventLoop* loop = thread->startLoop();
+
+    std::lock_guard<std::mutex> locker(mtx_);
+    threads_.push_back(LoopThread { loop, buf, std::move(thread) });
+    return std::make_pair(loop, std::string(buf));
+}
+
+void EventLoopThreadPool::publish(EventLoop* loop, const std::string& threadName) {
+    loops_.push_back(loop);
+    // 虚拟节点以线程名称和序号命名 相同配置的进程得到相同的哈希环
+    for (int v = 0; v < kVirtualNodes; ++v) {
+        std::string node = threadName + "#" + std::to_string(v);
+        ring_.emplace_back(mix(fnv1a(node.data(), node.size())), loop);
+    }
+    std::sort(ring_.begin(), ring_.end());
+}
+
+EventLoop* EventLoopThreadPool::addLoop() {
+    {
+        std::lock_guard<std::mutex> locker(mtx_);
+        // 没有SubLoop时所有任务都在MainLoop中 增加SubLoop会使已有的状态失效
+        if (!started_ || loops_.empty()) {
+            return nullptr;
+        }
+        // 已停止的事件循环仍在运行 观察者为它创建的状态也还在 直接重新加入
+        if (!stopped_.empty()) {
+            EventLoop* loop = stopped_.back();
+            stopped_.pop_back();
+            auto it = std::find_if(threads_.begin(), threads_.end(),
+                [loop](const LoopThread& thread) { return thread.loop == loop; });
+            publish(loop, it->name);
+            return loop;
+        }
+    }
+
+    std::pair<EventLoop*, std::string> started = startThread();
+    Observers                          observers;
+    {
+        std::lock_guard<std::mutex> locker(mtx_);
+        observers = observers_;
+    }
+    // 先让观察者为新的事件循环准备好状态 再对外可见
+    for (auto& observer : observers) {
+        observer.second(started.first);
+    }
+
+    std::lock_guard<std::mutex> locker(mtx_);
+    publish(started.first, started.second);
+    return started.first;
+}
+
+bool EventLoopThreadPool::retireLoop(EventLoop* loop) {
+    std::lock_guard<std::mutex> locker(mtx_);
+    auto it = std::find(loops_.begin(), loops_.end(), loop);
+    if (it == loops_.end() || loops_.size() == 1) {
+        return false;
+    }
+    loops_.erase(it);
+    if (next_ >= loops_.size()) {
+        next_ = 0;
+    }
+    // 其余节点的相对顺序不变 原来映射到该事件循环的key顺时针落到下一个节点
+    ring_.erase(std::remove_if(ring_.begin(), ring_.end(),
+                    [loop](const std::pair<uint64_t, EventLoop*>& node) { return node.second == loop; }),
+        ring_.end());
+    return true;
+}
+
+void EventLoopThreadPool::stopLoop(EventLoop* loop) {
+    // 不退出事件循环 其他线程可能刚刚取得它的指针 正要投递任务
+    std::lock_guard<std::mutex> locker(mtx_);
+    assert(std::find(loops_.begin(), loops_.end(), loop) == loops_.end());
+    bool owned = std::any_of(threads_.begin(), threads_.end(),
+        [loop](const LoopThread& thread) { return thread.loop == loop; });
+    if (owned && std::find(stopped_.begin(), stopped_.end(), loop) == stopped_.end()) {
+        stopped_.push_back(loop);
+    }
+}
+
+int EventLoopThreadPool::addObserver(const LoopCallback& added) {
+    std::lock_guard<std::mutex> locker(mtx_);
+    int id = nextObserverId_++;
+    observers_[id] = added;
+    return id;
+}
+
+void EventLoopThreadPool::removeObserver(int id) {
+    std::lock_guard<std::mutex> locker(mtx_);
+    observers_.erase(id);
+}
+
+int EventLoopThreadPool::threadNum() const {
+    std::lock_guard<std::mutex> locker(mtx_);
+    return static_cast<int>(loops_.size());
+}
+
 EventLoop* EventLoopThreadPool::getNextLoop() 
 {
     EventLoop* loop = mainLoop_;
 
+    std::lock_guard<std::mutex> locker(mtx_);
     if (!loops_.empty()) {
         loop = loops_[next_];
         ++next_;
-        if (next_ >= static_cast<int>(loops_.size())) {
+        if (next_ >= loops_.size()) {
             next_ = 0;
         }
     }
@@ -54,9 +182,39 @@ EventLoop* EventLoopThreadPool::getNextLoop()
 }
 
 std::vector<EventLoop*> EventLoopThreadPool::getAllLoop() const {
+    std::lock_guard<std::mutex> locker(mtx_);
     if (loops_.empty()) {
         return { mainLoop_ };
     } else {
         return loops_;
     }
-}
\ No newline at end of file
+}
+EventLoop* EventLoopThreadPool::getLoopForKey(const std::string& key) const {
+    return getLoopForHash(mix(fnv1a(key.data(), key.size())));
+}
+
+EventLoop* EventLoopThreadPool::getLoopForKey(uint64_t key) const {
+    return getLoopForHash(mix(key));
+}
+
+// 即使已经位于目标事件循环中也排队执行 否则会越过同一个key已经排队的任务
+void EventLoopThreadPool::runOnKey(const std::string& key, Functor task) const {
+    getLoopForKey(key)->queueInLoop(std::move(task));
+}
+
+void EventLoopThreadPool::runOnKey(uint64_t key, Functor task) const {
+    getLoopForKey(key)->queueInLoop(std::move(task));
+}
+
+EventLoop* EventLoopThreadPool::getLoopForHash(uint64_t hash) const {
+    std::lock_guard<std::mutex> locker(mtx_);
+    if (ring_.empty()) {
+        return mainLoop_;
+    }
+    // 顺时针找到第一个不小于hash的节点 超过最后一个节点时回到环的起点
+    auto it = std::lower_bound(ring_.begin(), ring_.end(), std::make_pair(hash, static_cast<EventLoop*>(nullptr)));
+    if (it == ring_.end()) {
+        it = ring_.begin();
+    }
+    return it->second;
+}
@@ -0,0 +1,92 @@
+#include "histogram.h"
+#include <algorithm>
+#include <limits>
+#include <stdio.h>
+using namespace apollo;
+
+const int64_t Histogram::kDefaultMaxValue;
+
+Histogram::Histogram(int64_t maxValue)
+    : maxValue_(std::max<int64_t>(maxValue, kSubBucketCount))
+    , counts_(bucketIndex(maxValue_) + 1, 0)
+    , count_(0)
+    , sum_(0)
+    , min_(std::numeric_limits<int64_t>::max())
+    , max_(0) {
+}
+
+size_t Histogram::bucketIndex(int64_t value) {
+    if (value < kSubBucketCount) {
+        return static_cast<size_t>(value);
+    }
+    // 最高有效位决定所在的2的幂区间 其后的6位决定区间内的桶
+    int    msb   = 63 - __builtin_clzll(static_cast<uint64_t>(value));
+    int    shift = msb - (kSubBucketBits - 1);
+    size_t sub   = static_cast<size_t>(value >> shift) - kSubBucketHalf;
+    return kSubBucketCount + static_cast<size_t>(shift - 1) * kSubBucketHalf + sub;
+}
+
+int64_t Histogram::bucketUpperBound(size_t index) {
+    if (index < static_cast<size_t>(kSubBucketCount)) {
+        return static_cast<int64_t>(index);
+    }
+    int     shift = static_cast<int>((index - kSubBucketCount) / kSubBucketHalf) + 1;
+    int64_t sub   = static_cast<int64_t>((index - kSubBucketCount) % kSubBucketHalf) + kSubBucketHalf;
+    return ((sub + 1) << shift) - 1;
+}
+
+void Histogram::record(int64_t value, int64_t count) {
+    value = std::min(std::max<int64_t>(value, 0), maxValue_);
+    counts_[bucketIndex(value)] += count;
+    count_ += count;
+    sum_ += value * count;
+    min_ = std::min(min_, value);
+    max_ = std::max(max_, value);
+}
+
+void Histogram::merge(const Histogram& other) {
+    size_t n = std::min(counts_.size(), other.counts_.size());
+    for (size_t i = 0; i < n; ++i) {
+        counts_[i] += other.counts_[i];
+    }
+    count_ += other.count_;
+    sum_ += other.sum_;
+    min_ = std::min(min_, other.min_);
+    max_ = std::max(max_, other.max_);
+}
+
+void Histogram::reset() {
+    std::fill(counts_.begin(), counts_.end(), 0);
+    count_ = 0;
+    sum_   = 0;
+    min_   = std::numeric_limits<int64_t>::max();
+    max_   = 0;
+}
+
+int64_t Histogram::percentile(double percentile) const {
+    if (count_ == 0) {
+        return 0;
+    }
+
+    percentile     = std::min(std::max(percentile, 0.0), 100.0);
+    int64_t target = static_cast<int64_t>(percentile / 100.0 * count_ + 0.5);
+    target         = std::max<int64_t>(target, 1);
+
+    int64_t seen = 0;
+    for (size_t i = 0; i < counts_.size(); ++i) {
+        seen += counts_[i];
+        if (seen >= target) {
+            return std::min(bucketUpperBound(i), max_);
+        }
+    }
+    return max_;
+}
+
+std::string Histogram::toString() const {
+    char buf[256] = { 0 };
+    snprintf(buf, sizeof(buf),
+        "count=%ld min=%ld mean=%.2f p50=%ld p90=%ld p99=%ld p999=%ld max=%ld",
+        count_, min(), mean(), percentile(50), percentile(90),
+        percentile(99), percentile(99.9), max_);
+    return buf;
+}
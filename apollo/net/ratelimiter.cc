@@ -0,0 +1,64 @@
+#include "ratelimiter.h"
+#include <algorithm>
+using namespace apollo;
+
+TokenBucket::TokenBucket(double rate, double burst)
+    : rate_(rate)
+    , burst_(std::max(burst, 1.0))
+    , tokens_(burst_)
+    , last_(Timestamp::now()) {
+}
+
+double TokenBucket::consume(double n, Timestamp now) {
+    if (rate_ <= 0) {
+        return 0;
+    }
+    double elapsed = static_cast<double>(now.microSecondsSinceEpoch() - last_.microSecondsSinceEpoch())
+                   / Timestamp::kMicroSecondsPerSecond;
+    if (elapsed > 0) {
+        tokens_ = std::min(burst_, tokens_ + elapsed * rate_);
+        last_   = now;
+    }
+    tokens_ -= n;
+    return tokens_ < 0 ? -tokens_ / rate_ : 0;
+}
+
+RateLimiter::RateLimiter(const RateLimit& limit)
+    : bytes_(limit.bytesPerSecond, limit.bytesPerSecond * limit.burstSeconds)
+    , messages_(limit.messagesPerSecond, limit.messagesPerSecond * limit.burstSeconds) {
+}
+
+double RateLimiter::consume(size_t bytes, size_t messages, Timestamp now) {
+    std::lock_guard<std::mutex> locker(mtx_);
+    return std::max(bytes_.consume(static_cast<double>(bytes), now),
+        messages_.consume(static_cast<double>(messages), now));
+}
+
+PeerRateLimiter::PeerRateLimiter(const RateLimit& limit, size_t maxPeers)
+    : limit_(limit)
+    , maxPeers_(std::max<size_t>(maxPeers, 1)) {
+}
+
+std::shared_ptr<RateLimiter> PeerRateLimiter::acquire(const InetAddress& peerAddr) {
+    uint32_t ip = peerAddr.getSockAddr()->sin_addr.s_addr;
+
+    std::lock_guard<std::mutex> locker(mtx_);
+    auto it = peers_.find(ip);
+    if (it != peers_.end()) {
+        lru_.splice(lru_.begin(), lru_, it->second);
+        return it->second->second;
+    }
+
+    if (peers_.size() >= maxPeers_) {
+        peers_.erase(lru_.back().first);
+        lru_.pop_back();
+    }
+    lru_.emplace_front(ip, std::make_shared<RateLimiter>(limit_));
+    peers_[ip] = lru_.begin();
+    return lru_.front().second;
+}
+
+size_t PeerRateLimiter::size() const {
+    std::lock_guard<std::mutex> locker(mtx_);
+    return peers_.size();
+}
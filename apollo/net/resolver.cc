@@ -0,0 +1,157 @@
+#include "resolver.h"
+#include "eventloop.h"
+#include "log.h"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <string.h>
+using namespace apollo;
+
+Resolver::Resolver(int numThreads)
+    : pool_("resolver")
+    , ttl_(60.0)
+    , negativeTtl_(5.0)
+    , maxCacheSize_(1024)
+    , cacheHits_(0)
+    , lookups_(0) {
+    pool_.setThreadNum(numThreads);
+    pool_.start();
+}
+
+Resolver::~Resolver() {
+    // 等待进行中的解析结束 其回调函数会被投递到各自的事件循环
+    pool_.stop();
+}
+
+void Resolver::setCacheTtl(double ttl, double negativeTtl) {
+    std::lock_guard<std::mutex> locker(mtx_);
+    ttl_         = ttl;
+    negativeTtl_ = negativeTtl;
+}
+
+void Resolver::setMaxCacheSize(size_t size) {
+    std::lock_guard<std::mutex> locker(mtx_);
+    maxCacheSize_ = size;
+}
+
+void Resolver::resolve(EventLoop* loop, const std::string& host, uint16_t port, const ResolveCallback& cb) {
+    Waiter waiter { loop, port, cb };
+
+    // 数字形式的地址不需要解析
+    in_addr addr;
+    if (::inet_pton(AF_INET, host.c_str(), &addr) == 1) {
+        deliver(waiter, std::vector<in_addr> { addr });
+        return;
+    }
+
+    std::lock_guard<std::mutex> locker(mtx_);
+    auto it = cache_.find(host);
+    if (it != cache_.end()) {
+        if (Timestamp::now() < it->second.expires) {
+            ++cacheHits_;
+            deliver(waiter, it->second.addrs);
+            return;
+        }
+        cache_.erase(it);
+    }
+
+    // 同一主机名已经在解析中时等待同一个结果
+    std::vector<Waiter>& waiters = inflight_[host];
+    waiters.push_back(waiter);
+    if (waiters.size() == 1) {
+        ++lookups_;
+        pool_.post(std::bind(&Resolver::lookup, this, host));
+    }
+}
+
+void Resolver::lookup(const std::string& host) {
+    addrinfo hints;
+    ::memset(&hints, 0, sizeof(hints));
+    hints.ai_family   = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+
+    std::vector<in_addr> addrs;
+    addrinfo*            result = nullptr;
+    int                  ret    = ::getaddrinfo(host.c_str(), nullptr, &hints, &result);
+    if (ret == 0) {
+        for (addrinfo* ai = result; ai != nullptr; ai = ai->ai_next) {
+            in_addr addr = reinterpret_cast<sockaddr_in*>(ai->ai_addr)->sin_addr;
+            // 同一地址可能以不同的协议出现多次
+            bool duplicate = std::any_of(addrs.begin(), addrs.end(),
+                [addr](const in_addr& a) { return a.s_addr == addr.s_addr; });
+            if (!duplicate) {
+                addrs.push_back(addr);
+            }
+        }
+        ::freeaddrinfo(result);
+    } else {
+        LOG_FMT_WARN(g_logger, "resolve %s failed: %s", host.c_str(), ::gai_strerror(ret));
+    }
+
+    std::vector<Waiter> waiters;
+    {
+        std::lock_guard<std::mutex> locker(mtx_);
+        waiters.swap(inflight_[host]);
+        inflight_.erase(host);
+
+        double ttl = addrs.empty() ? negativeTtl_ : ttl_;
+        if (ttl > 0 && maxCacheSize_ > 0) {
+            evictLocked();
+            CacheEntry& entry = cache_[host];
+            entry.addrs       = addrs;
+            entry.expires     = addTime(Timestamp::now(), ttl);
+        }
+    }
+    for (const Waiter& waiter : waiters) {
+        deliver(waiter, addrs);
+    }
+}
+
+void Resolver::deliver(const Waiter& waiter, const std::vector<in_addr>& addrs) {
+    std::vector<InetAddress> result;
+    for (const in_addr& addr : addrs) {
+        sockaddr_in sockaddr;
+        ::memset(&sockaddr, 0, sizeof(sockaddr));
+        sockaddr.sin_family = AF_INET;
+        sockaddr.sin_port   = htons(waiter.port);
+        sockaddr.sin_addr   = addr;
+        result.push_back(InetAddress(sockaddr));
+    }
+    waiter.loop->queueInLoop(std::bind(waiter.cb, std::move(result)));
+}
+
+void Resolver::evictLocked() {
+    if (cache_.size() < maxCacheSize_) {
+        return;
+    }
+    Timestamp now = Timestamp::now();
+    for (auto it = cache_.begin(); it != cache_.end();) {
+        if (it->second.expires < now) {
+            it = cache_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    while (cache_.size() >= maxCacheSize_) {
+        auto oldest = std::min_element(cache_.begin(), cache_.end(),
+            [](const std::pair<const std::string, CacheEntry>& a, const std::pair<const std::string, CacheEntry>& b) {
+                return a.second.expires < b.second.expires;
+            });
+        cache_.erase(oldest);
+    }
+}
+
+void Resolver::clearCache() {
+    std::lock_guard<std::mutex> locker(mtx_);
+    cache_.clear();
+}
+
+uint64_t Resolver::cacheHits() const {
+    std::lock_guard<std::mutex> locker(mtx_);
+    return cacheHits_;
+}
+
+uint64_t Resolver::lookups() const {
+    std::lock_guard<std::mutex> locker(mtx_);
+    return lookups_;
+}
@@ -1,6 +1,7 @@
 #include "socket.h"
 #include "inetaddress.h"
 #include "log.h"
+#include <linux/net_tstamp.h>
 #include <netinet/tcp.h>
 #include <strings.h>
 #include <sys/socket.h>
@@ -8,6 +9,10 @@
 #include <unistd.h>
 using namespace apollo;
 
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY 60
+#endif
+
 Socket::~Socket() {
     if (::close(sockfd_) < 0) {
         LOG_FMT_FATAL(g_logger, "close sockfd error: %d", errno);
@@ -62,4 +67,30 @@ void Socket::setReusePort(bool on) {
 void Socket::setKeepAlive(bool on) {
     int optval = on ? 1 : 0;
     ::setsockopt(sockfd_, SOL_SOCKET, SO_KEEPALIVE, &optval, sizeof(optval));
+}
+
+bool Socket::setTcpFastOpen(int queueLen) {
+    return ::setsockopt(sockfd_, IPPROTO_TCP, TCP_FASTOPEN, &queueLen, sizeof(queueLen)) == 0;
+}
+
+bool Socket::setTimestamping(bool rx, bool tx) {
+    int flags = 0;
+    if (rx) {
+        flags |= SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+    }
+    if (tx) {
+        // OPT_ID为每次发送编号 OPT_TSONLY使错误队列只返回时间戳而不回传数据包
+        flags |= SOF_TIMESTAMPING_TX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE
+               | SOF_TIMESTAMPING_OPT_ID | SOF_TIMESTAMPING_OPT_TSONLY;
+    }
+    return ::setsockopt(sockfd_, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) == 0;
+}
+
+bool Socket::setNotSentLowat(unsigned int bytes) {
+    return ::setsockopt(sockfd_, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &bytes, sizeof(bytes)) == 0;
+}
+
+bool Socket::setZeroCopy(bool on) {
+    int optval = on ? 1 : 0;
+    return ::setsockopt(sockfd_, SOL_SOCKET, SO_ZEROCOPY, &optval, sizeof(optval)) == 0;
 }
\ No newline at end of file
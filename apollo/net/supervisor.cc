@@ -0,0 +1,518 @@
+#include "supervisor.h"
+#include "channel.h"
+#include "eventloop.h"
+#include "log.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/prctl.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+using namespace apollo;
+
+static const char* kUpgradeEnv       = "APOLLO_SUPERVISOR_FD"; // 传递通信套接字的环境变量
+static const int    kMaxInheritedFds = 64;                     // 最多可以继承的监听套接字数目
+static const double kRespawnDelay    = 1.0;                    // 工作进程频繁退出时重新派生的间隔
+
+/**
+ * @brief 获取套接字绑定的本地地址
+ *
+ * @param sockfd
+ */
+static InetAddress getLocalAddr(int sockfd) {
+    sockaddr_in local;
+    ::bzero(&local, sizeof(local));
+    socklen_t addrlen = sizeof(local);
+    if (::getsockname(sockfd, reinterpret_cast<sockaddr*>(&local), &addrlen) < 0) {
+        LOG_FMT_ERROR(g_logger, "get socket name error: %d", errno);
+    }
+    return InetAddress(local);
+}
+
+/**
+ * @brief 通过SCM_RIGHTS发送一组文件描述符
+ *
+ * @param sockfd Unix域套接字
+ * @param fds 需要发送的文件描述符
+ */
+static bool sendFds(int sockfd, const std::vector<int>& fds) {
+    uint32_t count = static_cast<uint32_t>(fds.size());
+    iovec    iov;
+    iov.iov_base = &count;
+    iov.iov_len  = sizeof(count);
+
+    std::vector<char> control(CMSG_SPACE(sizeof(int) * fds.size()));
+    msghdr            msg;
+    ::bzero(&msg, sizeof(msg));
+    msg.msg_iov    = &iov;
+    msg.msg_iovlen = 1;
+    if (!fds.empty()) {
+        msg.msg_control    = control.data();
+        msg.msg_controllen = control.size();
+
+        cmsghdr* cmsg    = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type  = SCM_RIGHTS;
+        cmsg->cmsg_len   = CMSG_LEN(sizeof(int) * fds.size());
+        ::memcpy(CMSG_DATA(cmsg), fds.data(), sizeof(int) * fds.size());
+    }
+    return ::sendmsg(sockfd, &msg, MSG_NOSIGNAL) == static_cast<ssize_t>(sizeof(count));
+}
+
+/**
+ * @brief 通过SCM_RIGHTS接收一组文件描述符
+ *
+ * @param sockfd Unix域套接字
+ * @param fds 传出参数，接收到的文件描述符
+ */
+static bool recvFds(int sockfd, std::vector<int>* fds) {
+    uint32_t count = 0;
+    iovec    iov;
+    iov.iov_base = &count;
+    iov.iov_len  = sizeof(count);
+
+    std::vector<char> control(CMSG_SPACE(sizeof(int) * kMaxInheritedFds));
+    msghdr            msg;
+    ::bzero(&msg, sizeof(msg));
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = control.data();
+    msg.msg_controllen = control.size();
+
+    ssize_t n = ::recvmsg(sockfd, &msg, MSG_CMSG_CLOEXEC);
+    if (n != static_cast<ssize_t>(sizeof(count))) {
+        return false;
+    }
+    for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+            size_t num = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            int*   data = reinterpret_cast<int*>(CMSG_DATA(cmsg));
+            fds->insert(fds->end(), data, data + num);
+        }
+    }
+    return fds->size() == count;
+}
+
+Supervisor::Supervisor(const std::string& name, int argc, char* argv[])
+    : name_(name)
+    , argv_(argv, argv + argc)
+    , workerNum_(std::thread::hardware_concurrency())
+    , drainTimeout_(30.0)
+    , signalFd_(-1)
+    , readyFd_(-1)
+    , upgradeFd_(-1)
+    , upgradePid_(0)
+    , upgraded_(false)
+    , stopping_(false)
+    , isWorker_(false)
+    , workerSlot_(0) {
+    sigemptyset(&origMask_);
+
+    // 记录可执行文件的路径 热升级时执行替换后的新文件
+    char    path[PATH_MAX] = { 0 };
+    ssize_t n              = ::readlink("/proc/self/exe", path, sizeof(path) - 1);
+    if (n > 0) {
+        exePath_.assign(path, n);
+    } else if (argc > 0) {
+        exePath_ = argv[0];
+    }
+}
+
+Supervisor::~Supervisor() {
+    for (int fd : listenFds_) {
+        ::close(fd);
+    }
+    for (int fd : { signalFd_, readyFd_, upgradeFd_ }) {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+}
+
+void Supervisor::listen(const InetAddress& addr) {
+    listenAddrs_.push_back(addr);
+}
+
+int Supervisor::run() {
+    // 屏蔽控制信号 由signalfd统一处理
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigaddset(&mask, SIGTERM);
+    sigaddset(&mask, SIGQUIT);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGUSR2);
+    ::sigprocmask(SIG_BLOCK, &mask, &origMask_);
+    signalFd_ = ::signalfd(-1, &mask, SFD_CLOEXEC);
+    if (signalFd_ < 0) {
+        LOG_FMT_FATAL(g_logger, "supervisor[%s] - signalfd error: %d", name_.c_str(), errno);
+        return 1;
+    }
+
+    inheritListeners();
+    createListeners();
+
+    LOG_FMT_INFO(g_logger, "supervisor[%s] - master %d starting %d workers",
+        name_.c_str(), ::getpid(), workerNum_);
+
+    workers_.assign(workerNum_, Worker { 0, Timestamp() });
+    for (size_t i = 0; i < workers_.size(); ++i) {
+        spawnWorker(i);
+        if (isWorker_) {
+            return runWorker();
+        }
+    }
+
+    // 热升级启动时 通知旧的管理进程可以让旧的工作进程退出了
+    if (readyFd_ >= 0) {
+        char ready = 1;
+        if (::write(readyFd_, &ready, sizeof(ready)) != sizeof(ready)) {
+            LOG_FMT_ERROR(g_logger, "supervisor[%s] - notify old master error: %d", name_.c_str(), errno);
+        }
+        ::close(readyFd_);
+        readyFd_ = -1;
+    }
+
+    while (true) {
+        bool alive   = false;
+        bool pending = false;
+        for (const Worker& worker : workers_) {
+            alive   = alive || worker.pid != 0;
+            pending = pending || worker.pid == 0;
+        }
+        if (stopping_ && !alive) {
+            break;
+        }
+
+        pollfd fds[2];
+        nfds_t nfds    = 1;
+        fds[0].fd      = signalFd_;
+        fds[0].events  = POLLIN;
+        fds[0].revents = 0;
+        if (upgradeFd_ >= 0) {
+            fds[1].fd      = upgradeFd_;
+            fds[1].events  = POLLIN;
+            fds[1].revents = 0;
+            nfds           = 2;
+        }
+
+        // 有等待重新派生的工作进程时定期醒来
+        int timeout = (pending && !stopping_) ? 100 : -1;
+        int n       = ::poll(fds, nfds, timeout);
+        if (n < 0 && errno != EINTR) {
+            LOG_FMT_ERROR(g_logger, "supervisor[%s] - poll error: %d", name_.c_str(), errno);
+        }
+
+        if (n > 0 && (fds[0].revents & POLLIN)) {
+            signalfd_siginfo info;
+            if (::read(signalFd_, &info, sizeof(info)) == sizeof(info)) {
+                handleSignal(info.ssi_signo);
+            }
+        }
+        if (n > 0 && nfds == 2 && fds[1].revents != 0) {
+            handleUpgradeRead();
+        }
+
+        // 重新派生退出的工作进程 频繁退出时限制派生的速度
+        Timestamp now(Timestamp::now());
+        for (size_t i = 0; !stopping_ && i < workers_.size(); ++i) {
+            if (workers_[i].pid == 0 && timeDifference(now, workers_[i].spawnTime) >= kRespawnDelay) {
+                spawnWorker(i);
+                if (isWorker_) {
+                    return runWorker();
+                }
+            }
+        }
+    }
+
+    LOG_FMT_INFO(g_logger, "supervisor[%s] - master %d exit", name_.c_str(), ::getpid());
+    return 0;
+}
+
+bool Supervisor::inheritListeners() {
+    const char* env = ::getenv(kUpgradeEnv);
+    if (env == nullptr) {
+        return false;
+    }
+
+    readyFd_ = ::atoi(env);
+    ::unsetenv(kUpgradeEnv);
+    ::fcntl(readyFd_, F_SETFD, FD_CLOEXEC);
+
+    if (!recvFds(readyFd_, &inherited_)) {
+        LOG_FMT_ERROR(g_logger, "supervisor[%s] - failed to inherit listeners: %d", name_.c_str(), errno);
+        return false;
+    }
+    LOG_FMT_INFO(g_logger, "supervisor[%s] - inherited %lu listeners", name_.c_str(), inherited_.size());
+    return true;
+}
+
+void Supervisor::createListeners() {
+    for (const InetAddress& addr : listenAddrs_) {
+        // 优先复用从旧进程继承而来的地址相同的监听套接字
+        int listenfd = -1;
+        for (auto iter = inherited_.begin(); iter != inherited_.end(); ++iter) {
+            if (getLocalAddr(*iter).toIpPort() == addr.toIpPort()) {
+                listenfd = *iter;
+                inherited_.erase(iter);
+                break;
+            }
+        }
+
+        if (listenfd < 0) {
+            listenfd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            if (listenfd < 0) {
+                LOG_FMT_FATAL(g_logger, "failed to create socket, errno: %d", errno);
+            }
+            int optval = 1;
+            ::setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR, &optval, sizeof(optval));
+            if (::bind(listenfd, (sockaddr*)(addr.getSockAddr()), sizeof(sockaddr_in)) < 0) {
+                LOG_FMT_FATAL(g_logger, "failed to bind %s: %d", addr.toIpPort().c_str(), errno);
+            }
+            // 在派生工作进程之前开始监听 所有工作进程共享同一个连接队列
+            if (::listen(listenfd, 1024) < 0) {
+                LOG_FMT_FATAL(g_logger, "failed to listen %s: %d", addr.toIpPort().c_str(), errno);
+            }
+        }
+        listenFds_.push_back(listenfd);
+    }
+
+    // 新版本不再监听的地址
+    for (int fd : inherited_) {
+        ::close(fd);
+    }
+    inherited_.clear();
+}
+
+void Supervisor::spawnWorker(size_t slot) {
+    pid_t pid = ::fork();
+    if (pid < 0) {
+        LOG_FMT_ERROR(g_logger, "supervisor[%s] - fork error: %d", name_.c_str(), errno);
+        workers_[slot].spawnTime = Timestamp::now();
+        return;
+    }
+    if (pid == 0) {
+        isWorker_   = true;
+        workerSlot_ = slot;
+        return;
+    }
+
+    workers_[slot].pid       = pid;
+    workers_[slot].spawnTime = Timestamp::now();
+    LOG_FMT_INFO(g_logger, "supervisor[%s] - worker #%lu started, pid: %d", name_.c_str(), slot, pid);
+}
+
+int Supervisor::runWorker() {
+    // 关闭只属于管理进程的描述符
+    for (int* fd : { &signalFd_, &readyFd_, &upgradeFd_ }) {
+        if (*fd >= 0) {
+            ::close(*fd);
+            *fd = -1;
+        }
+    }
+    workers_.clear();
+
+    // 管理进程意外退出时工作进程随之优雅退出
+    ::prctl(PR_SET_PDEATHSIG, SIGQUIT);
+
+    // 恢复原有的信号屏蔽字 只有退出信号继续由signalfd处理
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGTERM);
+    sigaddset(&mask, SIGQUIT);
+    sigaddset(&mask, SIGINT);
+    ::sigprocmask(SIG_SETMASK, &origMask_, nullptr);
+    ::sigprocmask(SIG_BLOCK, &mask, nullptr);
+
+    EventLoop loop;
+    int       sigfd = ::signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    Channel   signalChannel(&loop, sigfd);
+
+    // 每个监听地址创建一个服务器 服务器接管监听套接字
+    std::vector<std::unique_ptr<TcpServer>> servers;
+    for (size_t i = 0; i < listenFds_.size(); ++i) {
+        std::unique_ptr<TcpServer> server;
+        if (serverFactory_) {
+            server = serverFactory_(&loop, listenFds_[i], i);
+        }
+        if (server) {
+            server->start();
+            servers.push_back(std::move(server));
+        } else {
+            ::close(listenFds_[i]);
+        }
+    }
+    listenFds_.clear();
+
+    bool   draining = false;
+    size_t pending  = servers.size();
+    signalChannel.setReadCallback([&](Timestamp) {
+        signalfd_siginfo info;
+        while (::read(sigfd, &info, sizeof(info)) == sizeof(info)) {
+            if (draining) {
+                // 再次收到退出信号时立即退出
+                loop.quit();
+                return;
+            }
+
+            LOG_FMT_INFO(g_logger, "supervisor[%s] - worker #%lu received signal %u, draining",
+                name_.c_str(), workerSlot_, info.ssi_signo);
+            draining = true;
+            if (pending == 0) {
+                loop.quit();
+                return;
+            }
+            for (auto& server : servers) {
+                server->drain(drainTimeout_, [&]() {
+                    if (--pending == 0) {
+                        loop.quit();
+                    }
+                });
+            }
+        }
+    });
+    signalChannel.enableReading();
+
+    LOG_FMT_INFO(g_logger, "supervisor[%s] - worker #%lu running, pid: %d",
+        name_.c_str(), workerSlot_, ::getpid());
+    loop.loop();
+
+    signalChannel.disableAll();
+    signalChannel.remove();
+    ::close(sigfd);
+    servers.clear();
+
+    LOG_FMT_INFO(g_logger, "supervisor[%s] - worker #%lu exit", name_.c_str(), workerSlot_);
+    return 0;
+}
+
+void Supervisor::reapWorkers() {
+    int   status = 0;
+    pid_t pid;
+    while ((pid = ::waitpid(-1, &status, WNOHANG)) > 0) {
+        if (pid == upgradePid_) {
+            upgradePid_ = 0;
+            if (!upgraded_) {
+                LOG_FMT_ERROR(g_logger, "supervisor[%s] - new master %d exited before ready, status: %d",
+                    name_.c_str(), pid, status);
+                if (upgradeFd_ >= 0) {
+                    ::close(upgradeFd_);
+                    upgradeFd_ = -1;
+                }
+            }
+            continue;
+        }
+
+        for (size_t i = 0; i < workers_.size(); ++i) {
+            if (workers_[i].pid == pid) {
+                workers_[i].pid = 0;
+                if (WIFSIGNALED(status)) {
+                    LOG_FMT_WARN(g_logger, "supervisor[%s] - worker #%lu killed by signal %d",
+                        name_.c_str(), i, WTERMSIG(status));
+                } else {
+                    LOG_FMT_INFO(g_logger, "supervisor[%s] - worker #%lu exited, status: %d",
+                        name_.c_str(), i, WEXITSTATUS(status));
+                }
+                break;
+            }
+        }
+    }
+}
+
+void Supervisor::handleSignal(int signo) {
+    switch (signo) {
+    case SIGCHLD:
+        reapWorkers();
+        break;
+    case SIGTERM:
+    case SIGQUIT:
+    case SIGINT:
+        LOG_FMT_INFO(g_logger, "supervisor[%s] - received signal %d, stopping", name_.c_str(), signo);
+        stopWorkers();
+        break;
+    case SIGUSR2:
+        upgrade();
+        break;
+    default:
+        break;
+    }
+}
+
+void Supervisor::upgrade() {
+    if (stopping_ || upgradePid_ != 0) {
+        LOG_FMT_WARN(g_logger, "supervisor[%s] - upgrade is not allowed now", name_.c_str());
+        return;
+    }
+
+    int fds[2];
+    if (::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0) {
+        LOG_FMT_ERROR(g_logger, "supervisor[%s] - socketpair error: %d", name_.c_str(), errno);
+        return;
+    }
+
+    pid_t pid = ::fork();
+    if (pid < 0) {
+        LOG_FMT_ERROR(g_logger, "supervisor[%s] - fork error: %d", name_.c_str(), errno);
+        ::close(fds[0]);
+        ::close(fds[1]);
+        return;
+    }
+
+    if (pid == 0) {
+        // 新的管理进程 通信套接字需要在exec之后保留
+        ::fcntl(fds[1], F_SETFD, 0);
+        ::setenv(kUpgradeEnv, std::to_string(fds[1]).c_str(), 1);
+        ::sigprocmask(SIG_SETMASK, &origMask_, nullptr);
+
+        std::vector<char*> args;
+        for (std::string& arg : argv_) {
+            args.push_back(&arg[0]);
+        }
+        args.push_back(nullptr);
+        ::execv(exePath_.c_str(), args.data());
+        ::_exit(127);
+    }
+
+    ::close(fds[1]);
+    if (!sendFds(fds[0], listenFds_)) {
+        LOG_FMT_ERROR(g_logger, "supervisor[%s] - send listeners error: %d", name_.c_str(), errno);
+    }
+
+    upgradeFd_  = fds[0];
+    upgradePid_ = pid;
+    upgraded_   = false;
+    LOG_FMT_INFO(g_logger, "supervisor[%s] - upgrading, new master pid: %d", name_.c_str(), pid);
+}
+
+void Supervisor::handleUpgradeRead() {
+    char    ready = 0;
+    ssize_t n     = ::read(upgradeFd_, &ready, sizeof(ready));
+    ::close(upgradeFd_);
+    upgradeFd_ = -1;
+
+    if (n == sizeof(ready)) {
+        // 新的工作进程已经开始接收连接 旧的工作进程优雅退出
+        upgraded_ = true;
+        LOG_FMT_INFO(g_logger, "supervisor[%s] - new master %d is ready, draining old workers",
+            name_.c_str(), upgradePid_);
+        stopWorkers();
+    } else {
+        LOG_FMT_ERROR(g_logger, "supervisor[%s] - upgrade failed, keep serving", name_.c_str());
+    }
+}
+
+void Supervisor::stopWorkers() {
+    stopping_ = true;
+    for (const Worker& worker : workers_) {
+        if (worker.pid != 0) {
+            ::kill(worker.pid, SIGQUIT);
+        }
+    }
+}
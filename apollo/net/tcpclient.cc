@@ -7,6 +7,20 @@ void removeTcpConnection(EventLoop* loop, const TcpConnectionPtr& conn) {
     loop->queueInLoop(std::bind(&TcpConnection::connectDestoryed, conn));
 }
 
+// TcpClient析构后在事件循环中接管连接 连接已经销毁时weak为空
+static void detachConnection(EventLoop* loop, const std::weak_ptr<TcpConnection>& weak) {
+    TcpConnectionPtr conn = weak.lock();
+    if (!conn) {
+        return;
+    }
+    conn->setCloseCallback(std::bind(&removeTcpConnection, loop, std::placeholders::_1));
+    // TcpClient已经放弃了引用 此时连接的持有者只有事件循环的self_和这里的conn时 用户已经不再使用 主动关闭
+    // 用户仍然持有时保持连接 关闭后由removeTcpConnection销毁
+    if (conn->ownedByLoop() && conn.use_count() == 2) {
+        conn->forceClose();
+    }
+}
+
 static EventLoop* CheckLoopNotNull(EventLoop* loop) {
     if (loop == nullptr) {
         LOG_FATAL(g_logger) << "loop is null!";
@@ -16,14 +30,28 @@ static EventLoop* CheckLoopNotNull(EventLoop* loop) {
 
 TcpClient::TcpClient(EventLoop* loop, const InetAddress& serverAddr,
     const std::string& nameArg)
+    : TcpClient(loop, std::make_shared<Connector>(loop, serverAddr), nameArg) {
+}
+
+TcpClient::TcpClient(EventLoop* loop, const std::vector<InetAddress>& serverAddrs,
+    const std::string& nameArg)
+    : TcpClient(loop, std::make_shared<Connector>(loop, serverAddrs), nameArg) {
+}
+
+TcpClient::TcpClient(EventLoop* loop, Resolver* resolver, const std::string& host, uint16_t port,
+    const std::string& nameArg)
+    : TcpClient(loop, std::make_shared<Connector>(loop, resolver, host, port), nameArg) {
+}
+
+TcpClient::TcpClient(EventLoop* loop, const ConnectorPtr& connector, const std::string& nameArg)
     : loop_(CheckLoopNotNull(loop))
-    , connector_(new Connector(loop, serverAddr))
+    , connector_(connector)
     , name_(nameArg)
     , connect_(true)
     , retry_(false)
     , connectionCallback_()
     , messageCallback_()
-    , nextConnId_(1) 
+    , nextConnId_(1)
 {
     connector_->setNewConnectionCallback(std::bind(&TcpClient::newConnection,
         this, std::placeholders::_1));
@@ -35,22 +63,16 @@ TcpClient::~TcpClient()
 {
     LOG_FMT_INFO(g_logger, "tcpclient[%s] dtor - connector[%p]",
         name_.c_str(), connector_.get());
-    TcpConnectionPtr conn;
-
-    bool unique = false;
+    std::weak_ptr<TcpConnection> weak;
     {
         std::lock_guard<std::mutex> locker(mtx_);
-        unique = connection_.unique();
-        conn   = connection_;
+        weak = connection_;
+        connection_.reset();
     }
 
-    if (conn) {
-        CloseCallback cb = std::bind(&removeTcpConnection,
-            loop_, std::placeholders::_1);
-        loop_->runInLoop(std::bind(&TcpConnection::setCloseCallback, conn, cb));
-        if (unique) {
-            conn->forceClose();
-        }
+    // 是否还有其他持有者只能在事件循环中判断 此时事件循环自身的处理过程中没有临时的引用
+    if (!weak.expired()) {
+        loop_->runInLoop(std::bind(&detachConnection, loop_, weak));
     } else {
         connector_->stop();
     }
@@ -58,8 +80,13 @@ TcpClient::~TcpClient()
 
 void TcpClient::connect() 
 {
-    LOG_FMT_INFO(g_logger, "TcpClinet[%s] - connecting to %s",
-        name_.c_str(), connector_->serverAddress().toIpPort().c_str());
+    if (connector_->host().empty()) {
+        LOG_FMT_INFO(g_logger, "TcpClinet[%s] - connecting to %s",
+            name_.c_str(), connector_->serverAddress().toIpPort().c_str());
+    } else {
+        LOG_FMT_INFO(g_logger, "TcpClinet[%s] - connecting to %s",
+            name_.c_str(), connector_->host().c_str());
+    }
     connect_ = true;
     connector_->start();
 }
@@ -92,18 +119,24 @@ void TcpClient::newConnection(int sockfd)
     socklen_t   addrlen = sizeof(peeraddr);
     bzero(&peeraddr, addrlen);
 
-    if (::getpeername(sockfd, reinterpret_cast<sockaddr*>(&peeraddr), &addrlen) < 0) {
+    InetAddress peerAddr(peeraddr);
+    if (::getpeername(sockfd, reinterpret_cast<sockaddr*>(&peeraddr), &addrlen) == 0) {
+        peerAddr = InetAddress(peeraddr);
+    } else if (errno == ENOTCONN) {
+        // 以TCP Fast Open发起的连接在第一次发送数据之前尚未发出SYN 对端即为所连接的服务器
+        peerAddr = connector_->serverAddress();
+    } else {
         LOG_ERROR(g_logger) << "failed to get peer addr";
     }
-    InetAddress peerAddr(peeraddr);
 
-    char buf[32];
+    char buf[64];
     snprintf(buf, sizeof(buf), ":%s#%d", peerAddr.toIpPort().c_str(), nextConnId_);
     ++nextConnId_;
     std::string connName = name_ + buf;
 
     addrlen = sizeof(localaddr);
-    if (::getsockname(sockfd, reinterpret_cast<sockaddr*>(&peerAddr), &addrlen) < 0) {
+    bzero(&localaddr, addrlen);
+    if (::getsockname(sockfd, reinterpret_cast<sockaddr*>(&localaddr), &addrlen) < 0) {
         LOG_ERROR(g_logger) << "failed to get local addr";
     }
     InetAddress localAddr(localaddr);
@@ -0,0 +1,390 @@
+#include "tcpclientpool.h"
+#include "log.h"
+#include <algorithm>
+#include <condition_variable>
+#include <map>
+using namespace apollo;
+
+//统计尚未完成的销毁任务 连接池析构时等待其全部完成
+struct TcpClientPool::Teardown {
+    std::mutex              mtx;
+    std::condition_variable cond;
+    int                     pending = 0;
+
+    void add() {
+        std::lock_guard<std::mutex> locker(mtx);
+        ++pending;
+    }
+
+    void done() {
+        std::lock_guard<std::mutex> locker(mtx);
+        if (--pending == 0) {
+            cond.notify_all();
+        }
+    }
+
+    void wait() {
+        std::unique_lock<std::mutex> locker(mtx);
+        cond.wait(locker, [this]() { return pending == 0; });
+    }
+};
+
+static EventLoop* CheckLoopNotNull(EventLoop* loop) {
+    if (loop == nullptr) {
+        LOG_FATAL(g_logger) << "loop is null!";
+    }
+    return loop;
+}
+
+/**
+ * @brief 在客户端所属的事件循环中销毁客户端
+ * @details 该函数只替换掉指向连接池的回调，绑定在函数对象中的客户端会在函数对象析构时释放，
+ * 此时已经位于客户端所属的事件循环中，TcpClient可以安全地关闭其连接
+ *
+ * @param client 客户端对象
+ * @param cb 连接关闭时所使用的回调函数，替换掉指向连接池的回调
+ */
+static void destroyClient(const std::shared_ptr<TcpClient>& client, const ConnectionCallback& cb) {
+    // 连接销毁时会无条件调用回调 未设置时使用空的回调
+    ConnectionCallback detached = cb ? cb : [](const TcpConnectionPtr&) {};
+    // 仍在连接中的客户端建立连接时会使用TcpClient的回调 同样需要替换
+    client->setConnectionCallback(detached);
+    TcpConnectionPtr conn = client->connection();
+    if (conn) {
+        conn->setConnectionCallback(detached);
+    }
+}
+
+void TcpClientPool::closeClients(EventLoop* loop, const std::shared_ptr<std::vector<TcpClientPtr>>& clients,
+    const ConnectionCallback& cb, const std::shared_ptr<Teardown>& teardown) {
+    std::vector<TcpConnectionPtr> conns;
+    for (const TcpClientPtr& client : *clients) {
+        destroyClient(client, cb);
+        TcpConnectionPtr conn = client->connection();
+        if (conn) {
+            conns.push_back(conn);
+        }
+    }
+    // 连接池是客户端唯一的持有者 TcpClient在此析构 停止连接器的任务排在之后的通知之前
+    clients->clear();
+
+    for (const TcpConnectionPtr& conn : conns) {
+        if (teardown) {
+            teardown->add();
+        }
+        if (conn->disconnected()) {
+            // 已经关闭 销毁连接的任务已经在队列中 排在其后通知
+            if (teardown) {
+                loop->queueInLoop(std::bind(&Teardown::done, teardown));
+            }
+            continue;
+        }
+        // 连接池的连接不再交给其他人使用 关闭后在这里销毁并通知
+        conn->setCloseCallback([loop, teardown](const TcpConnectionPtr& closed) {
+            loop->queueInLoop([closed, teardown]() {
+                closed->connectDestoryed();
+                if (teardown) {
+                    teardown->done();
+                }
+            });
+        });
+        conn->forceClose();
+    }
+    // 调用方投递前计入的任务 客户端析构时投递的任务排在此之前
+    if (teardown) {
+        loop->queueInLoop(std::bind(&Teardown::done, teardown));
+    }
+}
+
+TcpClientPool::TcpClientPool(EventLoop* loop, const std::string& name)
+    : loop_(CheckLoopNotNull(loop))
+    , name_(name)
+    , threadPool_(new EventLoopThreadPool(loop_, name_))
+    , minConnections_(1)
+    , maxConnections_(8)
+    , healthCheckInterval_(5.0)
+    , maxIdleTime_(60.0)
+    , leaseTimeout_(5.0)
+    , started_(false)
+    , nextClientId_(1)
+    , teardown_(std::make_shared<Teardown>()) {
+}
+
+TcpClientPool::~TcpClientPool() {
+    // 健康检查定时器绑定了this 在loop_中取消并等待 之后不会再执行
+    if (started_) {
+        if (loop_->isInLoopThread()) {
+            loop_->cancel(healthTimer_);
+        } else {
+            teardown_->add();
+            std::shared_ptr<Teardown> teardown = teardown_;
+            loop_->runInLoop([this, teardown]() {
+                loop_->cancel(healthTimer_);
+                teardown->done();
+            });
+            teardown_->wait();
+        }
+    }
+
+    std::vector<LeaseCallback>                      waiters;
+    std::map<EventLoop*, std::vector<TcpClientPtr>> clients;
+    {
+        std::lock_guard<std::mutex> locker(mtx_);
+        for (auto& item : endpoints_) {
+            Endpoint* endpoint = item.second.get();
+            for (const Waiter& waiter : endpoint->waiters) {
+                waiters.push_back(waiter.callback);
+            }
+            for (TcpClientPtr& client : endpoint->clients) {
+                EventLoop* loop = client->getLoop();
+                clients[loop].push_back(std::move(client));
+            }
+        }
+        endpoints_.clear();
+    }
+
+    // 连接池析构之后线程池随即销毁 事件循环退出时尚未执行的任务不会再执行
+    // 因此在各自的事件循环中关闭客户端 并等待连接销毁和停止连接器的任务执行完毕
+    for (auto& item : clients) {
+        EventLoop* loop = item.first;
+        std::shared_ptr<std::vector<TcpClientPtr>> holder(new std::vector<TcpClientPtr>(std::move(item.second)));
+        // 没有SubLoop时客户端位于loop_中 loop_属于调用方 生命周期长于连接池 不需要等待
+        std::shared_ptr<Teardown> teardown = loop == loop_ ? nullptr : teardown_;
+        if (teardown) {
+            teardown->add();
+        }
+        loop->runInLoop(std::bind(&TcpClientPool::closeClients, loop, holder, connectionCallback_, teardown));
+    }
+    teardown_->wait();
+
+    // 连接池关闭 让所有等待中的租用请求失败
+    for (const LeaseCallback& cb : waiters) {
+        cb(TcpConnectionPtr());
+    }
+}
+
+void TcpClientPool::setThreadNum(int numThreads) {
+    threadPool_->setThreadNum(numThreads);
+}
+
+void TcpClientPool::start() {
+    if (!started_) {
+        started_ = true;
+        threadPool_->start(threadInitCallback_);
+        healthTimer_ = loop_->runEvery(healthCheckInterval_,
+            std::bind(&TcpClientPool::healthCheck, this));
+    }
+}
+
+void TcpClientPool::warmup(const InetAddress& serverAddr) {
+    std::lock_guard<std::mutex> locker(mtx_);
+    Endpoint* endpoint = getEndpoint(serverAddr);
+    while (static_cast<int>(endpoint->clients.size()) < minConnections_) {
+        addClient(endpoint);
+    }
+}
+
+void TcpClientPool::acquire(const InetAddress& serverAddr, LeaseCallback cb) {
+    TcpConnectionPtr conn;
+    {
+        std::lock_guard<std::mutex> locker(mtx_);
+        Endpoint* endpoint = getEndpoint(serverAddr);
+
+        // 优先使用最近归还的连接 让最久未使用的连接在健康检查时被回收
+        while (!endpoint->idle.empty()) {
+            TcpConnectionPtr candidate = endpoint->idle.back().conn;
+            endpoint->idle.pop_back();
+            if (candidate->connected()) {
+                conn = candidate;
+                endpoint->leased.insert(conn->name());
+                break;
+            }
+        }
+
+        if (!conn) {
+            endpoint->waiters.push_back(Waiter { std::move(cb), Timestamp::now() });
+
+            // 正在建立的连接不足以满足所有等待者 且尚未达到最大连接数时新建连接
+            size_t demand = endpoint->leased.size() + endpoint->waiters.size();
+            if (endpoint->clients.size() < demand
+                && static_cast<int>(endpoint->clients.size()) < maxConnections_) {
+                addClient(endpoint);
+            }
+            return;
+        }
+    }
+
+    dispatch(cb, conn);
+}
+
+void TcpClientPool::release(const TcpConnectionPtr& conn) {
+    LeaseCallback cb;
+    {
+        std::lock_guard<std::mutex> locker(mtx_);
+        auto iter = endpoints_.find(conn->peerAddr().toIpPort());
+        if (iter == endpoints_.end()) {
+            return;
+        }
+
+        Endpoint* endpoint = iter->second.get();
+        if (endpoint->leased.erase(conn->name()) == 0) {
+            LOG_FMT_WARN(g_logger, "TcpClientPool[%s] - connection %s is not leased",
+                name_.c_str(), conn->name().c_str());
+            return;
+        }
+        if (!conn->connected() || !offer(endpoint, conn, &cb)) {
+            return;
+        }
+    }
+
+    dispatch(cb, conn);
+}
+
+size_t TcpClientPool::idleConnections(const InetAddress& serverAddr) {
+    std::lock_guard<std::mutex> locker(mtx_);
+    auto iter = endpoints_.find(serverAddr.toIpPort());
+    return iter == endpoints_.end() ? 0 : iter->second->idle.size();
+}
+
+size_t TcpClientPool::leasedConnections(const InetAddress& serverAddr) {
+    std::lock_guard<std::mutex> locker(mtx_);
+    auto iter = endpoints_.find(serverAddr.toIpPort());
+    return iter == endpoints_.end() ? 0 : iter->second->leased.size();
+}
+
+TcpClientPool::Endpoint* TcpClientPool::getEndpoint(const InetAddress& serverAddr) {
+    std::unique_ptr<Endpoint>& endpoint = endpoints_[serverAddr.toIpPort()];
+    if (!endpoint) {
+        endpoint.reset(new Endpoint(serverAddr));
+    }
+    return endpoint.get();
+}
+
+void TcpClientPool::addClient(Endpoint* endpoint) {
+    // 通过轮询算法选择客户端所在的事件循环
+    EventLoop* ioLoop = threadPool_->getNextLoop();
+
+    char buf[64] = { 0 };
+    snprintf(buf, sizeof(buf), "-%s#%d", endpoint->serverAddr.toIpPort().c_str(), nextClientId_);
+    ++nextClientId_;
+
+    TcpClientPtr client(new TcpClient(ioLoop, endpoint->serverAddr, name_ + buf));
+    client->setConnectionCallback(std::bind(&TcpClientPool::onConnection, this,
+        endpoint->serverAddr.toIpPort(), std::placeholders::_1));
+    client->setMessageCallback(messageCallback_);
+    client->setWriteCompleteCallback(writeCompleteCallback_);
+    // 连接断开后由Connector按照退避策略自动重连
+    client->enableRetry();
+    client->connect();
+
+    endpoint->clients.push_back(client);
+}
+
+void TcpClientPool::removeClient(Endpoint* endpoint, const TcpConnectionPtr& conn) {
+    auto iter = std::find_if(endpoint->clients.begin(), endpoint->clients.end(),
+        [&conn](const TcpClientPtr& client) { return client->connection() == conn; });
+    if (iter == endpoint->clients.end()) {
+        return;
+    }
+
+    LOG_FMT_INFO(g_logger, "TcpClientPool[%s] - close idle client %s",
+        name_.c_str(), (*iter)->name().c_str());
+
+    EventLoop* loop = (*iter)->getLoop();
+    std::shared_ptr<std::vector<TcpClientPtr>> holder(new std::vector<TcpClientPtr> { *iter });
+    endpoint->clients.erase(iter);
+    // 投递前计入 连接池析构时等待这里关闭的连接销毁完毕
+    std::shared_ptr<Teardown> teardown = loop == loop_ ? nullptr : teardown_;
+    if (teardown) {
+        teardown->add();
+    }
+    loop->queueInLoop(std::bind(&TcpClientPool::closeClients, loop, holder, connectionCallback_, teardown));
+}
+
+void TcpClientPool::dispatch(const LeaseCallback& cb, const TcpConnectionPtr& conn) {
+    conn->getLoop()->runInLoop(std::bind(cb, conn));
+}
+
+bool TcpClientPool::offer(Endpoint* endpoint, const TcpConnectionPtr& conn, LeaseCallback* cb) {
+    if (!endpoint->waiters.empty()) {
+        *cb = std::move(endpoint->waiters.front().callback);
+        endpoint->waiters.pop_front();
+        endpoint->leased.insert(conn->name());
+        return true;
+    }
+    endpoint->idle.push_back(IdleConnection { conn, Timestamp::now() });
+    return false;
+}
+
+void TcpClientPool::onConnection(const std::string& key, const TcpConnectionPtr& conn) {
+    if (connectionCallback_) {
+        connectionCallback_(conn);
+    }
+
+    LeaseCallback cb;
+    {
+        std::lock_guard<std::mutex> locker(mtx_);
+        auto iter = endpoints_.find(key);
+        if (iter == endpoints_.end()) {
+            return;
+        }
+
+        Endpoint* endpoint = iter->second.get();
+        if (!conn->connected()) {
+            // 连接断开 将其从空闲队列和租用集合中移除 等待TcpClient重连
+            endpoint->leased.erase(conn->name());
+            auto idleIter = std::find_if(endpoint->idle.begin(), endpoint->idle.end(),
+                [&conn](const IdleConnection& item) { return item.conn == conn; });
+            if (idleIter != endpoint->idle.end()) {
+                endpoint->idle.erase(idleIter);
+            }
+            return;
+        }
+        if (!offer(endpoint, conn, &cb)) {
+            return;
+        }
+    }
+
+    // 当前已经位于连接所属的事件循环中
+    cb(conn);
+}
+
+void TcpClientPool::healthCheck() {
+    Timestamp                  now(Timestamp::now());
+    std::vector<LeaseCallback> expired;
+    {
+        std::lock_guard<std::mutex> locker(mtx_);
+        for (auto& item : endpoints_) {
+            Endpoint* endpoint = item.second.get();
+
+            // 让等待超时的租用请求失败
+            while (!endpoint->waiters.empty()
+                && timeDifference(now, endpoint->waiters.front().waitSince) > leaseTimeout_) {
+                expired.push_back(std::move(endpoint->waiters.front().callback));
+                endpoint->waiters.pop_front();
+            }
+
+            // 回收空闲过久且超出最小连接数的连接
+            while (!endpoint->idle.empty()
+                && static_cast<int>(endpoint->clients.size()) > minConnections_
+                && timeDifference(now, endpoint->idle.front().idleSince) > maxIdleTime_) {
+                TcpConnectionPtr conn = endpoint->idle.front().conn;
+                endpoint->idle.pop_front();
+                removeClient(endpoint, conn);
+            }
+
+            // 补齐最小连接数
+            while (static_cast<int>(endpoint->clients.size()) < minConnections_) {
+                addClient(endpoint);
+            }
+
+            LOG_FMT_DEBUG(g_logger, "TcpClientPool[%s] - %s clients: %lu, idle: %lu, leased: %lu, waiters: %lu",
+                name_.c_str(), item.first.c_str(), endpoint->clients.size(), endpoint->idle.size(),
+                endpoint->leased.size(), endpoint->waiters.size());
+        }
+    }
+
+    for (const LeaseCallback& cb : expired) {
+        cb(TcpConnectionPtr());
+    }
+}
@@ -3,11 +3,74 @@
 #include "eventloop.h"
 #include "log.h"
 #include "socket.h"
+#include <algorithm>
+#include <fcntl.h>
 #include <functional>
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+#include <linux/tcp.h>
+#include <netinet/in.h>
+#include <string.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <unistd.h>
+#include <vector>
 using namespace apollo;
 
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY 0x4000000
+#endif
+#ifndef SO_EE_ORIGIN_ZEROCOPY
+#define SO_EE_ORIGIN_ZEROCOPY 5
+#endif
+#ifndef SO_EE_CODE_ZEROCOPY_COPIED
+#define SO_EE_CODE_ZEROCOPY_COPIED 1
+#endif
+
+namespace
+{
+const size_t kForwardChunk   = 64 * 1024; // 每次从套接字移入管道的最大字节数 与管道的默认容量一致
+const size_t kMaxCachedPipes = 64;        // 每个事件循环最多缓存的空闲管道数目
+const int    kMaxIovecs      = 64;        // 每次writev最多写出的数据块数目
+const double kZeroCopyLinger = 10.0;      // 连接销毁后零拷贝数据的保留时间 单位为秒
+const size_t kShrinkCapacity = 64 * 1024; // 缓冲区占用的内存超过该值时在空闲时缩减
+
+// 转发使用的管道池 每个事件循环线程一个 连接关闭后管道留给后续的转发复用
+struct PipePool {
+    std::vector<std::pair<int, int>> pipes;
+
+    ~PipePool() {
+        for (const auto& p : pipes) {
+            ::close(p.first);
+            ::close(p.second);
+        }
+    }
+};
+
+thread_local PipePool t_pipePool;
+
+bool acquirePipe(int fds[2]) {
+    if (!t_pipePool.pipes.empty()) {
+        fds[0] = t_pipePool.pipes.back().first;
+        fds[1] = t_pipePool.pipes.back().second;
+        t_pipePool.pipes.pop_back();
+        return true;
+    }
+    return ::pipe2(fds, O_NONBLOCK | O_CLOEXEC) == 0;
+}
+
+// 管道中残留数据时不能复用 直接关闭
+void releasePipe(int fds[2], bool empty) {
+    if (empty && t_pipePool.pipes.size() < kMaxCachedPipes) {
+        t_pipePool.pipes.emplace_back(fds[0], fds[1]);
+    } else {
+        ::close(fds[0]);
+        ::close(fds[1]);
+    }
+    fds[0] = fds[1] = -1;
+}
+}
+
 static EventLoop* CheckLoopNotNull(EventLoop* loop) 
 {
     if (loop == nullptr) {
@@ -22,77 +85,302 @@ TcpConnection::TcpConnection(EventLoop* loop, const std::string& name, int sockf
     , name_(name)
     , state_(kConnecting)
     , reading_(true)
+    , migrating_(false)
+    , attaching_(false)
     , socket_(new Socket(sockfd))
     , channel_(new Channel(loop, sockfd))
     , localAddr_(localAddr)
     , peerAddr_(peerAddr)
-    , highWaterMark_(64 * 1024 * 1024) {
+    , highWaterMark_(64 * 1024 * 1024)
+    , bytesReceived_(0)
+    , bytesSent_(0)
+    , messagesReceived_(0)
+    , messagesSent_(0)
+    , outputChunkBytes_(0)
+    , outputHeadStarted_(false)
+    , shrinkQueued_(false)
+    , readThrottled_(false)
+    , throttleId_(0)
+    , reportedMessages_(0)
+    , messagesReported_(false)
+    , zeroCopyThreshold_(0)
+    , zeroCopyNextId_(0)
+    , timestamping_(false)
+    , forwarding_(false)
+    , forwardEof_(false)
+    , forwardPending_(0) {
+    forwardPipe_[0] = forwardPipe_[1] = -1;
+    setupChannel();
+    LOG_FMT_INFO(g_logger, "TcpConnection::ctor[%s] at %p, fd: %d",
+        name_.c_str(), this, sockfd);
+    socket_->setKeepAlive(true);
+}
+
+void TcpConnection::setupChannel() {
     channel_->setReadCallback(std::bind(&TcpConnection::handleRead, this, std::placeholders::_1));
     channel_->setWriteCallback(std::bind(&TcpConnection::handleWrite, this));
     channel_->setCloseCallback(std::bind(&TcpConnection::handleClose, this));
     channel_->setErrorCallback(std::bind(&TcpConnection::handleError, this));
-    LOG_FMT_INFO(g_logger, "TcpConnection::ctor[%s] at %p, fd: %d",
-        name_.c_str(), this, sockfd);
-    socket_->setKeepAlive(true);
 }
 
 TcpConnection::~TcpConnection() {
     LOG_INFO(g_logger) << "TcpConnection::dtor[" << name_.c_str() << "] at " << this << ", fd: " << channel_->fd();
+    // 析构可能发生在其他线程 不能归还到事件循环的管道池
+    if (forwardPipe_[0] >= 0) {
+        ::close(forwardPipe_[0]);
+        ::close(forwardPipe_[1]);
+    }
 }
 
 void TcpConnection::send(const std::string& message) {
     if (state_ == kConnected) {
-        if (loop_->isInLoopThread()) {
+        if (getLoop()->isInLoopThread()) {
             sendInLoop(message.c_str(), message.size());
         } else {
-            loop_->runInLoop(std::bind(
-                &TcpConnection::sendInLoop,
-                this,
-                message.c_str(),
-                message.size()));
+            // 调用方的数据在回调执行前可能已经释放 需要拷贝一份 同时持有连接的引用
+            void (TcpConnection::*fp)(const std::string&) = &TcpConnection::sendInLoop;
+            getLoop()->runInLoop(std::bind(fp, shared_from_this(), message));
+        }
+    }
+}
+
+void TcpConnection::send(const SharedPayload& payload) {
+    if (state_ == kConnected) {
+        if (getLoop()->isInLoopThread()) {
+            sendInLoop(payload);
+        } else {
+            void (TcpConnection::*fp)(const SharedPayload&) = &TcpConnection::sendInLoop;
+            getLoop()->runInLoop(std::bind(fp, shared_from_this(), payload));
+        }
+    }
+}
+
+void TcpConnection::send(std::string&& message) {
+    if (useZeroCopy(message.size())) {
+        send(SharedPayload(std::make_shared<const std::string>(std::move(message))));
+    } else {
+        send(static_cast<const std::string&>(message));
+    }
+}
+
+bool TcpConnection::setZeroCopy(size_t threshold) {
+    if (!socket_->setZeroCopy(threshold > 0)) {
+        LOG_FMT_WARN(g_logger, "TcpConnection %s SO_ZEROCOPY not supported: %d", name_.c_str(), errno);
+        zeroCopyThreshold_ = 0;
+        return false;
+    }
+    zeroCopyThreshold_ = threshold;
+    return true;
+}
+
+void TcpConnection::sendPriority(const std::string& message) {
+    if (state_ == kConnected) {
+        if (getLoop()->isInLoopThread()) {
+            sendPriorityInLoop(message);
+        } else {
+            getLoop()->runInLoop(std::bind(&TcpConnection::sendPriorityInLoop, shared_from_this(), message));
+        }
+    }
+}
+
+bool TcpConnection::setLatencyMode(size_t lowat) {
+    if (!socket_->setNotSentLowat(static_cast<unsigned int>(lowat))) {
+        LOG_FMT_WARN(g_logger, "TcpConnection %s TCP_NOTSENT_LOWAT not supported: %d", name_.c_str(), errno);
+        return false;
+    }
+    return true;
+}
+
+bool TcpConnection::tcpInfo(TcpInfo* info) const {
+    // 使用内核头文件中的定义 glibc的tcp_info缺少tcpi_notsent_bytes等较新的字段
+    struct tcp_info ti;
+    ::memset(&ti, 0, sizeof(ti));
+    socklen_t len = sizeof(ti);
+    if (::getsockopt(channel_->fd(), IPPROTO_TCP, TCP_INFO, &ti, &len) < 0) {
+        return false;
+    }
+    info->rtt          = ti.tcpi_rtt;
+    info->rttVar       = ti.tcpi_rttvar;
+    info->retransmits  = ti.tcpi_retrans;
+    info->totalRetrans = ti.tcpi_total_retrans;
+    info->cwnd         = ti.tcpi_snd_cwnd;
+    info->unacked      = ti.tcpi_unacked;
+    info->notsentBytes = ti.tcpi_notsent_bytes;
+    return true;
+}
+
+bool TcpConnection::setTimestamping(bool on, const TxTimestampCallback& cb) {
+    if (!socket_->setTimestamping(on, on && cb)) {
+        LOG_FMT_WARN(g_logger, "TcpConnection %s SO_TIMESTAMPING not supported: %d", name_.c_str(), errno);
+        timestamping_ = false;
+        txTimestampCallback_ = TxTimestampCallback();
+        return false;
+    }
+    timestamping_        = on;
+    txTimestampCallback_ = on ? cb : TxTimestampCallback();
+    return true;
+}
+
+void TcpConnection::forwardTo(const TcpConnectionPtr& other) {
+    getLoop()->runInLoop(std::bind(&TcpConnection::forwardToInLoop, shared_from_this(), other));
+}
+
+bool TcpConnection::migrateTo(EventLoop* loop, const ConnectionCallback& cb) {
+    // 转发使用的管道属于当前线程 两端的连接也必须位于同一个事件循环
+    if (state_ != kConnected || loop == getLoop() || migrating_ || forwarding_ || forwardSource_.lock()) {
+        return false;
+    }
+
+    // 可能正处在连接的回调函数中 返回后handleEvent还会继续访问Channel和缓冲区
+    // 排队到本轮事件处理结束之后再切换
+    migrating_ = true;
+    getLoop()->queueInLoop(std::bind(&TcpConnection::migrateInLoop, shared_from_this(), loop, cb));
+    return true;
+}
+
+void TcpConnection::migrateInLoop(EventLoop* loop, const ConnectionCallback& cb) {
+    migrating_ = false;
+    // 排队期间连接关闭或者开始了转发 放弃迁移 连接仍然存活时在原事件循环中调用cb
+    if (state_ != kConnected || forwarding_ || forwardSource_.lock()) {
+        if (state_ != kDisconnected && cb) {
+            cb(self_);
         }
+        return;
+    }
+
+    // Channel绑定了事件循环 在原事件循环中移除后为目标事件循环创建新的Channel
+    bool reading = channel_->isReadEvent();
+    bool writing = channel_->isWriteEvent();
+    channel_->disableAll();
+    channel_->remove();
+    channel_.reset(new Channel(loop, socket_->fd()));
+    setupChannel();
+
+    // 先切换再投递注册事件的任务 注册完成之前在新事件循环中执行的操作由migratedAway重新排队
+    attaching_ = true;
+    loop_.store(loop, std::memory_order_release);
+    loop->queueInLoop(std::bind(&TcpConnection::attachInLoop, shared_from_this(), reading, writing, cb));
+}
+
+bool TcpConnection::migratedAway() const {
+    return !getLoop()->isInLoopThread() || attaching_;
+}
+
+void TcpConnection::attachInLoop(bool reading, bool writing, const ConnectionCallback& cb) {
+    attaching_ = false;
+    if (reading && state_ != kDisconnected) {
+        channel_->enableReading();
+    }
+    // 迁移前已经开启写事件 或者迁移期间有数据排队
+    if ((writing || pendingOutputBytes() > 0) && !channel_->isWriteEvent()) {
+        channel_->enableWriting();
+    }
+    // 恢复读取的定时器属于原事件循环 原事件循环退出后不会再触发 在新的事件循环中按剩余时间重新设置
+    if (readThrottled_) {
+        armResumeTimer(std::max(timeDifference(throttledUntil_, Timestamp::now()), 0.0));
+    }
+    if (cb) {
+        cb(self_);
     }
 }
 
 void TcpConnection::shutdown() {
     if (state_ == kConnected) {
         setState(kDisconnecting);
-        loop_->runInLoop(std::bind(&TcpConnection::shutdownInLoop, this));
+        getLoop()->runInLoop(std::bind(&TcpConnection::shutdownInLoop, shared_from_this()));
     }
 }
 
 void TcpConnection::connectEstablished() {
     setState(kConnected);
-    channel_->tie(shared_from_this());
+    // 由事件循环持有连接的引用 直到连接销毁时Channel从Poller中移除
+    // 因此处理事件时无需再通过tie提升弱引用
+    self_ = shared_from_this();
     channel_->enableReading();
 
-    connectionCallback_(shared_from_this());
+    connectionCallback_(self_);
 }
 
 void TcpConnection::connectDestoryed() {
+    stopForwarding();
+    if (!zeroCopyPending_.empty()) {
+        // 套接字关闭后内核可能仍在发送引用的内存页 延迟释放这些数据
+        std::shared_ptr<ZeroCopyList> pinned = std::make_shared<ZeroCopyList>();
+        pinned->swap(zeroCopyPending_);
+        getLoop()->runAfter(kZeroCopyLinger, [pinned] { });
+    }
     if (state_ == kConnected) {
         setState(kDisconnected);
         channel_->disableAll();
-        connectionCallback_(shared_from_this());
+        connectionCallback_(self_);
     }
     channel_->remove();
+    // 调用方持有连接的引用 此处释放不会导致连接立即析构
+    self_.reset();
 }
 
 void TcpConnection::forceClose() {
     if (state_ == kConnected || state_ == kDisconnecting) {
         setState(kDisconnecting);
-        loop_->queueInLoop(std::bind(&TcpConnection::forceCloseInLoop, shared_from_this()));
+        getLoop()->queueInLoop(std::bind(&TcpConnection::forceCloseInLoop, shared_from_this()));
+    }
+}
+
+// 缓冲区占用的内存过多而数据已经不多时需要缩减 数据仍然很多时缓冲区还在使用中
+static bool shouldShrink(const Buffer& buffer) {
+    return buffer.internalCapacity() > kShrinkCapacity && buffer.readableBytes() < kShrinkCapacity / 2;
+}
+
+void TcpConnection::shrinkBuffersWhenIdle() {
+    if (shrinkQueued_ || state_ == kDisconnected) {
+        return;
+    }
+    if (shouldShrink(inputBuffer_) || shouldShrink(outputBuffer_) || shouldShrink(priorityBuffer_)) {
+        shrinkQueued_ = true;
+        getLoop()->queueIdle(std::bind(&TcpConnection::shrinkBuffers, shared_from_this()));
+    }
+}
+
+void TcpConnection::shrinkBuffers() {
+    if (migratedAway()) {
+        getLoop()->queueIdle(std::bind(&TcpConnection::shrinkBuffers, shared_from_this()));
+        return;
+    }
+    shrinkQueued_ = false;
+
+    for (Buffer* buffer : { &inputBuffer_, &outputBuffer_, &priorityBuffer_ }) {
+        if (shouldShrink(*buffer)) {
+            buffer->shrink(Buffer::kInitialSize);
+        }
     }
 }
 
 void TcpConnection::handleRead(Timestamp receiveTime) {
+    if (forwarding_) {
+        handleForwardRead(receiveTime);
+        return;
+    }
+
     int saveErrno = 0;
 
-    ssize_t n = inputBuffer_.readFd(channel_->fd(), saveErrno);
+    // 开启时间戳后以内核记录的接收时间代替epoll_wait返回的时间
+    ssize_t n = timestamping_ ? inputBuffer_.readFd(channel_->fd(), saveErrno, &receiveTime)
+                              : inputBuffer_.readFd(channel_->fd(), saveErrno);
 
     if (n > 0) {
+        bytesReceived_ += n;
         // 已建立连接的用户 有可读事件发送 调用用户传入的MessageCallback
-        messageCallback_(shared_from_this(), &inputBuffer_, receiveTime);
+        // 未设置回调时数据保留在输入缓冲区中 例如等待协程接管连接
+        size_t messages = 0;
+        if (messageCallback_) {
+            ++messagesReceived_;
+            reportedMessages_ = 0;
+            messagesReported_ = false;
+            messageCallback_(self_, &inputBuffer_, receiveTime);
+            messages = messagesReported_ ? reportedMessages_ : 1;
+        }
+        throttleRead(n, messages);
+        shrinkBuffersWhenIdle();
     } else if (n == 0) {
         handleClose();
     } else {
@@ -102,33 +390,101 @@ void TcpConnection::handleRead(Timestamp receiveTime) {
     }
 }
 
+void TcpConnection::setRateLimit(const RateLimit& limit, const std::shared_ptr<RateLimiter>& peerLimiter) {
+    rateLimiter_.reset(limit.enabled() ? new RateLimiter(limit) : nullptr);
+    peerRateLimiter_ = peerLimiter;
+}
+
+void TcpConnection::throttleRead(size_t bytes, size_t messages) {
+    if (!rateLimiter_ && !peerRateLimiter_) {
+        return;
+    }
+
+    Timestamp now   = getLoop()->pollReturnTime();
+    double    delay = 0;
+    if (rateLimiter_) {
+        delay = rateLimiter_->consume(bytes, messages, now);
+    }
+    if (peerRateLimiter_) {
+        delay = std::max(delay, peerRateLimiter_->consume(bytes, messages, now));
+    }
+    if (delay <= 0 || readThrottled_ || state_ == kDisconnected || !channel_->isReadEvent()) {
+        return;
+    }
+
+    // 停止关注读事件 数据留在内核中 接收窗口缩小后对端自然放慢
+    readThrottled_  = true;
+    throttledUntil_ = addTime(now, delay);
+    channel_->disableReading();
+    armResumeTimer(delay);
+}
+
+void TcpConnection::armResumeTimer(double delay) {
+    // 限速很低时等待时间可能很长 定时器不延长连接的生命周期
+    // 每次设置定时器都更新序号 迁移之前设置在原事件循环中的定时器触发时被忽略
+    uint64_t                     id = ++throttleId_;
+    std::weak_ptr<TcpConnection> weak(shared_from_this());
+    getLoop()->runAfter(delay, [weak, id]() {
+        TcpConnectionPtr conn = weak.lock();
+        if (conn) {
+            conn->resumeRead(id);
+        }
+    });
+}
+
+void TcpConnection::resumeRead(uint64_t id) {
+    if (migratedAway()) {
+        getLoop()->queueInLoop(std::bind(&TcpConnection::resumeRead, shared_from_this(), id));
+        return;
+    }
+    if (!readThrottled_ || id != throttleId_) {
+        return;
+    }
+    readThrottled_ = false;
+
+    // 暂停期间开始了转发且管道尚未排空时 由转发流程恢复读取
+    if (state_ == kDisconnected || (forwarding_ && forwardPending_ > 0)) {
+        return;
+    }
+    if (!channel_->isReadEvent()) {
+        channel_->enableReading();
+    }
+}
+
 void TcpConnection::handleWrite() 
 {
     if (channel_->isWriteEvent()) {
-        int saveErrno = 0;
+        if (pendingOutputBytes() > 0) 
+        {
+            int saveErrno = 0;
 
-        ssize_t n = outputBuffer_.writeFd(channel_->fd(), saveErrno);
+            ssize_t n = flushOutput(saveErrno);
 
-        if (n > 0) 
-        {
-            outputBuffer_.retrieve(n);
-            if (outputBuffer_.readableBytes() == 0) 
+            if (n <= 0) 
             {
-                channel_->disableWriting();
-                if (writeCompleteCallback_) 
-                {
-                    loop_->queueInLoop(std::bind(
-                        writeCompleteCallback_, shared_from_this()));
-                }
-                if (state_ == kDisconnecting) {
-                    shutdownInLoop();
-                }
+                LOG_FMT_ERROR(g_logger, "TcpConnection %p write error: %d",
+                    this, saveErrno);
+                return;
             }
-        } 
-        else 
+            if (pendingOutputBytes() > 0) {
+                return;
+            }
+        }
+
+        // 输出缓冲区排空后再写入转发过来的数据 保证数据的顺序
+        if (!drainForwardSource()) {
+            return;
+        }
+
+        channel_->disableWriting();
+        shrinkBuffersWhenIdle();
+        if (writeCompleteCallback_) 
         {
-            LOG_FMT_ERROR(g_logger, "TcpConnection %p write error: %d",
-                this, saveErrno);
+            getLoop()->queueInLoop(std::bind(
+                writeCompleteCallback_, shared_from_this()));
+        }
+        if (state_ == kDisconnecting) {
+            shutdownInLoop();
         }
     } else {
         LOG_FMT_ERROR(g_logger, "Connection fd: %d is down, no more writing",
@@ -140,8 +496,16 @@ void TcpConnection::handleClose() {
     LOG_INFO(g_logger) << "fd: " << channel_->fd() << ", state: " << state_ << " need close";
     setState(kDisconnected);
     channel_->disableAll();
+    stopForwarding();
+
+    // 关闭回调可能会导致连接被销毁 需要持有一份引用
+    TcpConnectionPtr connPtr(self_);
 
-    TcpConnectionPtr connPtr(shared_from_this());
+    TcpConnectionPtr source = forwardSource_.lock();
+    if (source) {
+        forwardSource_.reset();
+        source->forwardTargetClosed();
+    }
     if (connectionCallback_) {
         connectionCallback_(connPtr);
     }
@@ -151,6 +515,9 @@ void TcpConnection::handleClose() {
 }
 
 void TcpConnection::handleError() {
+    // 零拷贝的完成通知和发送时间戳同样以EPOLLERR的形式到达 此时套接字上并没有错误
+    int reaped = expectErrorQueue() ? reapErrorQueue() : 0;
+
     int       optval;
     socklen_t optlen = sizeof(optval);
     int       err    = 0;
@@ -159,11 +526,116 @@ void TcpConnection::handleError() {
     } else {
         err = optval;
     }
+    if (reaped > 0 && err == 0) {
+        return;
+    }
     LOG_FMT_ERROR(g_logger, "TcpConnection::handleError name: %s - error: %d",
         name_.c_str(), err);
 }
 
+int TcpConnection::reapErrorQueue() {
+    int reaped = 0;
+    for (;;) {
+        char   control[256];
+        msghdr msg;
+        ::memset(&msg, 0, sizeof(msg));
+        msg.msg_control    = control;
+        msg.msg_controllen = sizeof(control);
+        if (::recvmsg(channel_->fd(), &msg, MSG_ERRQUEUE) < 0) {
+            break;
+        }
+        ++reaped;
+
+        // 发送时间戳由一个SCM_TIMESTAMPING和一个携带序号的IP_RECVERR组成 两者的先后顺序不固定
+        Timestamp                sendTime;
+        const sock_extended_err* tstamp = nullptr;
+        for (cmsghdr* cm = CMSG_FIRSTHDR(&msg); cm != nullptr; cm = CMSG_NXTHDR(&msg, cm)) {
+            if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_TIMESTAMPING) {
+                scm_timestamping tss;
+                ::memcpy(&tss, CMSG_DATA(cm), sizeof(tss));
+                sendTime = Timestamp(static_cast<int64_t>(tss.ts[0].tv_sec) * Timestamp::kMicroSecondsPerSecond
+                                     + tss.ts[0].tv_nsec / 1000);
+                continue;
+            }
+            if (!(cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR)
+                && !(cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR)) {
+                continue;
+            }
+            const sock_extended_err* serr = reinterpret_cast<const sock_extended_err*>(CMSG_DATA(cm));
+            if (serr->ee_origin == SO_EE_ORIGIN_TIMESTAMPING) {
+                tstamp = serr;
+                continue;
+            }
+            if (serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+                continue;
+            }
+
+            // 通知表示序号在[lo, hi]之间的发送已经完成 完成的顺序不一定与发送顺序一致
+            uint32_t lo = serr->ee_info, hi = serr->ee_data;
+            zeroCopyPending_.erase(std::remove_if(zeroCopyPending_.begin(), zeroCopyPending_.end(),
+                                       [lo, hi](const ZeroCopyList::value_type& item) {
+                                           return item.first - lo <= hi - lo;
+                                       }),
+                zeroCopyPending_.end());
+
+            if ((serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) && zeroCopyThreshold_ > 0) {
+                // 内核已经回退为拷贝 继续使用零拷贝只会增加额外的通知开销
+                LOG_FMT_INFO(g_logger, "TcpConnection %s zerocopy fell back to copy, disabled", name_.c_str());
+                zeroCopyThreshold_ = 0;
+            }
+        }
+
+        if (tstamp != nullptr && tstamp->ee_info == SCM_TSTAMP_SND && sendTime.valid() && txTimestampCallback_) {
+            txTimestampCallback_(self_, tstamp->ee_data, sendTime);
+        }
+    }
+    return reaped;
+}
+
+void TcpConnection::sendInLoop(const std::string& message) {
+    if (migratedAway()) {
+        void (TcpConnection::*fp)(const std::string&) = &TcpConnection::sendInLoop;
+        getLoop()->queueInLoop(std::bind(fp, shared_from_this(), message));
+        return;
+    }
+    sendInLoop(message.data(), message.size());
+}
+
+void TcpConnection::sendInLoop(const SharedPayload& payload) {
+    if (migratedAway()) {
+        void (TcpConnection::*fp)(const SharedPayload&) = &TcpConnection::sendInLoop;
+        getLoop()->queueInLoop(std::bind(fp, shared_from_this(), payload));
+        return;
+    }
+    sendInLoop(payload->data(), payload->size(), payload);
+}
+
+void TcpConnection::sendPriorityInLoop(const std::string& message) {
+    if (migratedAway()) {
+        getLoop()->queueInLoop(std::bind(&TcpConnection::sendPriorityInLoop, shared_from_this(), message));
+        return;
+    }
+    // 没有排队的数据时与普通消息相同
+    if (!channel_->isWriteEvent() && pendingOutputBytes() == 0) {
+        sendInLoop(message.data(), message.size());
+        return;
+    }
+    if (state_ == kDisconnected) {
+        LOG_ERROR(g_logger) << "disconnected, give up writing";
+        return;
+    }
+    ++messagesSent_;
+    priorityBuffer_.append(message.data(), message.size());
+    if (!channel_->isWriteEvent()) {
+        channel_->enableWriting();
+    }
+}
+
 void TcpConnection::sendInLoop(const void* message, size_t len) {
+    sendInLoop(static_cast<const char*>(message), len, SharedPayload());
+}
+
+void TcpConnection::sendInLoop(const char* data, size_t len, const SharedPayload& payload) {
     ssize_t nwrote = 0, remaining = len;
     bool    faultError = false;
 
@@ -171,18 +643,31 @@ void TcpConnection::sendInLoop(const void* message, size_t len) {
         LOG_ERROR(g_logger) << "disconnected, give up writing";
         return;
     }
+    ++messagesSent_;
 
     // 如果是第一次发送数据
-    if (!channel_->isWriteEvent() && outputBuffer_.readableBytes() == 0) 
+    if (!channel_->isWriteEvent() && pendingOutputBytes() == 0) 
     {
-        nwrote = ::write(channel_->fd(), message, len);
+        if (payload && useZeroCopy(len)) {
+            nwrote = ::send(channel_->fd(), data, len, MSG_ZEROCOPY);
+            if (nwrote >= 0) {
+                pinZeroCopy(payload);
+                ++zeroCopyNextId_;
+            } else if (errno == ENOBUFS) {
+                // 超出了内核为零拷贝分配的内存上限 本次以普通方式发送
+                nwrote = ::write(channel_->fd(), data, len);
+            }
+        } else {
+            nwrote = ::write(channel_->fd(), data, len);
+        }
         if (nwrote >= 0) 
         {
+            bytesSent_ += nwrote;
             // 计算未发送的字节数
             remaining = len - nwrote;
             // 如果数据全部发送完成 则调用消息发送完成的回调函数
             if (remaining == 0 && writeCompleteCallback_) {
-                loop_->queueInLoop(std::bind(
+                getLoop()->queueInLoop(std::bind(
                     writeCompleteCallback_, shared_from_this()));
             }
         } 
@@ -202,26 +687,306 @@ void TcpConnection::sendInLoop(const void* message, size_t len) {
 
     // 如果连接正常 并且数据并未发送完成
     if (!faultError && remaining > 0) {
-        // 计算输出缓冲区中旧数据的长度
-        size_t oldLen = outputBuffer_.readableBytes();
+        // 计算等待发送的旧数据的长度
+        size_t oldLen = pendingOutputBytes();
         // 如果旧的数据和未发送数据的长度之和大于高水位标记 则调用高水位回调
         if (oldLen + remaining >= highWaterMark_
             && oldLen < highWaterMark_
             && highWaterMarkCallback_) {
-            loop_->queueInLoop(std::bind(
+            getLoop()->queueInLoop(std::bind(
                 highWaterMarkCallback_,
                 shared_from_this(),
                 oldLen + remaining));
         }
-        // 将未发送的数据添加到输出缓冲区中 等待下一次EPLLOUT事件的到来 再进行发送
-        outputBuffer_.append(static_cast<const char*>(message) + nwrote, remaining);
+        // 将未发送的数据排入输出队列 等待下一次EPLLOUT事件的到来 再进行发送
+        // 共享数据只保存引用 共享数据队列不为空时普通数据也需要排在其后以保证顺序
+        if (payload) {
+            outputChunks_.push_back(OutputChunk { payload, static_cast<size_t>(nwrote) });
+            outputChunkBytes_ += remaining;
+        } else if (!outputChunks_.empty()) {
+            outputChunks_.push_back(OutputChunk { std::make_shared<const std::string>(data + nwrote, remaining), 0 });
+            outputChunkBytes_ += remaining;
+        } else {
+            outputBuffer_.append(data + nwrote, remaining);
+        }
+        outputMessages_.push_back(remaining);
+        if (nwrote > 0) {
+            outputHeadStarted_ = true;
+        }
         if (!channel_->isWriteEvent()) {
             channel_->enableWriting();
         }
     }
 }
 
+ssize_t TcpConnection::flushOutput(int& saveErrno) {
+    if (priorityBuffer_.readableBytes() == 0) {
+        return writeOutput(saveErrno, pendingOutputBytes());
+    }
+    // 优先消息不能打断正在发送的消息 先写完该消息的剩余部分
+    if (outputHeadStarted_) {
+        return writeOutput(saveErrno, outputMessages_.front());
+    }
+    ssize_t n = priorityBuffer_.writeFd(channel_->fd(), saveErrno);
+    if (n > 0) {
+        priorityBuffer_.retrieve(n);
+        bytesSent_ += n;
+    }
+    return n;
+}
+
+ssize_t TcpConnection::writeOutput(int& saveErrno, size_t limit) {
+    if (outputChunks_.empty()) {
+        ssize_t n = ::write(channel_->fd(), outputBuffer_.peek(), std::min(limit, outputBuffer_.readableBytes()));
+        if (n < 0) {
+            saveErrno = errno;
+        } else if (n > 0) {
+            outputBuffer_.retrieve(n);
+            bytesSent_ += n;
+            retireOutputMessages(n);
+        }
+        return n;
+    }
+
+    struct iovec vec[kMaxIovecs];
+    int          count = 0;
+    if (outputBuffer_.readableBytes() > 0) {
+        vec[count].iov_base = const_cast<char*>(outputBuffer_.peek());
+        vec[count].iov_len  = outputBuffer_.readableBytes();
+        ++count;
+    }
+    for (auto it = outputChunks_.begin(); it != outputChunks_.end() && count < kMaxIovecs; ++it, ++count) {
+        vec[count].iov_base = const_cast<char*>(it->data->data() + it->offset);
+        vec[count].iov_len  = it->data->size() - it->offset;
+    }
+    // 截断到limit字节
+    size_t total = 0;
+    for (int i = 0; i < count; ++i) {
+        if (total + vec[i].iov_len >= limit) {
+            vec[i].iov_len = limit - total;
+            count          = i + 1;
+            break;
+        }
+        total += vec[i].iov_len;
+    }
+
+    // 只有全部是共享数据时才能零拷贝发送 输出缓冲区的内存在发送之后会被复用
+    bool    zeroCopy = outputBuffer_.readableBytes() == 0 && useZeroCopy(outputChunkBytes_);
+    ssize_t n        = -1;
+    if (zeroCopy) {
+        msghdr msg;
+        ::memset(&msg, 0, sizeof(msg));
+        msg.msg_iov    = vec;
+        msg.msg_iovlen = count;
+        n              = ::sendmsg(channel_->fd(), &msg, MSG_ZEROCOPY);
+        zeroCopy       = n >= 0 || errno != ENOBUFS;
+    }
+    if (!zeroCopy) {
+        n = ::writev(channel_->fd(), vec, count);
+    }
+    if (n < 0) {
+        saveErrno = errno;
+        return n;
+    }
+    bytesSent_ += n;
+    retireOutputMessages(n);
+    if (zeroCopy) {
+        // 本次发送涉及的数据都需要保留到内核完成通知
+        size_t bytes = 0;
+        for (auto it = outputChunks_.begin(); it != outputChunks_.end() && bytes < static_cast<size_t>(n); ++it) {
+            bytes += it->data->size() - it->offset;
+            pinZeroCopy(it->data);
+        }
+        ++zeroCopyNextId_;
+    }
+
+    // 依次从输出缓冲区和共享数据队列中移除已经写出的数据
+    size_t left       = static_cast<size_t>(n);
+    size_t fromBuffer = std::min(left, outputBuffer_.readableBytes());
+    outputBuffer_.retrieve(fromBuffer);
+    left -= fromBuffer;
+    while (left > 0) {
+        OutputChunk& chunk = outputChunks_.front();
+        size_t       avail = chunk.data->size() - chunk.offset;
+        if (left < avail) {
+            chunk.offset += left;
+            outputChunkBytes_ -= left;
+            break;
+        }
+        left -= avail;
+        outputChunkBytes_ -= avail;
+        outputChunks_.pop_front();
+    }
+    return n;
+}
+
+void TcpConnection::retireOutputMessages(size_t n) {
+    while (n > 0 && !outputMessages_.empty()) {
+        if (n < outputMessages_.front()) {
+            outputMessages_.front() -= n;
+            outputHeadStarted_ = true;
+            return;
+        }
+        n -= outputMessages_.front();
+        outputMessages_.pop_front();
+        outputHeadStarted_ = false;
+    }
+}
+
+void TcpConnection::forwardToInLoop(const TcpConnectionPtr& other) {
+    if (migratedAway()) {
+        getLoop()->queueInLoop(std::bind(&TcpConnection::forwardToInLoop, shared_from_this(), other));
+        return;
+    }
+
+    if (other->getLoop() != getLoop()) {
+        LOG_FMT_ERROR(g_logger, "TcpConnection %s cannot forward to %s in another EventLoop",
+            name_.c_str(), other->name().c_str());
+        return;
+    }
+    if (state_ != kConnected || !other->connected()) {
+        return;
+    }
+
+    stopForwarding();
+    if (!acquirePipe(forwardPipe_)) {
+        LOG_FMT_ERROR(g_logger, "TcpConnection %s create pipe error: %d", name_.c_str(), errno);
+        return;
+    }
+    forwarding_           = true;
+    forwardTarget_        = other;
+    other->forwardSource_ = self_;
+
+    // 开始转发之前已经读入输入缓冲区的数据先交给目标连接
+    if (inputBuffer_.readableBytes() > 0) {
+        other->sendInLoop(inputBuffer_.peek(), inputBuffer_.readableBytes());
+        inputBuffer_.retrieveAll();
+    }
+}
+
+void TcpConnection::handleForwardRead(Timestamp receiveTime) {
+    TcpConnectionPtr target = forwardTarget_.lock();
+    if (!target || !target->connected()) {
+        stopForwarding();
+        handleRead(receiveTime);
+        return;
+    }
+
+    ssize_t n = ::splice(channel_->fd(), nullptr, forwardPipe_[1], nullptr,
+        kForwardChunk, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (n > 0) {
+        bytesReceived_ += n;
+        forwardPending_ += n;
+        // 目标连接暂时无法写入 停止读取直到管道排空
+        if (!drainForwardPipe(target)) {
+            channel_->disableReading();
+        }
+    } else if (n == 0) {
+        channel_->disableReading();
+        forwardEof_ = true;
+        if (forwardPending_ == 0) {
+            resumeForwardRead();
+        }
+    } else if (errno != EAGAIN) {
+        LOG_FMT_ERROR(g_logger, "TcpConnection %p splice error: %d", this, errno);
+        handleError();
+    }
+}
+
+bool TcpConnection::drainForwardPipe(const TcpConnectionPtr& target) {
+    // 目标连接输出缓冲区中的数据需要先发出 由目标连接的写事件继续排空管道
+    if (target->pendingOutputBytes() > 0) {
+        return false;
+    }
+
+    while (forwardPending_ > 0) {
+        ssize_t n = ::splice(forwardPipe_[0], nullptr, target->channel_->fd(), nullptr,
+            forwardPending_, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (n > 0) {
+            forwardPending_ -= n;
+            target->bytesSent_ += n;
+        } else if (n < 0 && errno == EAGAIN) {
+            if (!target->channel_->isWriteEvent()) {
+                target->channel_->enableWriting();
+            }
+            return false;
+        } else {
+            // 目标连接异常 由其自身的关闭事件通知本连接停止转发
+            LOG_FMT_ERROR(g_logger, "TcpConnection %p forward to %s error: %d",
+                this, target->name().c_str(), errno);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool TcpConnection::drainForwardSource() {
+    TcpConnectionPtr source = forwardSource_.lock();
+    if (!source || !source->forwarding_) {
+        return true;
+    }
+    if (!source->drainForwardPipe(self_)) {
+        return false;
+    }
+    source->resumeForwardRead();
+    return true;
+}
+
+void TcpConnection::resumeForwardRead() {
+    if (!forwardEof_) {
+        if (!channel_->isReadEvent()) {
+            channel_->enableReading();
+        }
+        return;
+    }
+
+    // 对端的数据已经全部转发 关闭目标连接的写端并关闭本连接
+    TcpConnectionPtr target = forwardTarget_.lock();
+    stopForwarding();
+    if (target) {
+        target->shutdown();
+    }
+    handleClose();
+}
+
+void TcpConnection::forwardTargetClosed() {
+    bool eof = forwardEof_;
+    stopForwarding();
+    if (eof) {
+        handleClose();
+    } else if (state_ == kConnected && !readThrottled_ && !channel_->isReadEvent()) {
+        channel_->enableReading();
+    }
+}
+
+void TcpConnection::stopForwarding() {
+    if (!forwarding_) {
+        return;
+    }
+    if (forwardPending_ > 0) {
+        LOG_FMT_WARN(g_logger, "TcpConnection %s stop forwarding with %zu bytes dropped",
+            name_.c_str(), forwardPending_);
+    }
+    releasePipe(forwardPipe_, forwardPending_ == 0);
+    forwarding_     = false;
+    forwardEof_     = false;
+    forwardPending_ = 0;
+
+    // 解除目标连接对本连接的引用 否则改为转发给其他连接后 原目标连接关闭时会停止新的转发
+    // 原目标连接也会继续排空本连接的管道 并且无法迁移
+    TcpConnectionPtr target = forwardTarget_.lock();
+    if (target && target->forwardSource_.lock().get() == this) {
+        target->forwardSource_.reset();
+    }
+    forwardTarget_.reset();
+}
+
 void TcpConnection::shutdownInLoop() {
+    if (migratedAway()) {
+        getLoop()->queueInLoop(std::bind(&TcpConnection::shutdownInLoop, shared_from_this()));
+        return;
+    }
+
     if (!channel_->isWriteEvent()) {
         // 说明输出缓冲区的数据已经发送完成
         socket_->shutdownWrite();
@@ -229,6 +994,11 @@ void TcpConnection::shutdownInLoop() {
 }
 
 void TcpConnection::forceCloseInLoop() {
+    if (migratedAway()) {
+        getLoop()->queueInLoop(std::bind(&TcpConnection::forceCloseInLoop, shared_from_this()));
+        return;
+    }
+
     if (state_ == kConnected || state_ == kDisconnecting) {
         handleClose();
     }
@@ -1,9 +1,19 @@
 #include "tcpserver.h"
 #include "log.h"
+#include <algorithm>
+#include <cmath>
 #include <functional>
+#include <sstream>
 #include <strings.h>
 using namespace apollo;
 
+namespace
+{
+const double kEvacuateInterval = 0.1;  // 移除SubLoop时重试迁移的间隔 单位为秒
+const double kEvacuateTimeout  = 30.0; // 等待无法迁移的连接自行关闭的最长时间 单位为秒
+const int    kScaleCooldown    = 3;    // 自动调整之后暂停调整的检查次数
+}
+
 static EventLoop* CheckLoopNotNull(EventLoop* loop) {
     if (loop == nullptr) {
         LOG_FATAL(g_logger) << "loop is null!";
@@ -21,14 +31,115 @@ TcpServer::TcpServer(EventLoop* loop, const InetAddress& localAddr,
     , connectionCallback_()
     , messageCallback_()
     , started_(false)
-    , nextConnId_(1) {
+    , nextConnId_(1)
+    , tcpInfoInterval_(0)
+    , rebalanceInterval_(0)
+    , rebalanceThreshold_(0.2)
+    , minThreads_(1)
+    , maxThreads_(0)
+    , scaleUpLoad_(0.75)
+    , scaleDownLoad_(0.3)
+    , scaleCooldown_(0)
+    , retiring_(0)
+    , draining_(false)
+    , alive_(std::make_shared<bool>(true)) {
     accepter_->setNewConnectionCallback(std::bind(
         &TcpServer::newConnection, this,
         std::placeholders::_1,
         std::placeholders::_2));
 }
 
+/**
+ * @brief 获取套接字绑定的本地地址
+ *
+ * @param sockfd
+ */
+static InetAddress getLocalAddr(int sockfd) {
+    sockaddr_in local;
+    ::bzero(&local, sizeof(local));
+    socklen_t addrlen = sizeof(local);
+    if (::getsockname(sockfd, reinterpret_cast<sockaddr*>(&local), &addrlen) < 0) {
+        LOG_FMT_ERROR(g_logger, "get socket name error: %d", errno);
+    }
+    return InetAddress(local);
+}
+
+TcpServer::TcpServer(EventLoop* loop, int listenfd, const std::string& name)
+    : loop_(CheckLoopNotNull(loop))
+    , ipPort_(getLocalAddr(listenfd).toIpPort())
+    , name_(name)
+    , accepter_(new Accepter(loop, listenfd))
+    , threadPool_(new EventLoopThreadPool(loop_, name_))
+    , connectionCallback_()
+    , messageCallback_()
+    , started_(false)
+    , nextConnId_(1)
+    , tcpInfoInterval_(0)
+    , rebalanceInterval_(0)
+    , rebalanceThreshold_(0.2)
+    , minThreads_(1)
+    , maxThreads_(0)
+    , scaleUpLoad_(0.75)
+    , scaleDownLoad_(0.3)
+    , scaleCooldown_(0)
+    , retiring_(0)
+    , draining_(false)
+    , alive_(std::make_shared<bool>(true)) {
+    accepter_->setNewConnectionCallback(std::bind(
+        &TcpServer::newConnection, this,
+        std::placeholders::_1,
+        std::placeholders::_2));
+}
+
+void TcpInfoStats::merge(const TcpInfoStats& other) {
+    rtt.merge(other.rtt);
+    rttVar.merge(other.rttVar);
+    retransmits.merge(other.retransmits);
+    cwnd.merge(other.cwnd);
+    unacked.merge(other.unacked);
+    notsentBytes.merge(other.notsentBytes);
+}
+
+void TcpInfoStats::reset() {
+    rtt.reset();
+    rttVar.reset();
+    retransmits.reset();
+    cwnd.reset();
+    unacked.reset();
+    notsentBytes.reset();
+}
+
+std::string TcpInfoStats::toString() const {
+    std::ostringstream os;
+    os << "rtt(us):       " << rtt.toString() << "\n"
+       << "rttvar(us):    " << rttVar.toString() << "\n"
+       << "retransmits:   " << retransmits.toString() << "\n"
+       << "cwnd:          " << cwnd.toString() << "\n"
+       << "unacked:       " << unacked.toString() << "\n"
+       << "notsent bytes: " << notsentBytes.toString() << "\n";
+    return os.str();
+}
+
 TcpServer::~TcpServer() {
+    // 在MainLoop中析构 MainLoop上的定时器直接取消
+    if (loadTrackers_) {
+        loop_->cancel(rebalanceTimer_);
+    }
+    if (draining_) {
+        loop_->cancel(drainTimer_);
+    }
+    // 释放alive_之后在每个SubLoop(包括已停止的)中同步执行一次 正在执行的定时任务都已结束
+    // 之后到期的任务不再访问服务器
+    alive_.reset();
+    if (loopConnections_) {
+        loopConnections_->forEach([this](EventLoop* loop, ConnectionSet&) {
+            runInLoopAsync(loop, [this, loop]() {
+                if (tcpInfoSamplers_) {
+                    loop->cancel(tcpInfoSamplers_->get().timer);
+                }
+            }).wait();
+        });
+    }
     for (auto& item : connections_) {
         TcpConnectionPtr conn(item.second);
         item.second.reset();
@@ -47,6 +158,20 @@ void TcpServer::start()
         started_ = true;
         // 启动线程池
         threadPool_->start(threadInitCallback_);
+        loopConnections_.reset(new LoopLocal<ConnectionSet>(*threadPool_));
+        if (tcpInfoInterval_ > 0) {
+            tcpInfoSamplers_.reset(new LoopLocal<TcpInfoSampler>(*threadPool_, [this](EventLoop* loop) {
+                std::unique_ptr<TcpInfoSampler> sampler(new TcpInfoSampler());
+                sampler->timer = loop->runEvery(tcpInfoInterval_, guard(std::bind(&TcpServer::sampleTcpInfoInLoop, this)));
+                return sampler;
+            }));
+        }
+        if (rebalanceInterval_ > 0) {
+            loadTrackers_.reset(new LoopLocal<LoadTracker>(*threadPool_));
+            // 第一次检查时还没有上一次的统计 负载都为0
+            scaleCooldown_ = 1;
+            rebalanceTimer_ = loop_->runEvery(rebalanceInterval_, std::bind(&TcpServer::rebalance, this));
+        }
         // 开启MainLoop上的监听客户端事件
         loop_->runInLoop(std::bind(&Accepter::listen, accepter_.get()));
     }
@@ -65,13 +190,7 @@ void TcpServer::newConnection(int sockfd, const InetAddress& peerAddr)
     LOG_FMT_INFO(g_logger, "server[%s] - client[%s] from %s established",
         name_.c_str(), connName.c_str(), peerAddr.toIpPort().c_str());
 
-    sockaddr_in local;
-    ::bzero(&local, sizeof(local));
-    socklen_t addrlen = sizeof(local);
-    if (::getsockname(sockfd, reinterpret_cast<sockaddr*>(&local), &addrlen) < 0) {
-        LOG_FMT_ERROR(g_logger, "get socket name error: %d", errno);
-    }
-    InetAddress localAddr(local);
+    InetAddress localAddr(getLocalAddr(sockfd));
 
     // 根据连接的sockfd 创建TcpConnection对象
     TcpConnectionPtr conn(new TcpConnection(ioLoop, connName,
@@ -83,8 +202,12 @@ void TcpServer::newConnection(int sockfd, const InetAddress& peerAddr)
     conn->setWriteCompleteCallback(writeCompleteCallback_);
     conn->setCloseCallback(std::bind(&TcpServer::removeConnection,
         this, std::placeholders::_1));
+    if (connectionRateLimit_.enabled() || peerRateLimiter_) {
+        conn->setRateLimit(connectionRateLimit_,
+            peerRateLimiter_ ? peerRateLimiter_->acquire(peerAddr) : nullptr);
+    }
 
-    ioLoop->runInLoop(std::bind(&TcpConnection::connectEstablished, conn));
+    ioLoop->runInLoop(std::bind(&TcpServer::connectEstablishedInLoop, this, conn));
 }
 
 void TcpServer::removeConnection(const TcpConnectionPtr& conn) {
@@ -97,5 +220,353 @@ void TcpServer::removeConnectionInLoop(const TcpConnectionPtr& conn) {
 
     connections_.erase(conn->name());
     EventLoop* ioLoop = conn->getLoop();
-    ioLoop->queueInLoop(std::bind(&TcpConnection::connectDestoryed, conn));
+    ioLoop->queueInLoop(std::bind(&TcpServer::connectDestroyedInLoop, this, conn));
+
+    if (draining_ && connections_.empty()) {
+        draining_ = false;
+        loop_->cancel(drainTimer_);
+        LOG_FMT_INFO(g_logger, "server[%s] - drained", name_.c_str());
+        // 在连接销毁之后再通知调用方
+        loop_->queueInLoop(std::move(drainCallback_));
+        drainCallback_ = DrainCallback();
+    }
+}
+
+void TcpServer::connectEstablishedInLoop(const TcpConnectionPtr& conn) {
+    loopConnections_->get().insert(conn);
+    conn->connectEstablished();
+}
+
+void TcpServer::connectDestroyedInLoop(const TcpConnectionPtr& conn) {
+    loopConnections_->get().erase(conn);
+    if (tcpInfoSamplers_) {
+        tcpInfoSamplers_->get().totalRetrans.erase(conn.get());
+    }
+    conn->connectDestoryed();
+}
+
+void TcpServer::broadcast(const std::string& message) {
+    broadcast(std::make_shared<const std::string>(message));
+}
+
+void TcpServer::broadcast(const SharedPayload& payload) {
+    for (EventLoop* loop : threadPool_->getAllLoop()) {
+        loop->runInLoop(std::bind(&TcpServer::broadcastInLoop, this, payload));
+    }
+}
+
+void TcpServer::broadcastInLoop(const SharedPayload& payload) {
+    for (const TcpConnectionPtr& conn : loopConnections_->get()) {
+        conn->send(payload);
+    }
+}
+
+Future<TcpInfoStats> TcpServer::tcpInfoStats(bool reset) {
+    if (!tcpInfoSamplers_) {
+        return makeReadyFuture(TcpInfoStats());
+    }
+
+    std::vector<Future<TcpInfoStats>> futures;
+    for (EventLoop* loop : threadPool_->getAllLoop()) {
+        futures.push_back(runInLoopAsync(loop, std::bind(&TcpServer::collectTcpInfoInLoop, this, reset)));
+    }
+    return whenAll(futures).then(nullptr, [](const std::vector<TcpInfoStats>& all) {
+        TcpInfoStats merged;
+        for (const TcpInfoStats& stats : all) {
+            merged.merge(stats);
+        }
+        return merged;
+    });
+}
+
+void TcpServer::migrate(const TcpConnectionPtr& conn, EventLoop* loop) {
+    conn->getLoop()->runInLoop(std::bind(&TcpServer::migrateInLoop, this, conn, loop));
+}
+
+void TcpServer::migrateInLoop(const TcpConnectionPtr& conn, EventLoop* loop) {
+    // 任务投递之后连接可能已经迁移或者关闭
+    if (conn->getLoop() != EventLoop::getEventLoopOfCurrentThread()) {
+        migrate(conn, loop);
+        return;
+    }
+    ConnectionSet& connections = loopConnections_->get();
+    if (connections.find(conn) == connections.end()) {
+        return;
+    }
+
+    uint32_t totalRetrans = 0;
+    if (tcpInfoSamplers_) {
+        auto& retrans = tcpInfoSamplers_->get().totalRetrans;
+        auto  it      = retrans.find(conn.get());
+        if (it != retrans.end()) {
+            totalRetrans = it->second;
+            retrans.erase(it);
+        }
+    }
+    EventLoop* from = conn->getLoop();
+    if (!conn->migrateTo(loop, std::bind(&TcpServer::connectMigratedInLoop, this, std::placeholders::_1, totalRetrans))) {
+        return;
+    }
+    connections.erase(conn);
+    LOG_FMT_INFO(g_logger, "server[%s] - migrate %s from loop %p to %p",
+        name_.c_str(), conn->name().c_str(), from, loop);
+}
+
+void TcpServer::connectMigratedInLoop(const TcpConnectionPtr& conn, uint32_t totalRetrans) {
+    loopConnections_->get().insert(conn);
+    if (tcpInfoSamplers_) {
+        tcpInfoSamplers_->get().totalRetrans[conn.get()] = totalRetrans;
+    }
+}
+
+void TcpServer::rebalance() {
+    std::vector<Future<LoopLoad>> futures;
+    for (EventLoop* loop : threadPool_->getAllLoop()) {
+        futures.push_back(runInLoopAsync(loop, std::bind(&TcpServer::loadInLoop, this)));
+    }
+    whenAll(futures).then(loop_, std::bind(&TcpServer::rebalanceWith, this, std::placeholders::_1));
+}
+
+TcpServer::LoopLoad TcpServer::loadInLoop() {
+    EventLoop*   loop    = EventLoop::getEventLoopOfCurrentThread();
+    LoadTracker& tracker = loadTrackers_->get();
+    Timestamp    now     = Timestamp::now();
+    int64_t      busy    = loop->busyTime();
+
+    LoopLoad load;
+    load.loop        = loop;
+    load.utilization = 0;
+    load.bytes       = 0;
+    if (tracker.time.valid() && now.microSecondsSinceEpoch() > tracker.time.microSecondsSinceEpoch()) {
+        load.utilization = static_cast<double>(busy - tracker.busyTime)
+                         / (now.microSecondsSinceEpoch() - tracker.time.microSecondsSinceEpoch());
+    }
+    tracker.busyTime = busy;
+    tracker.time     = now;
+
+    // 每次重建字节数表 关闭或迁移走的连接自然被移除 新加入的连接从下一次统计开始计算
+    std::unordered_map<const TcpConnection*, uint64_t> bytes;
+    for (const TcpConnectionPtr& conn : loopConnections_->get()) {
+        uint64_t total = conn->bytesReceived() + conn->bytesSent();
+        auto     it    = tracker.bytes.find(conn.get());
+        if (it != tracker.bytes.end() && total > it->second) {
+            load.connections.push_back(std::make_pair(conn, total - it->second));
+            load.bytes += total - it->second;
+        }
+        bytes[conn.get()] = total;
+    }
+    tracker.bytes.swap(bytes);
+    return load;
+}
+
+void TcpServer::rebalanceWith(const std::vector<LoopLoad>& all) {
+    // 统计期间被移除的SubLoop不再参与均衡 也不能作为迁移的目标
+    std::vector<EventLoop*> active = threadPool_->getAllLoop();
+    std::vector<LoopLoad>   loads;
+    for (const LoopLoad& load : all) {
+        if (std::find(active.begin(), active.end(), load.loop) != active.end()) {
+            loads.push_back(load);
+        }
+    }
+    if (autoScale(loads) || loads.size() < 2) {
+        return;
+    }
+    const LoopLoad* hot  = &loads.front();
+    const LoopLoad* cold = &loads.front();
+    for (const LoopLoad& load : loads) {
+        if (load.utilization > hot->utilization) {
+            hot = &load;
+        }
+        if (load.utilization < cold->utilization) {
+            cold = &load;
+        }
+    }
+    double gap = hot->utilization - cold->utilization;
+    if (gap < rebalanceThreshold_ || hot->bytes == 0) {
+        return;
+    }
+
+    // 迁移负载为x的连接后两者的负载为hot-x与cold+x 只有x小于差值时才能缩小差距 x等于差值的一半时最均衡
+    const TcpConnectionPtr* best     = nullptr;
+    double                  bestDiff = gap;
+    for (const auto& item : hot->connections) {
+        double x = hot->utilization * item.second / hot->bytes;
+        if (x < gap && std::abs(x - gap / 2) < bestDiff) {
+            best     = &item.first;
+            bestDiff = std::abs(x - gap / 2);
+        }
+    }
+    if (best != nullptr) {
+        LOG_FMT_INFO(g_logger, "server[%s] - rebalance: loop %p load %.2f, loop %p load %.2f",
+            name_.c_str(), hot->loop, hot->utilization, cold->loop, cold->utilization);
+        migrate(*best, cold->loop);
+    }
+}
+
+bool TcpServer::autoScale(const std::vector<LoopLoad>& loads) {
+    if (maxThreads_ <= 0 || loads.empty() || retiring_ > 0) {
+        return false;
+    }
+    if (scaleCooldown_ > 0) {
+        --scaleCooldown_;
+        return false;
+    }
+
+    int             n     = static_cast<int>(loads.size());
+    double          total = 0;
+    const LoopLoad* cold  = &loads.front();
+    for (const LoopLoad& load : loads) {
+        total += load.utilization;
+        if (load.utilization < cold->utilization) {
+            cold = &load;
+        }
+    }
+
+    if (n < maxThreads_ && total / n > scaleUpLoad_) {
+        LOG_FMT_INFO(g_logger, "server[%s] - scale up: %d loops, average load %.2f",
+            name_.c_str(), n, total / n);
+        threadPool_->addLoop();
+    } else if (n > std::max(minThreads_, 1) && total / (n - 1) < scaleDownLoad_) {
+        LOG_FMT_INFO(g_logger, "server[%s] - scale down: %d loops, average load %.2f",
+            name_.c_str(), n, total / n);
+        retireLoopInLoop(cold->loop);
+    } else {
+        return false;
+    }
+    scaleCooldown_ = kScaleCooldown;
+    return true;
+}
+
+void TcpServer::resize(int numThreads) {
+    if (!started_) {
+        setThreadNum(numThreads);
+        return;
+    }
+    loop_->runInLoop(std::bind(&TcpServer::resizeInLoop, this, numThreads));
+}
+
+void TcpServer::resizeInLoop(int numThreads) {
+    int current = threadPool_->threadNum();
+    if (current == 0 || numThreads < 1) {
+        LOG_FMT_ERROR(g_logger, "server[%s] - cannot resize from %d to %d loops",
+            name_.c_str(), current, numThreads);
+        return;
+    }
+
+    LOG_FMT_INFO(g_logger, "server[%s] - resize from %d to %d loops", name_.c_str(), current, numThreads);
+    for (; current < numThreads; ++current) {
+        threadPool_->addLoop();
+    }
+    if (current > numThreads) {
+        // 后加入的SubLoop上通常连接较少 优先移除
+        std::vector<EventLoop*> loops = threadPool_->getAllLoop();
+        for (; current > numThreads; --current) {
+            retireLoopInLoop(loops[current - 1]);
+        }
+    }
+}
+
+void TcpServer::retireLoopInLoop(EventLoop* loop) {
+    if (!threadPool_->retireLoop(loop)) {
+        return;
+    }
+    ++retiring_;
+    LOG_FMT_INFO(g_logger, "server[%s] - retire loop %p", name_.c_str(), loop);
+    loop->runInLoop(guard(std::bind(&TcpServer::evacuateInLoop, this, addTime(Timestamp::now(), kEvacuateTimeout))));
+}
+
+void TcpServer::evacuateInLoop(Timestamp deadline) {
+    EventLoop*     loop        = EventLoop::getEventLoopOfCurrentThread();
+    ConnectionSet& connections = loopConnections_->get();
+    bool           expired     = deadline < Timestamp::now();
+
+    // 迁移成功的连接会从集合中移除 先复制一份
+    std::vector<TcpConnectionPtr> conns(connections.begin(), connections.end());
+    for (const TcpConnectionPtr& conn : conns) {
+        migrateInLoop(conn, threadPool_->getNextLoop());
+        if (expired && connections.count(conn) > 0) {
+            conn->forceClose();
+        }
+    }
+
+    if (connections.empty()) {
+        loop_->runInLoop(guard(std::bind(&TcpServer::stopLoopInLoop, this, loop)));
+    } else {
+        loop->runAfter(kEvacuateInterval, guard(std::bind(&TcpServer::evacuateInLoop, this, deadline)));
+    }
+}
+
+void TcpServer::stopLoopInLoop(EventLoop* loop) {
+    threadPool_->stopLoop(loop);
+    --retiring_;
+    LOG_FMT_INFO(g_logger, "server[%s] - loop %p stopped, %d loops left",
+        name_.c_str(), loop, threadPool_->threadNum());
+}
+
+void TcpServer::sampleTcpInfoInLoop() {
+    TcpInfoSampler& sampler = tcpInfoSamplers_->get();
+    TcpInfo         info;
+    for (const TcpConnectionPtr& conn : loopConnections_->get()) {
+        if (!conn->tcpInfo(&info)) {
+            continue;
+        }
+        sampler.stats.rtt.record(info.rtt);
+        sampler.stats.rttVar.record(info.rttVar);
+        sampler.stats.cwnd.record(info.cwnd);
+        sampler.stats.unacked.record(info.unacked);
+        sampler.stats.notsentBytes.record(info.notsentBytes);
+
+        // 记录两次采样之间新增的重传 累计值只反映连接的历史
+        uint32_t& last = sampler.totalRetrans[conn.get()];
+        sampler.stats.retransmits.record(info.totalRetrans - last);
+        last = info.totalRetrans;
+    }
+}
+
+TcpInfoStats TcpServer::collectTcpInfoInLoop(bool reset) {
+    TcpInfoStats& stats = tcpInfoSamplers_->get().stats;
+    TcpInfoStats  result(stats);
+    if (reset) {
+        stats.reset();
+    }
+    return result;
+}
+
+void TcpServer::drain(double timeout, const DrainCallback& cb) {
+    loop_->runInLoop(std::bind(&TcpServer::drainInLoop, this, timeout, cb));
+}
+
+void TcpServer::drainInLoop(double timeout, const DrainCallback& cb) {
+    accepter_->stop();
+    LOG_FMT_INFO(g_logger, "server[%s] - draining %lu connections",
+        name_.c_str(), connections_.size());
+
+    if (connections_.empty()) {
+        cb();
+        return;
+    }
+
+    if (draining_) {
+        loop_->cancel(drainTimer_);
+    }
+    draining_      = true;
+    drainCallback_ = cb;
+    drainTimer_    = loop_->runAfter(timeout, std::bind(&TcpServer::forceCloseAll, this));
+}
+
+std::function<void()> TcpServer::guard(const std::function<void()>& func) const {
+    std::weak_ptr<bool> alive(alive_);
+    return [alive, func]() {
+        if (alive.lock()) {
+            func();
+        }
+    };
+}
+
+void TcpServer::forceCloseAll() {
+    LOG_FMT_WARN(g_logger, "server[%s] - drain timeout, force close %lu connections",
+        name_.c_str(), connections_.size());
+    for (auto& item : connections_) {
+        item.second->forceClose();
+    }
 }
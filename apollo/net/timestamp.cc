@@ -1,5 +1,6 @@
 #include "timestamp.h"
 #include <ctime>
+#include <sys/time.h>
 using namespace apollo;
 
 Timestamp::Timestamp()
@@ -9,12 +10,15 @@ Timestamp::Timestamp(int64_t microSecondsSinceEpoch)
     : microSecondsSinceEpoch_(microSecondsSinceEpoch) { }
 
 Timestamp Timestamp::now() {
-    return Timestamp(time(nullptr));
+    timeval tv;
+    ::gettimeofday(&tv, nullptr);
+    return Timestamp(static_cast<int64_t>(tv.tv_sec) * kMicroSecondsPerSecond + tv.tv_usec);
 }
 
 std::string Timestamp::toString() const {
-    char buf[128] = { 0 };
-    tm*  tm_time  = localtime(&microSecondsSinceEpoch_);
+    char   buf[128] = { 0 };
+    time_t seconds  = static_cast<time_t>(microSecondsSinceEpoch_ / kMicroSecondsPerSecond);
+    tm*    tm_time  = localtime(&seconds);
     snprintf(buf, 128, "%4d/%02d/%02d %02d:%02d:%02d",
         tm_time->tm_year + 1900,
         tm_time->tm_mon + 1,
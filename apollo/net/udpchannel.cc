@@ -0,0 +1,421 @@
+#include "udpchannel.h"
+#include "channel.h"
+#include "eventloop.h"
+#include "log.h"
+#include "socket.h"
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+using namespace apollo;
+
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+
+const size_t kMaxUdpPayload     = 65507; // IPv4下单个UDP报文的最大负载
+const size_t kMaxGsoSegmentSize = 1472;  // 以太网MTU下单个分段的最大负载，超过时不进行GSO合并
+
+/**
+ * @brief 创建一个非阻塞的UDP套接字
+ *
+ * @return int 返回套接字描述符
+ */
+static int createNonblockingUdp()
+{
+    int sockfd = ::socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_UDP);
+    if (sockfd < 0) {
+        LOG_FMT_FATAL(g_logger, "failed to create udp socket, errno: %d", errno);
+    }
+    return sockfd;
+}
+
+/**
+ * @brief 两个地址是否指向同一个对端
+ */
+static bool isSamePeer(const InetAddress& lhs, const InetAddress& rhs)
+{
+    return lhs.getSockAddr()->sin_addr.s_addr == rhs.getSockAddr()->sin_addr.s_addr
+        && lhs.getSockAddr()->sin_port == rhs.getSockAddr()->sin_port;
+}
+
+UdpChannel::UdpChannel(EventLoop* loop, const std::string& name)
+    : loop_(loop)
+    , name_(name)
+    , socket_(new Socket(createNonblockingUdp()))
+    , channel_(new Channel(loop, socket_->fd()))
+    , connected_(false)
+    , started_(false)
+    , gro_(false)
+    , gso_(false)
+    , flushPending_(false)
+    , maxDatagramSize_(kDefaultDatagramSize)
+    , sendIndex_(0)
+    , queueBytes_(0)
+    , maxQueueBytes_(kDefaultMaxQueueBytes)
+    , droppedDatagrams_(0)
+    , sendMsgs_(kMaxBatch)
+    , sendIovecs_(kMaxBatch)
+    , sendCounts_(kMaxBatch)
+    , sendControl_(kMaxBatch * CMSG_SPACE(sizeof(uint16_t)))
+{
+    channel_->setReadCallback(std::bind(&UdpChannel::handleRead, this, std::placeholders::_1));
+    channel_->setWriteCallback(std::bind(&UdpChannel::handleWrite, this));
+    channel_->setErrorCallback(std::bind(&UdpChannel::handleError, this));
+    LOG_FMT_INFO(g_logger, "UdpChannel::ctor[%s] at %p, fd: %d",
+        name_.c_str(), this, socket_->fd());
+}
+
+UdpChannel::~UdpChannel()
+{
+    LOG_FMT_INFO(g_logger, "UdpChannel::dtor[%s] at %p, fd: %d",
+        name_.c_str(), this, socket_->fd());
+}
+
+int UdpChannel::fd() const
+{
+    return socket_->fd();
+}
+
+void UdpChannel::bindAddress(const InetAddress& localAddr, bool reusePort)
+{
+    socket_->setReuseAddr(true);
+    socket_->setReusePort(reusePort);
+    socket_->bindAddress(localAddr);
+}
+
+void UdpChannel::connect(const InetAddress& peerAddr)
+{
+    if (::connect(socket_->fd(), (sockaddr*)(peerAddr.getSockAddr()), sizeof(sockaddr_in)) < 0) {
+        LOG_FMT_ERROR(g_logger, "UdpChannel[%s] connect to %s error: %d",
+            name_.c_str(), peerAddr.toIpPort().c_str(), errno);
+        return;
+    }
+    peerAddr_  = peerAddr;
+    connected_ = true;
+}
+
+bool UdpChannel::setGro(bool on)
+{
+    int optval = on ? 1 : 0;
+    if (::setsockopt(socket_->fd(), SOL_UDP, UDP_GRO, &optval, sizeof(optval)) < 0) {
+        LOG_FMT_WARN(g_logger, "UdpChannel[%s] UDP_GRO is not supported: %d", name_.c_str(), errno);
+        gro_ = false;
+        return false;
+    }
+    gro_ = on;
+    return true;
+}
+
+bool UdpChannel::setGso(bool on)
+{
+    // 将套接字级别的分段大小设置为0 仅用于探测内核是否支持UDP_SEGMENT
+    // 实际的分段大小在每次发送时通过控制消息指定
+    int  optval    = 0;
+    bool supported = true;
+    if (on && ::setsockopt(socket_->fd(), SOL_UDP, UDP_SEGMENT, &optval, sizeof(optval)) < 0) {
+        LOG_FMT_WARN(g_logger, "UdpChannel[%s] UDP_SEGMENT is not supported: %d", name_.c_str(), errno);
+        supported = false;
+    }
+    gso_ = on && supported;
+    sendIovecs_.resize(gso_ ? kMaxBatch * kMaxGsoSegments : kMaxBatch);
+    return supported;
+}
+
+void UdpChannel::start()
+{
+    loop_->runInLoop(std::bind(&UdpChannel::startInLoop, shared_from_this()));
+}
+
+void UdpChannel::stop()
+{
+    loop_->runInLoop(std::bind(&UdpChannel::stopInLoop, shared_from_this()));
+}
+
+void UdpChannel::sendTo(const InetAddress& peerAddr, const void* data, size_t len)
+{
+    if (loop_->isInLoopThread()) {
+        enqueue(peerAddr, static_cast<const char*>(data), len);
+    } else {
+        loop_->runInLoop(std::bind(&UdpChannel::sendInLoop, shared_from_this(),
+            peerAddr, std::string(static_cast<const char*>(data), len)));
+    }
+}
+
+void UdpChannel::sendTo(const InetAddress& peerAddr, const std::string& message)
+{
+    sendTo(peerAddr, message.data(), message.size());
+}
+
+void UdpChannel::send(const std::string& message)
+{
+    if (!connected_) {
+        LOG_FMT_ERROR(g_logger, "UdpChannel[%s] has no default peer, give up sending", name_.c_str());
+        return;
+    }
+    sendTo(peerAddr_, message.data(), message.size());
+}
+
+void UdpChannel::startInLoop()
+{
+    if (started_) {
+        return;
+    }
+    started_ = true;
+
+    // 开启GRO时每个接收缓冲区需要容纳内核聚合后的整个报文
+    const int    batch    = gro_ ? kMaxGroBatch : kMaxBatch;
+    const size_t slotSize = gro_ ? kMaxGroSize : maxDatagramSize_;
+    const size_t ctrlSize = CMSG_SPACE(sizeof(int));
+
+    recvBuffer_.resize(batch * slotSize);
+    recvMsgs_.resize(batch);
+    recvIovecs_.resize(batch);
+    recvAddrs_.resize(batch);
+    recvControl_.resize(batch * ctrlSize);
+
+    for (int i = 0; i < batch; ++i) {
+        recvIovecs_[i].iov_base = &recvBuffer_[i * slotSize];
+        recvIovecs_[i].iov_len  = slotSize;
+
+        msghdr& hdr = recvMsgs_[i].msg_hdr;
+        ::memset(&hdr, 0, sizeof(hdr));
+        hdr.msg_name    = &recvAddrs_[i];
+        hdr.msg_iov     = &recvIovecs_[i];
+        hdr.msg_iovlen  = 1;
+        hdr.msg_control = gro_ ? &recvControl_[i * ctrlSize] : nullptr;
+    }
+
+    channel_->tie(shared_from_this());
+    channel_->enableReading();
+}
+
+void UdpChannel::stopInLoop()
+{
+    if (started_) {
+        started_ = false;
+        channel_->disableAll();
+        channel_->remove();
+    }
+}
+
+void UdpChannel::sendInLoop(const InetAddress& peerAddr, const std::string& message)
+{
+    enqueue(peerAddr, message.data(), message.size());
+}
+
+void UdpChannel::enqueue(const InetAddress& peerAddr, const char* data, size_t len)
+{
+    // 内核发送缓冲区持续写满时队列不能无限增长 超出上限的数据报直接丢弃
+    if (queueBytes_ + len > maxQueueBytes_) {
+        droppedDatagrams_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    queueBytes_ += len;
+    sendQueue_.push_back(Datagram { peerAddr, std::string(data, len) });
+
+    // 同一轮事件循环中发送的数据报会在doPendingFunctors中通过一次sendmmsg发送
+    // 如果正在等待EPOLLOUT事件 则由handleWrite负责发送
+    if (!flushPending_ && !channel_->isWriteEvent()) {
+        flushPending_ = true;
+        loop_->queueInLoop(std::bind(&UdpChannel::flush, shared_from_this()));
+    }
+}
+
+int UdpChannel::fillSendBatch(size_t first)
+{
+    const size_t ctrlSize = CMSG_SPACE(sizeof(uint16_t));
+
+    size_t idx    = first;
+    size_t iovIdx = 0;
+    int    nmsg   = 0;
+
+    while (idx < sendQueue_.size() && nmsg < kMaxBatch) {
+        const Datagram& head    = sendQueue_[idx];
+        const size_t    segSize = head.data.size();
+        size_t          count   = 1;
+
+        // 合并后续发往同一对端的等长数据报 只有最后一个数据报可以比分段长度短
+        if (gso_ && segSize > 0 && segSize <= kMaxGsoSegmentSize) {
+            size_t total = segSize;
+            while (idx + count < sendQueue_.size() && count < static_cast<size_t>(kMaxGsoSegments)) {
+                const Datagram& next = sendQueue_[idx + count];
+                if (next.data.empty() || next.data.size() > segSize
+                    || total + next.data.size() > kMaxUdpPayload
+                    || !isSamePeer(next.peerAddr, head.peerAddr)) {
+                    break;
+                }
+                total += next.data.size();
+                ++count;
+                if (next.data.size() < segSize) {
+                    break;
+                }
+            }
+        }
+
+        msghdr& hdr = sendMsgs_[nmsg].msg_hdr;
+        ::memset(&hdr, 0, sizeof(hdr));
+        if (!connected_) {
+            hdr.msg_name    = const_cast<sockaddr_in*>(head.peerAddr.getSockAddr());
+            hdr.msg_namelen = sizeof(sockaddr_in);
+        }
+        hdr.msg_iov    = &sendIovecs_[iovIdx];
+        hdr.msg_iovlen = count;
+        for (size_t i = 0; i < count; ++i) {
+            const std::string& data         = sendQueue_[idx + i].data;
+            sendIovecs_[iovIdx + i].iov_base = const_cast<char*>(data.data());
+            sendIovecs_[iovIdx + i].iov_len  = data.size();
+        }
+
+        if (count > 1) {
+            hdr.msg_control    = &sendControl_[nmsg * ctrlSize];
+            hdr.msg_controllen = ctrlSize;
+
+            cmsghdr* cmsg    = CMSG_FIRSTHDR(&hdr);
+            cmsg->cmsg_level = SOL_UDP;
+            cmsg->cmsg_type  = UDP_SEGMENT;
+            cmsg->cmsg_len   = CMSG_LEN(sizeof(uint16_t));
+            uint16_t gsoSize = static_cast<uint16_t>(segSize);
+            ::memcpy(CMSG_DATA(cmsg), &gsoSize, sizeof(gsoSize));
+        }
+
+        sendCounts_[nmsg] = count;
+        iovIdx += count;
+        idx += count;
+        ++nmsg;
+    }
+
+    return nmsg;
+}
+
+void UdpChannel::flush()
+{
+    flushPending_ = false;
+
+    while (sendIndex_ < sendQueue_.size()) {
+        int batch = fillSendBatch(sendIndex_);
+        int n     = ::sendmmsg(socket_->fd(), sendMsgs_.data(), batch, MSG_DONTWAIT);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                // 内核发送缓冲区已满 等待EPOLLOUT事件到来后继续发送
+                if (!channel_->isWriteEvent()) {
+                    channel_->enableWriting();
+                }
+                return;
+            } else if (errno == EINTR) {
+                continue;
+            }
+            // 批次中的第一个消息发送失败 丢弃该消息后继续发送后面的数据报
+            LOG_FMT_ERROR(g_logger, "UdpChannel[%s] sendmmsg to %s error: %d",
+                name_.c_str(), sendQueue_[sendIndex_].peerAddr.toIpPort().c_str(), errno);
+            retire(sendCounts_[0]);
+            continue;
+        }
+        for (int i = 0; i < n; ++i) {
+            retire(sendCounts_[i]);
+        }
+    }
+
+    sendQueue_.clear();
+    sendIndex_  = 0;
+    queueBytes_ = 0;
+    if (channel_->isWriteEvent()) {
+        channel_->disableWriting();
+    }
+}
+
+void UdpChannel::retire(size_t count)
+{
+    for (size_t i = 0; i < count; ++i) {
+        queueBytes_ -= sendQueue_[sendIndex_ + i].data.size();
+    }
+    sendIndex_ += count;
+}
+
+void UdpChannel::handleRead(Timestamp receiveTime)
+{
+    const int    batch    = static_cast<int>(recvMsgs_.size());
+    const size_t ctrlSize = CMSG_SPACE(sizeof(int));
+
+    // 内核会修改地址长度和控制消息长度 每次接收前都需要重置
+    for (int i = 0; i < batch; ++i) {
+        recvMsgs_[i].msg_hdr.msg_namelen    = sizeof(sockaddr_in);
+        recvMsgs_[i].msg_hdr.msg_controllen = gro_ ? ctrlSize : 0;
+    }
+
+    int n = ::recvmmsg(socket_->fd(), recvMsgs_.data(), batch, MSG_DONTWAIT, nullptr);
+    if (n < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            LOG_FMT_ERROR(g_logger, "UdpChannel[%s] recvmmsg error: %d", name_.c_str(), errno);
+        }
+        return;
+    }
+
+    // 整个批次只获取一次自身的引用 避免每个数据报都进行原子操作
+    UdpChannelPtr self(shared_from_this());
+    for (int i = 0; i < n; ++i) {
+        msghdr&     hdr  = recvMsgs_[i].msg_hdr;
+        const char* data = static_cast<const char*>(hdr.msg_iov->iov_base);
+        size_t      len  = recvMsgs_[i].msg_len;
+        InetAddress peerAddr(recvAddrs_[i]);
+
+        if (hdr.msg_flags & MSG_TRUNC) {
+            LOG_FMT_WARN(g_logger, "UdpChannel[%s] datagram from %s truncated to %lu bytes",
+                name_.c_str(), peerAddr.toIpPort().c_str(), len);
+        }
+
+        // 开启GRO时内核会在控制消息中告知聚合前每个数据报的长度
+        size_t segSize = len;
+        if (gro_) {
+            for (cmsghdr* cmsg = CMSG_FIRSTHDR(&hdr); cmsg != nullptr; cmsg = CMSG_NXTHDR(&hdr, cmsg)) {
+                if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+                    int gsoSize = 0;
+                    ::memcpy(&gsoSize, CMSG_DATA(cmsg), sizeof(gsoSize));
+                    if (gsoSize > 0) {
+                        segSize = static_cast<size_t>(gsoSize);
+                    }
+                }
+            }
+        }
+
+        if (!messageCallback_) {
+            continue;
+        }
+        if (segSize == 0 || segSize >= len) {
+            messageCallback_(self, peerAddr, data, len, receiveTime);
+        } else {
+            for (size_t offset = 0; offset < len; offset += segSize) {
+                messageCallback_(self, peerAddr, data + offset,
+                    std::min(segSize, len - offset), receiveTime);
+            }
+        }
+    }
+}
+
+void UdpChannel::handleWrite()
+{
+    if (channel_->isWriteEvent()) {
+        flush();
+    }
+}
+
+void UdpChannel::handleError()
+{
+    int       optval;
+    socklen_t optlen = sizeof(optval);
+    int       err    = 0;
+    if (::getsockopt(socket_->fd(), SOL_SOCKET, SO_ERROR, &optval, &optlen) < 0) {
+        err = errno;
+    } else {
+        err = optval;
+    }
+    LOG_FMT_ERROR(g_logger, "UdpChannel::handleError name: %s - error: %d",
+        name_.c_str(), err);
+}
@@ -0,0 +1,66 @@
+#include "udpserver.h"
+#include "log.h"
+using namespace apollo;
+
+static EventLoop* CheckLoopNotNull(EventLoop* loop) {
+    if (loop == nullptr) {
+        LOG_FATAL(g_logger) << "loop is null!";
+    }
+    return loop;
+}
+
+UdpServer::UdpServer(EventLoop* loop, const InetAddress& localAddr, const std::string& name)
+    : loop_(CheckLoopNotNull(loop))
+    , localAddr_(localAddr)
+    , name_(name)
+    , threadPool_(new EventLoopThreadPool(loop_, name_))
+    , gro_(false)
+    , gso_(false)
+    , maxDatagramSize_(UdpChannel::kDefaultDatagramSize)
+    , started_(false) {
+}
+
+UdpServer::~UdpServer() {
+    for (auto& channel : channels_) {
+        channel->stop();
+    }
+}
+
+void UdpServer::setThreadNum(int numThreads) {
+    threadPool_->setThreadNum(numThreads);
+}
+
+void UdpServer::start() {
+    // 防止启动多次
+    if (started_) {
+        return;
+    }
+    started_ = true;
+    threadPool_->start(threadInitCallback_);
+
+    // 每个事件循环各自创建一个套接字 多个套接字绑定同一端口时需要开启SO_REUSEPORT
+    std::vector<EventLoop*> loops = threadPool_->getAllLoop();
+    bool reusePort = loops.size() > 1;
+
+    for (size_t i = 0; i < loops.size(); ++i) {
+        char buf[64] = { 0 };
+        snprintf(buf, sizeof(buf), "-%s#%lu", localAddr_.toIpPort().c_str(), i);
+
+        UdpChannelPtr channel(new UdpChannel(loops[i], name_ + buf));
+        if (gro_) {
+            channel->setGro(true);
+        }
+        if (gso_) {
+            channel->setGso(true);
+        }
+        channel->setMaxDatagramSize(maxDatagramSize_);
+        channel->setMessageCallback(messageCallback_);
+        channel->bindAddress(localAddr_, reusePort);
+        channels_.push_back(channel);
+
+        LOG_FMT_INFO(g_logger, "udp server[%s] - channel[%s] bound on loop %p",
+            name_.c_str(), channel->name().c_str(), loops[i]);
+
+        channel->start();
+    }
+}
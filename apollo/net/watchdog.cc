@@ -0,0 +1,272 @@
+#include "watchdog.h"
+#include "eventloop.h"
+#include "eventloopthreadpool.h"
+#include "log.h"
+#include "thread.h"
+#include "timestamp.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cxxabi.h>
+#include <errno.h>
+#include <execinfo.h>
+#include <signal.h>
+#include <sstream>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+using namespace apollo;
+
+namespace
+{
+const int kMaxFrames        = 64;  // 调用栈的最大深度
+const int kSkipFrames       = 2;   // 信号处理函数和内核的信号返回帧
+const int kCaptureTimeoutMs = 100; // 等待信号处理函数取栈的最长时间 单位为毫秒
+
+// 信号处理函数写入的调用栈 同一时刻只有一个线程在取栈
+// 每次取栈使用新的序号 信号处理函数只有在线程ID相符并且以CAS领取了当前序号之后才写入，
+// 上一次取栈超时之后迟到的信号不会写入本次的结果
+struct StackSlot {
+    std::shared_ptr<LoopHeartbeat> owner;     // 持有被取栈的心跳 直到下一次取栈 只在取栈线程中访问
+    const LoopHeartbeat*           heartbeat; // 被取栈的事件循环的心跳
+    pid_t                          tid;       // 被取栈的线程
+    uint64_t                       nextSeq;   // 下一次取栈的序号 只在取栈线程中访问
+    std::atomic<uint64_t>          armed;     // 等待信号处理函数领取的序号 为0表示没有
+    std::atomic<uint64_t>          done;      // 信号处理函数写完调用栈的序号
+    uint64_t                       iteration; // 取栈时事件循环所在的循环序号
+    void*                          frames[kMaxFrames];
+    int                            depth;
+};
+
+StackSlot      g_stack;
+std::mutex     g_captureMtx;
+std::once_flag g_installOnce;
+
+int stackSignal() {
+    return SIGRTMIN + 1;
+}
+
+void onStackSignal(int) {
+    int      saveErrno = errno;
+    uint64_t seq       = g_stack.armed.load(std::memory_order_acquire);
+    // armed变为0之前取栈线程不会修改tid 领取成功说明读到的tid属于序号seq
+    if (seq != 0 && g_stack.tid == static_cast<pid_t>(::syscall(SYS_gettid))
+        && g_stack.armed.compare_exchange_strong(seq, 0, std::memory_order_acq_rel)) {
+        g_stack.depth     = ::backtrace(g_stack.frames, kMaxFrames);
+        g_stack.iteration = g_stack.heartbeat->iteration.load(std::memory_order_relaxed);
+        g_stack.done.store(seq, std::memory_order_release);
+    }
+    errno = saveErrno;
+}
+
+void installHandler() {
+    // backtrace第一次调用时会加载libgcc并分配内存 不能发生在信号处理函数中
+    void* frame;
+    ::backtrace(&frame, 1);
+
+    struct sigaction sa;
+    ::memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = onStackSignal;
+    sa.sa_flags   = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    if (::sigaction(stackSignal(), &sa, nullptr) < 0) {
+        LOG_FMT_ERROR(g_logger, "watchdog sigaction error: %d", errno);
+    }
+}
+
+std::string demangle(const char* name) {
+    int   status    = 0;
+    char* demangled = abi::__cxa_demangle(name, nullptr, nullptr, &status);
+    if (demangled == nullptr) {
+        return name;
+    }
+    std::string result(demangled);
+    ::free(demangled);
+    return result;
+}
+}
+
+std::string StallReport::toString() const {
+    std::ostringstream os;
+    os << "EventLoop " << loop << " in thread " << tid << " stalled for " << duration * 1000 << " ms";
+    if (fd >= 0) {
+        os << ", handling fd " << fd;
+    }
+    if (!functor.empty()) {
+        os << ", running functor " << functor;
+    }
+    for (const std::string& frame : stack) {
+        os << "\n    " << frame;
+    }
+    return os.str();
+}
+
+Watchdog::Watchdog(double threshold, double interval)
+    : threshold_(static_cast<int64_t>(threshold * Timestamp::kMicroSecondsPerSecond))
+    , interval_(interval > 0 ? interval : threshold / 4)
+    , stallCallback_([](const StallReport& report) { LOG_WARN(g_logger) << report.toString(); })
+    , running_(false)
+    , stalls_(0) {
+}
+
+Watchdog::~Watchdog() {
+    stop();
+    for (const auto& observer : observers_) {
+        observer.first->removeObserver(observer.second);
+    }
+}
+
+void Watchdog::watch(EventLoop* loop) {
+    std::lock_guard<std::mutex> locker(mtx_);
+    Watched watched;
+    watched.heartbeat = loop->heartbeat();
+    watched.reported  = 0;
+    watched_.push_back(watched);
+}
+
+void Watchdog::watch(EventLoopThreadPool& pool) {
+    for (EventLoop* loop : pool.getAllLoop()) {
+        watch(loop);
+    }
+    // 线程池析构时退出的事件循环由心跳中的退出标记移除
+    int id = pool.addObserver(std::bind(static_cast<void (Watchdog::*)(EventLoop*)>(&Watchdog::watch), this, std::placeholders::_1));
+    observers_.push_back(std::make_pair(&pool, id));
+}
+
+void Watchdog::start() {
+    std::call_once(g_installOnce, installHandler);
+
+    std::lock_guard<std::mutex> locker(mtx_);
+    if (running_) {
+        return;
+    }
+    running_ = true;
+    thread_.reset(new Thread(std::bind(&Watchdog::threadFunc, this), "watchdog"));
+    thread_->start();
+}
+
+void Watchdog::stop() {
+    {
+        std::lock_guard<std::mutex> locker(mtx_);
+        if (!running_) {
+            return;
+        }
+        running_ = false;
+    }
+    cond_.notify_all();
+    thread_->join();
+    thread_.reset();
+}
+
+uint64_t Watchdog::stalls() const {
+    std::lock_guard<std::mutex> locker(mtx_);
+    return stalls_;
+}
+
+void Watchdog::threadFunc() {
+    std::chrono::microseconds interval(static_cast<int64_t>(interval_ * Timestamp::kMicroSecondsPerSecond));
+    std::unique_lock<std::mutex> locker(mtx_);
+    while (running_) {
+        cond_.wait_for(locker, interval);
+        if (!running_) {
+            break;
+        }
+        locker.unlock();
+        check();
+        locker.lock();
+    }
+}
+
+void Watchdog::check() {
+    // 发现阻塞的事件循环及其本轮循环的序号
+    std::vector<std::pair<std::shared_ptr<LoopHeartbeat>, uint64_t>> stalled;
+    int64_t now = Timestamp::now().microSecondsSinceEpoch();
+    {
+        std::lock_guard<std::mutex> locker(mtx_);
+        watched_.erase(std::remove_if(watched_.begin(), watched_.end(),
+                           [](const Watched& w) { return w.heartbeat->exited.load(std::memory_order_acquire); }),
+            watched_.end());
+
+        for (Watched& w : watched_) {
+            int64_t  since     = w.heartbeat->busySince.load(std::memory_order_relaxed);
+            uint64_t iteration = w.heartbeat->iteration.load(std::memory_order_relaxed);
+            // 以序号加一记录已经报告的循环 初始的0表示没有报告过
+            if (since > 0 && now - since > threshold_ && w.reported != iteration + 1) {
+                w.reported = iteration + 1;
+                stalled.push_back(std::make_pair(w.heartbeat, iteration));
+            }
+        }
+    }
+
+    for (const auto& item : stalled) {
+        const LoopHeartbeat& heartbeat = *item.first;
+
+        StallReport report;
+        report.loop     = heartbeat.loop;
+        report.tid      = heartbeat.tid;
+        report.duration = static_cast<double>(now - heartbeat.busySince.load(std::memory_order_relaxed))
+                        / Timestamp::kMicroSecondsPerSecond;
+        report.fd       = heartbeat.fd.load(std::memory_order_relaxed);
+
+        // type_info对象的生命周期是整个程序 可以在其他线程中读取
+        const std::type_info* functor = heartbeat.functor.load(std::memory_order_relaxed);
+        if (functor != nullptr) {
+            report.functor = demangle(functor->name());
+        }
+
+        report.stack = captureStack(item.first, item.second);
+
+        {
+            std::lock_guard<std::mutex> locker(mtx_);
+            ++stalls_;
+        }
+        if (stallCallback_) {
+            stallCallback_(report);
+        }
+    }
+}
+
+std::vector<std::string> Watchdog::captureStack(const std::shared_ptr<LoopHeartbeat>& heartbeat, uint64_t iteration) {
+    std::vector<std::string> stack;
+
+    std::lock_guard<std::mutex> locker(g_captureMtx);
+    uint64_t seq      = ++g_stack.nextSeq;
+    g_stack.owner     = heartbeat;
+    g_stack.heartbeat = heartbeat.get();
+    g_stack.tid       = heartbeat->tid;
+    g_stack.armed.store(seq, std::memory_order_release);
+    if (::syscall(SYS_tgkill, ::getpid(), heartbeat->tid, stackSignal()) < 0) {
+        g_stack.armed.store(0, std::memory_order_relaxed);
+        return stack;
+    }
+    for (int i = 0; i < kCaptureTimeoutMs && g_stack.done.load(std::memory_order_acquire) != seq; ++i) {
+        ::usleep(1000);
+    }
+
+    if (g_stack.done.load(std::memory_order_acquire) != seq) {
+        // 超时后撤回序号 撤回失败说明信号处理函数已经领取 等待其写完
+        uint64_t expected = seq;
+        if (g_stack.armed.compare_exchange_strong(expected, 0, std::memory_order_acq_rel)) {
+            return stack;
+        }
+        while (g_stack.done.load(std::memory_order_acquire) != seq) {
+            ::usleep(100);
+        }
+    }
+
+    // 信号到达之前这一轮循环已经结束 调用栈与阻塞无关
+    int depth = g_stack.depth;
+    if (depth <= kSkipFrames || g_stack.iteration != iteration) {
+        return stack;
+    }
+    char** symbols = ::backtrace_symbols(g_stack.frames + kSkipFrames, depth - kSkipFrames);
+    if (symbols == nullptr) {
+        return stack;
+    }
+    for (int i = 0; i < depth - kSkipFrames; ++i) {
+        stack.push_back(symbols[i]);
+    }
+    ::free(symbols);
+    return stack;
+}
@@ -93,6 +93,8 @@ void RpcChannelImpl::CallMethod(
     InetAddress serverAddr(port, ip);
 
     TcpClient client(&loop_, serverAddr, "RpcChannelImpl");
+    // 每次调用都建立新连接 请求随SYN一起发出可以节省一次往返
+    client.setFastOpen(true);
     client.setConnectionCallback(std::bind(&RpcChannelImpl::onConnection, this, std::placeholders::_1));
     client.setMessageCallback(std::bind(&RpcChannelImpl::onMessage, this,
         std::placeholders::_1, std::placeholders::_2,
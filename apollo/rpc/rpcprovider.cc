@@ -1,4 +1,5 @@
 #include "rpcprovider.h"
+#include "computethreadpool.h"
 #include "configparser.h"
 #include "log.h"
 #include "rpcheader.pb.h"
@@ -8,9 +9,11 @@
 using namespace apollo;
 using namespace google::protobuf;
 
+const int kFastOpenQueueLen = 256; // TCP Fast Open请求队列长度
 
 RpcProvider::RpcProvider()
-    : loop_(new EventLoop) {}
+    : loop_(new EventLoop)
+    , computePool_(new ComputeThreadPool("RpcCompute")) {}
 
 RpcProvider::~RpcProvider() {}
 
@@ -37,6 +40,11 @@ void RpcProvider::notifyService(Service* service)
     LOG_FMT_INFO(g_rpclogger, "publish servic: [%s][%d]", serviceName.c_str(), methondCnt);
 }
 
+void RpcProvider::setComputeThreadNum(int numThreads)
+{
+    computePool_->setThreadNum(numThreads);
+}
+
 void RpcProvider::run()
 {
     auto rpcNode = ConfigParser::getInstance()->rpcNodeConfig();
@@ -52,6 +60,8 @@ void RpcProvider::run()
         std::placeholders::_3));
 
     server.setThreadNum(rpcNode.threadNum);
+    // RpcChannelImpl每次调用都建立新连接 以TCP Fast Open接收随SYN到达的请求
+    server.setFastOpen(kFastOpenQueueLen);
 
     ZkClient zkCli;
     zkCli.start();
@@ -77,6 +87,7 @@ void RpcProvider::run()
         rpcNode.ip.c_str(), rpcNode.port);
 
     // 启动网络服务
+    computePool_->start();
     server.start();
     loop_->loop();
 }
@@ -157,10 +168,14 @@ void RpcProvider::onMessage(const TcpConnectionPtr& conn,
 
     // 根据远端RPC请求 调用当前RPC节点上发布的方法
     Message* response = service->GetResponsePrototype(methodDesc).New();
+    // 回调对象按值保存参数 服务方法可能在计算线程中执行 因此需要持有连接而不是其引用
     Closure* done     = NewCallback<RpcProvider,
-        const TcpConnectionPtr&, Message*>(
+        TcpConnectionPtr, Message*>(
         this, &RpcProvider::sendRpcResponse, conn, response);
-    service->CallMethod(methodDesc, nullptr, request, response, done);
+    // 未设置计算线程时线程池直接在当前IO线程中执行
+    computePool_->post([service, methodDesc, request, response, done] {
+        service->CallMethod(methodDesc, nullptr, request, response, done);
+    });
 
 
 
@@ -168,13 +183,13 @@ void RpcProvider::onMessage(const TcpConnectionPtr& conn,
 
 }
 
-void RpcProvider::sendRpcResponse(const TcpConnectionPtr& conn, Message* response) 
+void RpcProvider::sendRpcResponse(TcpConnectionPtr conn, Message* response) 
 {
     LOG_INFO(g_rpclogger) << "send rpc response";
 
     std::string responseStr;
     if (response->SerializeToString(&responseStr)) {
-        // 通过网络将RPC方法执行的结果发送回RPC的调用方
+        // 通过网络将RPC方法执行的结果发送回RPC的调用方 send可在计算线程中调用
         conn->send(responseStr);
     } else {
         LOG_ERROR(g_rpclogger) << "failed to serial string";
@@ -0,0 +1,231 @@
+/**
+ * @file benchmark.cc
+ * @brief 微基准测试的运行与统计
+ *
+ * Usage: ./net_bench [-f filter] [-n samples] [-t min sample ms] [-w warmup samples] [-j] [-o file] [-l]
+ * 每个基准先校准单次采样的迭代次数，使一次采样至少持续指定的时间，
+ * 然后进行预热和多次采样，按学生t分布计算每次操作耗时均值的95%置信区间
+ */
+#include "benchmark.h"
+#include "log.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <stdio.h>
+#include <unistd.h>
+using namespace apollo;
+using namespace apollo::bench;
+
+#ifndef APOLLO_BENCH_BUILD_TYPE
+#define APOLLO_BENCH_BUILD_TYPE "unknown"
+#endif
+
+namespace
+{
+// 按名称排序的基准函数集合
+std::map<std::string, BenchmarkFunc>& registry() {
+    static std::map<std::string, BenchmarkFunc> benchmarks;
+    return benchmarks;
+}
+
+// 运行参数
+struct Options {
+    std::string filter;                  // 只运行名称中包含该字符串的基准
+    int         samples       = 30;      // 采样次数
+    double      minSampleTime = 0.01;    // 单次采样的最短时间 单位为秒
+    int         warmup        = 2;       // 预热的采样次数
+    bool        json          = false;   // 是否以JSON格式输出
+    std::string output;                  // 结果输出的文件 为空则输出到标准输出
+    bool        list          = false;   // 只列出基准名称
+};
+
+// 单个基准的统计结果 耗时的单位均为纳秒每次操作
+struct Result {
+    std::string name;
+    int64_t     iterations; // 每次采样的迭代次数
+    int         samples;    // 采样次数
+    double      mean;
+    double      stddev;
+    double      ciLow;      // 95%置信区间下界
+    double      ciHigh;     // 95%置信区间上界
+    double      median;
+    double      min;
+    double      max;
+};
+
+// 自由度为df时学生t分布的双侧95%分位数
+double tQuantile95(int df) {
+    static const double table[] = {
+        12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+        2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+        2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+    };
+    if (df <= 0) {
+        return 0.0;
+    }
+    if (df <= 30) {
+        return table[df - 1];
+    }
+    // 自由度较大时近似为正态分布
+    return df <= 60 ? 2.000 : 1.960;
+}
+
+// 校准迭代次数 使一次采样至少持续minSampleTime秒
+int64_t calibrate(const BenchmarkFunc& func, double minSampleTime) {
+    const double  target = minSampleTime * 1e9;
+    const int64_t kMaxIterations = int64_t(1) << 30;
+
+    int64_t iterations = 1;
+    for (;;) {
+        double elapsed = func(iterations);
+        if (elapsed >= target || iterations >= kMaxIterations) {
+            return iterations;
+        }
+        // 根据本次耗时估算所需的迭代次数 留出余量并限制增长速度
+        double  estimate = elapsed > 0 ? target / elapsed * iterations * 1.2 : iterations * 10.0;
+        int64_t next     = static_cast<int64_t>(std::min(estimate, iterations * 10.0));
+        iterations       = std::min(std::max(next, iterations + 1), kMaxIterations);
+    }
+}
+
+Result run(const std::string& name, const BenchmarkFunc& func, const Options& opts) {
+    Result result;
+    result.name       = name;
+    result.iterations = calibrate(func, opts.minSampleTime);
+    result.samples    = opts.samples;
+
+    for (int i = 0; i < opts.warmup; ++i) {
+        func(result.iterations);
+    }
+
+    std::vector<double> samples;
+    samples.reserve(opts.samples);
+    for (int i = 0; i < opts.samples; ++i) {
+        samples.push_back(func(result.iterations) / result.iterations);
+    }
+
+    double sum = 0;
+    for (double s : samples) {
+        sum += s;
+    }
+    result.mean = sum / samples.size();
+
+    double squares = 0;
+    for (double s : samples) {
+        squares += (s - result.mean) * (s - result.mean);
+    }
+    result.stddev = samples.size() > 1 ? std::sqrt(squares / (samples.size() - 1)) : 0.0;
+
+    double halfWidth = tQuantile95(static_cast<int>(samples.size()) - 1)
+        * result.stddev / std::sqrt(static_cast<double>(samples.size()));
+    result.ciLow  = result.mean - halfWidth;
+    result.ciHigh = result.mean + halfWidth;
+
+    std::sort(samples.begin(), samples.end());
+    size_t mid    = samples.size() / 2;
+    result.median = samples.size() % 2 ? samples[mid] : (samples[mid - 1] + samples[mid]) / 2;
+    result.min    = samples.front();
+    result.max    = samples.back();
+    return result;
+}
+
+void printText(std::ostream& os, const Result& r) {
+    char buf[256] = { 0 };
+    double relative = r.mean > 0 ? (r.ciHigh - r.mean) / r.mean * 100 : 0.0;
+    snprintf(buf, sizeof(buf), "%-40s %12.1f ns/op  +-%5.2f%%  median %10.1f  min %10.1f  (%d x %ld)",
+        r.name.c_str(), r.mean, relative, r.median, r.min, r.samples, r.iterations);
+    os << buf << std::endl;
+}
+
+void printJson(std::ostream& os, const std::vector<Result>& results, const Options& opts) {
+    os << "{\n"
+       << "  \"build_type\": \"" << APOLLO_BENCH_BUILD_TYPE << "\",\n"
+       << "  \"samples\": " << opts.samples << ",\n"
+       << "  \"min_sample_time\": " << opts.minSampleTime << ",\n"
+       << "  \"benchmarks\": [";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Result& r = results[i];
+        os << (i == 0 ? "\n" : ",\n")
+           << "    {\"name\": \"" << r.name << "\""
+           << ", \"iterations\": " << r.iterations
+           << ", \"samples\": " << r.samples
+           << ", \"ns_per_op\": " << r.mean
+           << ", \"stddev\": " << r.stddev
+           << ", \"ci95_low\": " << r.ciLow
+           << ", \"ci95_high\": " << r.ciHigh
+           << ", \"median\": " << r.median
+           << ", \"min\": " << r.min
+           << ", \"max\": " << r.max
+           << ", \"ops_per_sec\": " << (r.mean > 0 ? 1e9 / r.mean : 0.0)
+           << "}";
+    }
+    os << "\n  ]\n}" << std::endl;
+}
+
+void usage(const char* prog) {
+    std::cerr << "Usage: " << prog
+              << " [-f filter] [-n samples] [-t min sample ms] [-w warmup samples] [-j] [-o file] [-l]"
+              << std::endl;
+}
+}
+
+void apollo::bench::registerBenchmark(const std::string& name, BenchmarkFunc func) {
+    registry()[name] = std::move(func);
+}
+
+int main(int argc, char* argv[]) {
+    Options opts;
+    int     opt;
+    while ((opt = ::getopt(argc, argv, "f:n:t:w:jo:lh")) != -1) {
+        switch (opt) {
+        case 'f': opts.filter = optarg; break;
+        case 'n': opts.samples = std::max(2, atoi(optarg)); break;
+        case 't': opts.minSampleTime = std::max(1.0, atof(optarg)) / 1000; break;
+        case 'w': opts.warmup = std::max(0, atoi(optarg)); break;
+        case 'j': opts.json = true; break;
+        case 'o': opts.output = optarg; break;
+        case 'l': opts.list = true; break;
+        default: usage(argv[0]); return 1;
+        }
+    }
+
+    // 连接建立与销毁的日志会干扰测量
+    g_logger->setLevel(LogLevel::WARN);
+
+    std::vector<Result> results;
+    for (auto& item : registry()) {
+        if (item.first.find(opts.filter) == std::string::npos) {
+            continue;
+        }
+        if (opts.list) {
+            std::cout << item.first << std::endl;
+            continue;
+        }
+        results.push_back(run(item.first, item.second, opts));
+        // 结果输出到别处时 文本格式逐条输出到标准错误 便于观察进度
+        printText(opts.json || !opts.output.empty() ? std::cerr : std::cout, results.back());
+    }
+    if (opts.list) {
+        return 0;
+    }
+
+    std::ofstream file;
+    if (!opts.output.empty()) {
+        file.open(opts.output);
+        if (!file) {
+            std::cerr << "can not open " << opts.output << std::endl;
+            return 1;
+        }
+    }
+    std::ostream& os = opts.output.empty() ? std::cout : file;
+    if (opts.json) {
+        printJson(os, results, opts);
+    } else if (!opts.output.empty()) {
+        for (const Result& r : results) {
+            printText(os, r);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,78 @@
+/**
+ * @file benchmark.h
+ * @brief 网络库核心组件的微基准测试框架
+ * @details 每个基准函数执行指定次数的被测操作并返回耗时，框架负责校准迭代次数、
+ * 预热以及多次采样，最终给出每次操作耗时的均值、中位数和95%置信区间，
+ * 结果可以输出为文本或者JSON，便于比较修改前后的性能差异。
+ */
+#ifndef __APOLLO_BENCH_BENCHMARK_H__
+#define __APOLLO_BENCH_BENCHMARK_H__
+
+#include <chrono>
+#include <functional>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace apollo
+{
+namespace bench
+{
+/**
+ * @brief 基准函数
+ * @details 执行iterations次被测操作，返回被测部分的耗时，单位为纳秒。
+ * 准备和清理工作不应计入返回的耗时
+ */
+using BenchmarkFunc = std::function<double(int64_t iterations)>;
+
+//注册基准函数，名称采用 组件/操作/参数 的形式，例如 buffer/append/64
+void registerBenchmark(const std::string& name, BenchmarkFunc func);
+
+//在静态初始化阶段注册基准函数
+struct Registrar {
+    Registrar(const std::string& name, BenchmarkFunc func) {
+        registerBenchmark(name, std::move(func));
+    }
+};
+
+//计时器，用于在基准函数中测量被测部分的耗时
+class Stopwatch
+{
+public:
+    Stopwatch()
+        : start_(std::chrono::steady_clock::now()) { }
+
+    //重新开始计时
+    void restart() { start_ = std::chrono::steady_clock::now(); }
+
+    //返回开始计时以来经过的纳秒数
+    double elapsedNanos() const {
+        return std::chrono::duration<double, std::nano>(
+            std::chrono::steady_clock::now() - start_).count();
+    }
+
+private:
+    std::chrono::steady_clock::time_point start_;
+};
+
+//阻止编译器将结果未被使用的计算优化掉
+template <typename T>
+inline void doNotOptimize(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+}
+}
+
+#define APOLLO_BENCH_CONCAT_IMPL(a, b) a##b
+#define APOLLO_BENCH_CONCAT(a, b) APOLLO_BENCH_CONCAT_IMPL(a, b)
+
+/**
+ * @brief 注册基准函数
+ *
+ * @param name 基准名称
+ * @param func 可转换为BenchmarkFunc的可调用对象
+ */
+#define APOLLO_BENCHMARK(name, func) \
+    static apollo::bench::Registrar APOLLO_BENCH_CONCAT(s_registrar_, __LINE__)(name, func)
+
+#endif
@@ -0,0 +1,95 @@
+/**
+ * @file buffer_bench.cc
+ * @brief Buffer的追加、取出以及从文件描述符读取数据的基准测试
+ */
+#include "benchmark.h"
+#include "buffer.h"
+#include <fcntl.h>
+#include <unistd.h>
+using namespace apollo;
+using namespace apollo::bench;
+
+namespace
+{
+// 持续追加数据 缓冲区超过1MB后清空 包含扩容与移动数据的开销
+double appendOnly(size_t size, int64_t iterations) {
+    std::string data(size, 'x');
+    Buffer      buf;
+
+    Stopwatch watch;
+    for (int64_t i = 0; i < iterations; ++i) {
+        buf.append(data);
+        if (buf.readableBytes() > 1024 * 1024) {
+            buf.retrieveAll();
+        }
+    }
+    doNotOptimize(buf.peek());
+    return watch.elapsedNanos();
+}
+
+// 追加后立即取出相同长度的数据 模拟收发平衡时的稳态
+double appendRetrieve(size_t size, int64_t iterations) {
+    std::string data(size, 'x');
+    Buffer      buf;
+
+    Stopwatch watch;
+    for (int64_t i = 0; i < iterations; ++i) {
+        buf.append(data);
+        buf.retrieve(size);
+    }
+    doNotOptimize(buf.peek());
+    return watch.elapsedNanos();
+}
+
+// 长度前缀消息的编码与解码
+double int32Frame(size_t size, int64_t iterations) {
+    std::string data(size, 'x');
+    Buffer      buf;
+
+    Stopwatch watch;
+    for (int64_t i = 0; i < iterations; ++i) {
+        buf.appendInt32(static_cast<int32_t>(size));
+        buf.append(data);
+        int32_t len = buf.readInt32();
+        doNotOptimize(buf.peek());
+        buf.retrieve(len);
+    }
+    return watch.elapsedNanos();
+}
+
+// 每次迭代先向管道写入size字节 再由readFd读出 耗时包含写入管道的系统调用
+double readFd(size_t size, int64_t iterations) {
+    int fds[2];
+    if (::pipe2(fds, O_NONBLOCK) < 0) {
+        return 0;
+    }
+    ::fcntl(fds[1], F_SETPIPE_SZ, 1024 * 1024);
+
+    std::string data(size, 'x');
+    Buffer      buf;
+    int         saveErrno = 0;
+
+    Stopwatch watch;
+    for (int64_t i = 0; i < iterations; ++i) {
+        ssize_t n = ::write(fds[1], data.data(), data.size());
+        doNotOptimize(n);
+        buf.readFd(fds[0], saveErrno);
+        buf.retrieveAll();
+    }
+    double elapsed = watch.elapsedNanos();
+
+    ::close(fds[0]);
+    ::close(fds[1]);
+    return elapsed;
+}
+}
+
+using std::placeholders::_1;
+APOLLO_BENCHMARK("buffer/append/16", std::bind(appendOnly, 16, _1));
+APOLLO_BENCHMARK("buffer/append/256", std::bind(appendOnly, 256, _1));
+APOLLO_BENCHMARK("buffer/append/4096", std::bind(appendOnly, 4096, _1));
+APOLLO_BENCHMARK("buffer/append_retrieve/64", std::bind(appendRetrieve, 64, _1));
+APOLLO_BENCHMARK("buffer/append_retrieve/1024", std::bind(appendRetrieve, 1024, _1));
+APOLLO_BENCHMARK("buffer/int32_frame/64", std::bind(int32Frame, 64, _1));
+APOLLO_BENCHMARK("buffer/readFd/1024", std::bind(readFd, 1024, _1));
+APOLLO_BENCHMARK("buffer/readFd/65536", std::bind(readFd, 65536, _1));
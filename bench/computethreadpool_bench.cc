@@ -0,0 +1,105 @@
+/**
+ * @file computethreadpool_bench.cc
+ * @brief 计算线程池的基准测试：任务吞吐以及从事件循环卸载任务再返回的往返延迟
+ */
+#include "benchmark.h"
+#include "computethreadpool.h"
+#include "eventloop.h"
+#include "eventloopthread.h"
+#include <atomic>
+#include <future>
+using namespace apollo;
+using namespace apollo::bench;
+
+namespace
+{
+EventLoop* benchLoop() {
+    static EventLoopThread thread(EventLoopThread::ThreadInitCallback(), "bench-compute");
+    static EventLoop*      loop = thread.startLoop();
+    return loop;
+}
+
+// 执行spin次空循环 模拟计算任务
+void spinWork(int spin) {
+    for (int i = 0; i < spin; ++i) {
+        doNotOptimize(i);
+    }
+}
+
+/**
+ * @brief 从外部线程提交iterations个任务并等待全部执行完毕
+ *
+ * @param threads 工作线程数目
+ * @param spin 每个任务的计算量
+ * @param iterations 任务数目
+ */
+double postThroughput(int threads, int spin, int64_t iterations) {
+    ComputeThreadPool pool("bench-pool");
+    pool.setThreadNum(threads);
+    pool.start();
+
+    std::atomic<int64_t> finished(0);
+    Stopwatch            watch;
+    for (int64_t i = 0; i < iterations; ++i) {
+        pool.post([spin, &finished] {
+            spinWork(spin);
+            finished.fetch_add(1, std::memory_order_release);
+        });
+    }
+    while (finished.load(std::memory_order_acquire) < iterations) {
+    }
+    return watch.elapsedNanos();
+}
+
+// 计算量不均的任务由一个工作线程递归派生 其余线程只能通过窃取获得任务
+double stealFanout(int threads, int64_t iterations) {
+    ComputeThreadPool pool("bench-pool");
+    pool.setThreadNum(threads);
+    pool.start();
+
+    std::atomic<int64_t> finished(0);
+    Stopwatch            watch;
+    pool.post([&pool, &finished, iterations] {
+        for (int64_t i = 0; i < iterations; ++i) {
+            pool.post([i, &finished] {
+                spinWork(i % 8 == 0 ? 20000 : 500);
+                finished.fetch_add(1, std::memory_order_release);
+            });
+        }
+    });
+    while (finished.load(std::memory_order_acquire) < iterations) {
+    }
+    return watch.elapsedNanos();
+}
+
+// 在事件循环中逐个卸载任务 测量回到事件循环的往返延迟
+double postAndContinue(int64_t iterations) {
+    ComputeThreadPool pool("bench-pool");
+    pool.setThreadNum(2);
+    pool.start();
+
+    EventLoop*           loop = benchLoop();
+    std::promise<void>   done;
+    int64_t              completed = 0;
+    std::function<void()> next;
+    next = [&] {
+        if (completed++ == iterations) {
+            done.set_value();
+            return;
+        }
+        pool.postAndContinue(loop, [] {}, next);
+    };
+
+    Stopwatch watch;
+    loop->runInLoop(next);
+    done.get_future().wait();
+    return watch.elapsedNanos();
+}
+}
+
+using std::placeholders::_1;
+APOLLO_BENCHMARK("compute/post/1", std::bind(postThroughput, 1, 0, _1));
+APOLLO_BENCHMARK("compute/post/4", std::bind(postThroughput, 4, 0, _1));
+APOLLO_BENCHMARK("compute/post_spin1000/4", std::bind(postThroughput, 4, 1000, _1));
+APOLLO_BENCHMARK("compute/steal_fanout/4", std::bind(stealFanout, 4, _1));
+APOLLO_BENCHMARK("compute/post_and_continue", postAndContinue);
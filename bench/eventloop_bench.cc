@@ -0,0 +1,207 @@
+/**
+ * @file eventloop_bench.cc
+ * @brief 事件循环相关的基准测试：跨线程queueInLoop、定时器队列以及Channel事件分发
+ */
+#include "benchmark.h"
+#include "channel.h"
+#include "eventloop.h"
+#include "eventloopthread.h"
+#include "future.h"
+#include <atomic>
+#include <future>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <vector>
+using namespace apollo;
+using namespace apollo::bench;
+
+namespace
+{
+// 所有基准共用的事件循环线程
+EventLoop* benchLoop() {
+    static EventLoopThread thread(EventLoopThread::ThreadInitCallback(), "bench-loop");
+    static EventLoop*      loop = thread.startLoop();
+    return loop;
+}
+
+// 在事件循环线程中执行func并等待其返回
+double runInBenchLoop(const std::function<double()>& func) {
+    std::promise<double> done;
+    benchLoop()->runInLoop([&] { done.set_value(func()); });
+    return done.get_future().get();
+}
+
+// 逐个投递回调并等待其执行 测量从投递到在事件循环中执行的往返延迟
+double queueInLoopLatency(int64_t iterations) {
+    EventLoop*       loop = benchLoop();
+    std::atomic_bool done(false);
+
+    Stopwatch watch;
+    for (int64_t i = 0; i < iterations; ++i) {
+        done.store(false, std::memory_order_relaxed);
+        loop->queueInLoop([&done] { done.store(true, std::memory_order_release); });
+        while (!done.load(std::memory_order_acquire)) {
+        }
+    }
+    return watch.elapsedNanos();
+}
+
+// 连续投递回调 测量事件循环批量执行回调的吞吐
+double queueInLoopThroughput(int64_t iterations) {
+    EventLoop*          loop = benchLoop();
+    std::atomic<int64_t> executed(0);
+
+    Stopwatch watch;
+    for (int64_t i = 0; i < iterations; ++i) {
+        loop->queueInLoop([&executed] { executed.fetch_add(1, std::memory_order_release); });
+    }
+    while (executed.load(std::memory_order_acquire) < iterations) {
+    }
+    return watch.elapsedNanos();
+}
+
+// 逐个在事件循环中执行并经then返回结果 测量Future往返的开销
+double futureThen(int64_t iterations) {
+    EventLoop* loop = benchLoop();
+
+    Stopwatch watch;
+    for (int64_t i = 0; i < iterations; ++i) {
+        Future<int64_t> f = runInLoopAsync(loop, [i] { return i; }).then(nullptr, [](int64_t v) { return v + 1; });
+        doNotOptimize(f.get());
+    }
+    return watch.elapsedNanos();
+}
+
+// 在已有scale个定时器的队列中添加并立即取消定时器
+double timerAddCancel(int64_t scale, int64_t iterations) {
+    return runInBenchLoop([scale, iterations] {
+        EventLoop*           loop = benchLoop();
+        std::vector<TimerId> background;
+        background.reserve(scale);
+        for (int64_t i = 0; i < scale; ++i) {
+            background.push_back(loop->runAfter(3600 + i * 1e-3, [] {}));
+        }
+
+        Stopwatch watch;
+        for (int64_t i = 0; i < iterations; ++i) {
+            TimerId id = loop->runAfter(1800 + i * 1e-6, [] {});
+            loop->cancel(id);
+        }
+        double elapsed = watch.elapsedNanos();
+
+        for (const TimerId& id : background) {
+            loop->cancel(id);
+        }
+        return elapsed;
+    });
+}
+
+// 同时到期iterations个定时器 测量从第一个回调到最后一个回调的耗时
+double timerExpire(int64_t iterations) {
+    std::promise<double> done;
+    int64_t              fired = 0;
+    Stopwatch            watch;
+
+    // 回调都在事件循环线程中执行 无需同步
+    benchLoop()->runInLoop([&] {
+        EventLoop* loop = benchLoop();
+        Timestamp  when = Timestamp::now();
+        for (int64_t i = 0; i < iterations; ++i) {
+            loop->runAt(when, [&] {
+                if (fired++ == 0) {
+                    watch.restart();
+                }
+                if (fired == iterations) {
+                    done.set_value(watch.elapsedNanos());
+                }
+            });
+        }
+    });
+    return done.get_future().get();
+}
+
+// 直接调用Channel::handleEvent 测量单次分发的开销
+double channelHandleEvent(bool tied, int64_t iterations) {
+    int64_t readCount = 0;
+    Channel channel(benchLoop(), -1);
+    channel.setReadCallback([&readCount](Timestamp) { ++readCount; });
+    channel.setRevents(EPOLLIN);
+
+    std::shared_ptr<int> owner = std::make_shared<int>(0);
+    if (tied) {
+        channel.tie(owner);
+    }
+
+    Timestamp now = Timestamp::now();
+    Stopwatch watch;
+    for (int64_t i = 0; i < iterations; ++i) {
+        channel.handleEvent(now);
+    }
+    doNotOptimize(readCount);
+    return watch.elapsedNanos();
+}
+
+// 一次性触发count个eventfd 测量每个Channel经过Poller分发到读回调的平均开销
+double channelDispatch(int count, int64_t iterations) {
+    EventLoop*           loop = benchLoop();
+    std::vector<int>     fds;
+    std::vector<Channel*> channels;
+    std::atomic<int64_t> handled(0);
+
+    runInBenchLoop([&] {
+        for (int i = 0; i < count; ++i) {
+            int      fd      = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            Channel* channel = new Channel(loop, fd);
+            channel->setReadCallback([fd, &handled](Timestamp) {
+                uint64_t value = 0;
+                ssize_t  n     = ::read(fd, &value, sizeof(value));
+                doNotOptimize(n);
+                handled.fetch_add(1, std::memory_order_release);
+            });
+            channel->enableReading();
+            fds.push_back(fd);
+            channels.push_back(channel);
+        }
+        return 0.0;
+    });
+
+    const uint64_t one = 1;
+    Stopwatch      watch;
+    for (int64_t sent = 0; sent < iterations;) {
+        int64_t batch = std::min<int64_t>(count, iterations - sent);
+        for (int64_t i = 0; i < batch; ++i) {
+            ssize_t n = ::write(fds[i], &one, sizeof(one));
+            doNotOptimize(n);
+        }
+        sent += batch;
+        while (handled.load(std::memory_order_acquire) < sent) {
+        }
+    }
+    double elapsed = watch.elapsedNanos();
+
+    runInBenchLoop([&] {
+        for (size_t i = 0; i < channels.size(); ++i) {
+            channels[i]->disableAll();
+            channels[i]->remove();
+            delete channels[i];
+            ::close(fds[i]);
+        }
+        return 0.0;
+    });
+    return elapsed;
+}
+}
+
+using std::placeholders::_1;
+APOLLO_BENCHMARK("loop/queueInLoop_latency", queueInLoopLatency);
+APOLLO_BENCHMARK("loop/queueInLoop_throughput", queueInLoopThroughput);
+APOLLO_BENCHMARK("loop/future_then", futureThen);
+APOLLO_BENCHMARK("timer/add_cancel/0", std::bind(timerAddCancel, 0, _1));
+APOLLO_BENCHMARK("timer/add_cancel/10000", std::bind(timerAddCancel, 10000, _1));
+APOLLO_BENCHMARK("timer/add_cancel/100000", std::bind(timerAddCancel, 100000, _1));
+APOLLO_BENCHMARK("timer/expire", timerExpire);
+APOLLO_BENCHMARK("channel/handleEvent", std::bind(channelHandleEvent, false, _1));
+APOLLO_BENCHMARK("channel/handleEvent_tied", std::bind(channelHandleEvent, true, _1));
+APOLLO_BENCHMARK("channel/dispatch/1", std::bind(channelDispatch, 1, _1));
+APOLLO_BENCHMARK("channel/dispatch/64", std::bind(channelDispatch, 64, _1));
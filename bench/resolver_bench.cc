@@ -0,0 +1,74 @@
+/**
+ * @file resolver_bench.cc
+ * @brief 域名解析相关的基准测试：解析/etc/hosts中的名称以及命中缓存的解析
+ * @details 解析的是localhost，由/etc/hosts提供，不依赖网络和DNS服务器，
+ * 测量的是线程池中getaddrinfo加上结果回到事件循环的往返开销
+ */
+#include "benchmark.h"
+#include "eventloop.h"
+#include "eventloopthread.h"
+#include "resolver.h"
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+using namespace apollo;
+using namespace apollo::bench;
+
+namespace
+{
+const char* const kHostsName = "localhost"; // /etc/hosts中的名称
+
+// 所有基准共用的事件循环线程和解析器
+EventLoop* resolverLoop() {
+    static EventLoopThread thread(EventLoopThread::ThreadInitCallback(), "resolver-bench");
+    static EventLoop*      loop = thread.startLoop();
+    return loop;
+}
+
+Resolver& benchResolver() {
+    static Resolver resolver;
+    return resolver;
+}
+
+// 解析一次并等待回调在事件循环中执行
+void resolveAndWait(Resolver& resolver) {
+    std::atomic_bool done(false);
+    resolver.resolve(resolverLoop(), kHostsName, 80, [&done](const std::vector<InetAddress>& addrs) {
+        if (addrs.empty()) {
+            fprintf(stderr, "failed to resolve %s\n", kHostsName);
+            abort();
+        }
+        done.store(true, std::memory_order_release);
+    });
+    while (!done.load(std::memory_order_acquire)) {
+    }
+}
+
+// 每次解析前清空缓存 测量经过getaddrinfo读取/etc/hosts的解析
+double hostsLookup(int64_t iterations) {
+    Resolver& resolver = benchResolver();
+
+    Stopwatch watch;
+    for (int64_t i = 0; i < iterations; ++i) {
+        resolver.clearCache();
+        resolveAndWait(resolver);
+    }
+    return watch.elapsedNanos();
+}
+
+// 预先解析一次 测量命中缓存时从调用到回调执行的开销
+double cacheHit(int64_t iterations) {
+    Resolver& resolver = benchResolver();
+    resolver.clearCache();
+    resolveAndWait(resolver);
+
+    Stopwatch watch;
+    for (int64_t i = 0; i < iterations; ++i) {
+        resolveAndWait(resolver);
+    }
+    return watch.elapsedNanos();
+}
+}
+
+APOLLO_BENCHMARK("resolver/hosts_lookup", hostsLookup);
+APOLLO_BENCHMARK("resolver/cache_hit", cacheHit);
@@ -0,0 +1,102 @@
+/**
+ * @file tcpconnection_bench.cc
+ * @brief TcpConnection通过socketpair发送数据的基准测试
+ */
+#include "benchmark.h"
+#include "eventloop.h"
+#include "eventloopthread.h"
+#include "tcpconnection.h"
+#include <fcntl.h>
+#include <future>
+#include <sys/socket.h>
+#include <unistd.h>
+using namespace apollo;
+using namespace apollo::bench;
+
+namespace
+{
+EventLoop* benchLoop() {
+    static EventLoopThread thread(EventLoopThread::ThreadInitCallback(), "bench-conn");
+    static EventLoop*      loop = thread.startLoop();
+    return loop;
+}
+
+/**
+ * @brief 在事件循环线程或者调用线程中发送iterations条size字节的消息，
+ * 调用线程在socketpair的另一端阻塞读取，直到收到全部数据为止
+ *
+ * @param size 消息长度
+ * @param crossThread 是否从事件循环之外的线程调用send
+ * @param shared 是否发送共享的数据 未发送的部分只保存引用而不拷贝
+ * @param iterations 消息数目
+ */
+double sendMessages(size_t size, bool crossThread, bool shared, int64_t iterations) {
+    int fds[2];
+    if (::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0) {
+        return 0;
+    }
+    // 连接一端设为非阻塞 读取端保持阻塞
+    int flags = ::fcntl(fds[0], F_GETFL, 0);
+    ::fcntl(fds[0], F_SETFL, flags | O_NONBLOCK);
+
+    EventLoop*       loop = benchLoop();
+    TcpConnectionPtr conn = std::make_shared<TcpConnection>(loop, "bench", fds[0], InetAddress(), InetAddress());
+    conn->setConnectionCallback([](const TcpConnectionPtr&) {});
+    conn->setMessageCallback([](const TcpConnectionPtr&, Buffer* buf, Timestamp) { buf->retrieveAll(); });
+
+    std::promise<void> established;
+    loop->runInLoop([&] {
+        conn->connectEstablished();
+        established.set_value();
+    });
+    established.get_future().wait();
+
+    const std::string   message(size, 'x');
+    const SharedPayload payload = std::make_shared<const std::string>(message);
+    const int64_t     total = static_cast<int64_t>(size) * iterations;
+    std::vector<char> buf(256 * 1024);
+
+    Stopwatch watch;
+    auto sendAll = [&] {
+        for (int64_t i = 0; i < iterations; ++i) {
+            if (shared) {
+                conn->send(payload);
+            } else {
+                conn->send(message);
+            }
+        }
+    };
+    if (crossThread) {
+        sendAll();
+    } else {
+        loop->runInLoop(sendAll);
+    }
+    for (int64_t received = 0; received < total;) {
+        ssize_t n = ::read(fds[1], buf.data(), buf.size());
+        if (n <= 0) {
+            break;
+        }
+        received += n;
+    }
+    double elapsed = watch.elapsedNanos();
+
+    std::promise<void> destroyed;
+    loop->runInLoop([&] {
+        conn->connectDestoryed();
+        conn.reset();
+        destroyed.set_value();
+    });
+    destroyed.get_future().wait();
+    ::close(fds[1]);
+    return elapsed;
+}
+}
+
+using std::placeholders::_1;
+APOLLO_BENCHMARK("tcpconnection/send/64", std::bind(sendMessages, 64, false, false, _1));
+APOLLO_BENCHMARK("tcpconnection/send/4096", std::bind(sendMessages, 4096, false, false, _1));
+APOLLO_BENCHMARK("tcpconnection/send/65536", std::bind(sendMessages, 65536, false, false, _1));
+APOLLO_BENCHMARK("tcpconnection/send_cross_thread/64", std::bind(sendMessages, 64, true, false, _1));
+APOLLO_BENCHMARK("tcpconnection/send_shared/4096", std::bind(sendMessages, 4096, false, true, _1));
+APOLLO_BENCHMARK("tcpconnection/send_shared/65536", std::bind(sendMessages, 65536, false, true, _1));
+APOLLO_BENCHMARK("tcpconnection/send_shared_cross_thread/4096", std::bind(sendMessages, 4096, true, true, _1));
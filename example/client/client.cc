@@ -1,130 +1,461 @@
+/**
+ * @file client.cc
+ * @brief 回显服务器的压测客户端
+ * @details 基于TcpClient与EventLoopThreadPool，将多个连接分配到多个事件循环上，
+ * 每条消息由4字节网络字节序的长度与EchoMessage组成，支持两种压测模式：
+ * 闭环模式：每个连接保持固定数目的未完成请求（流水线深度），收到响应后立即发送下一个请求；
+ * 开环模式：按照固定的总速率以泊松过程产生请求，延迟从请求计划发出的时间开始计算，
+ * 避免服务端变慢时压测端同步放缓而低估尾延迟（coordinated omission）。
+ * 延迟以微秒为单位记录在直方图中，结束后输出吞吐量与p50/p99/p999等统计值。
+ *
+ * Usage: ./client [-a host] [-p port] [-c connections] [-t threads] [-d depth]
+ *                 [-s payload] [-r rate] [-D duration] [-w warmup] [-j]
+ * payload的格式为 fixed:N、uniform:MIN:MAX 或者 exp:MEAN，单位为字节
+ */
+#include "eventloopthreadpool.h"
+#include "histogram.h"
 #include "log.h"
 #include "qpsmsg.pb.h"
+#include "resolver.h"
 #include "tcpclient.h"
-#include <thread>
+#include <atomic>
+#include <deque>
+#include <future>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <unistd.h>
 #include <vector>
 using namespace apollo;
-using namespace std;
 
 static std::shared_ptr<apollo::Logger> biz_logger = LOG_NAME("business");
 
-struct Qps {
-    Qps() {
-        last_time = time(nullptr);
-        succ_cnt  = 0;
+static const size_t  kHeaderLen     = sizeof(int32_t);  // 消息头长度
+static const int32_t kMaxMessageLen = 64 * 1024 * 1024; // 消息的最大长度
+static const double  kTickInterval  = 0.001;            // 开环模式下产生请求的时间间隔
+
+// 压测参数
+struct Options {
+    std::string host        = "127.0.0.1"; // 服务端地址或主机名
+    uint16_t    port        = 8000;        // 服务端端口
+    int         connections = 1;           // 连接数目
+    int         threads     = 1;           // 事件循环线程数目
+    int         depth       = 1;           // 闭环模式下每个连接的流水线深度
+    std::string payload     = "fixed:16";  // 请求内容长度的分布
+    double      rate        = 0;           // 开环模式下每秒的总请求数 为0时使用闭环模式
+    double      duration    = 10;          // 压测时长 单位为秒
+    double      warmup      = 1;           // 预热时长 预热期间的延迟不计入统计
+    bool        json        = false;       // 是否以JSON格式输出结果
+};
+
+/**
+ * @brief 请求内容长度的分布
+ *
+ */
+class PayloadDistribution {
+public:
+    bool parse(const std::string& spec) {
+        std::vector<std::string> fields;
+        std::istringstream       in(spec);
+        std::string              field;
+        while (std::getline(in, field, ':')) {
+            fields.push_back(field);
+        }
+
+        if (fields.size() == 2 && fields[0] == "fixed") {
+            kind_ = kFixed;
+            a_    = atof(fields[1].c_str());
+        } else if (fields.size() == 3 && fields[0] == "uniform") {
+            kind_ = kUniform;
+            a_    = atof(fields[1].c_str());
+            b_    = atof(fields[2].c_str());
+        } else if (fields.size() == 2 && fields[0] == "exp") {
+            kind_ = kExponential;
+            a_    = atof(fields[1].c_str());
+        } else {
+            return false;
+        }
+        if (kind_ == kUniform && b_ < a_) {
+            return false;
+        }
+        return a_ >= 0;
     }
-    long last_time; // 最后一次发包时间 单位为ms
-    int  succ_cnt;  // 成功收到服务器回显的次数
+
+    size_t next(std::mt19937& rng) const {
+        double size = a_;
+        if (kind_ == kUniform) {
+            size = std::uniform_real_distribution<double>(a_, b_)(rng);
+        } else if (kind_ == kExponential && a_ > 0) {
+            size = std::exponential_distribution<double>(1.0 / a_)(rng);
+        }
+        return std::min(static_cast<size_t>(size), static_cast<size_t>(kMaxMessageLen / 2));
+    }
+
+private:
+    enum Kind {
+        kFixed,
+        kUniform,
+        kExponential
+    };
+
+    Kind   kind_ = kFixed;
+    double a_    = 0;
+    double b_    = 0;
 };
 
-class TestClinet {
+/**
+ * @brief 压测的统计结果
+ *
+ */
+struct Stats {
+    Histogram latency;   // 请求的延迟 单位为微秒
+    int64_t   completed; // 完成的请求数
+    int64_t   errors;    // 出错或者未能发出的请求数
+    int64_t   bytesOut;  // 发送的字节数
+    int64_t   bytesIn;   // 接收的字节数
+
+    Stats()
+        : completed(0)
+        , errors(0)
+        , bytesOut(0)
+        , bytesIn(0) { }
+
+    void merge(const Stats& other) {
+        latency.merge(other.latency);
+        completed += other.completed;
+        errors += other.errors;
+        bytesOut += other.bytesOut;
+        bytesIn += other.bytesIn;
+    }
+};
+
+/**
+ * @brief 一个压测连接，所有成员函数都在所属的事件循环中执行
+ *
+ */
+class Session {
 public:
-    TestClinet(EventLoop* loop, const InetAddress& listenAddr, const std::string& name)
+    Session(EventLoop* loop, Resolver* resolver, const std::string& name,
+        const Options& opts, const PayloadDistribution& payload,
+        Timestamp measureStart, std::atomic<int64_t>* progress)
         : loop_(loop)
-        , client_(loop, listenAddr, name) {
-        client_.setConnectionCallback(std::bind(&TestClinet::onConnection,
+        , client_(loop, resolver, opts.host, opts.port, name)
+        , opts_(opts)
+        , payload_(payload)
+        , rng_(std::random_device()())
+        , measureStart_(measureStart)
+        , progress_(progress)
+        , nextId_(1) {
+        client_.setConnectionCallback(std::bind(&Session::onConnection,
             this, std::placeholders::_1));
-        client_.setMessageCallback(std::bind(&TestClinet::onMessage,
-            this, std::placeholders::_1, std::placeholders::_2,
-            std::placeholders::_3, &client_));
+        client_.setMessageCallback(std::bind(&Session::onMessage,
+            this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
     }
 
-    void connect() {
+    EventLoop* loop() const { return loop_; }
+
+    // 开始连接服务端
+    void start() {
         client_.connect();
-        LOG_INFO(biz_logger) << "try connect to server";
+        if (opts_.rate > 0) {
+            // 开环模式下每个连接分担相同的请求速率
+            arrivalRate_ = opts_.rate / opts_.connections;
+            nextArrival_ = Timestamp::now();
+            tickTimer_   = loop_->runEvery(kTickInterval, std::bind(&Session::onTick, this));
+        }
+    }
+
+    // 停止压测并返回统计结果
+    const Stats& stop() {
+        if (opts_.rate > 0) {
+            loop_->cancel(tickTimer_);
+        }
+        // 连接可能在Session销毁后才关闭 替换掉指向Session的回调
+        if (conn_) {
+            conn_->setConnectionCallback(std::bind(&Session::ignoreConnection, std::placeholders::_1));
+            conn_->setMessageCallback(std::bind(&Session::ignoreMessage,
+                std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+        }
+        return stats_;
     }
 
 private:
     void onConnection(const TcpConnectionPtr& conn) {
         if (conn->connected()) {
-            LOG_INFO(biz_logger) << "connection up";
+            conn_ = conn;
+            // 闭环模式下一次性发出流水线深度个请求
+            if (opts_.rate <= 0) {
+                for (int i = 0; i < opts_.depth; ++i) {
+                    sendRequest(Timestamp::now());
+                }
+            }
+        } else {
+            LOG_FMT_WARN(biz_logger, "connection %s down", conn->name().c_str());
+            stats_.errors += static_cast<int64_t>(inflight_.size());
+            inflight_.clear();
+            conn_.reset();
+        }
+    }
 
-            qps_test::EchoMessage request;
-            request.set_id(1);
-            request.set_content("Hello apollo!!!");
+    void onMessage(const TcpConnectionPtr& conn, Buffer* buffer, Timestamp receiveTime) {
+        while (buffer->readableBytes() >= kHeaderLen) {
+            int32_t len = buffer->peekInt32();
+            if (len < 0 || len > kMaxMessageLen) {
+                LOG_FMT_ERROR(biz_logger, "invalid message length: %d", len);
+                conn->shutdown();
+                return;
+            }
+            if (buffer->readableBytes() < kHeaderLen + len) {
+                return;
+            }
+            buffer->retrieve(kHeaderLen);
 
-            // 序列化数据
-            std::string requestStr;
-            request.SerializeToString(&requestStr);
+            qps_test::EchoMessage response;
+            if (!response.ParseFromArray(buffer->peek(), len)) {
+                ++stats_.errors;
+            }
+            buffer->retrieve(len);
+            stats_.bytesIn += kHeaderLen + len;
 
-            // 发送数据包
-            conn->send(requestStr);
-        } else {
-            LOG_INFO(biz_logger) << "connection down";
-            // loop_->quit();
+            // 服务端按照请求的顺序返回响应
+            if (inflight_.empty()) {
+                ++stats_.errors;
+                continue;
+            }
+            Timestamp intended = inflight_.front();
+            inflight_.pop_front();
+
+            Timestamp now(Timestamp::now());
+            if (!(intended < measureStart_)) {
+                stats_.latency.record(now.microSecondsSinceEpoch() - intended.microSecondsSinceEpoch());
+                ++stats_.completed;
+                progress_->fetch_add(1, std::memory_order_relaxed);
+            }
+
+            if (opts_.rate <= 0) {
+                sendRequest(now);
+            }
         }
     }
 
-    void onMessage(const TcpConnectionPtr& conn, Buffer* buffer, Timestamp receiveTime, TcpClient* client) {
-        qps_test::EchoMessage response, request;
+    // 开环模式下按照泊松过程发出到期的请求
+    void onTick() {
+        Timestamp now(Timestamp::now());
+        std::exponential_distribution<double> interval(arrivalRate_);
+        while (!(now < nextArrival_)) {
+            sendRequest(nextArrival_);
+            nextArrival_ = addTime(nextArrival_, interval(rng_));
+        }
+    }
 
-        // 解析服务器发来的数据包
-        std::string message(buffer->retrieveAllAsString());
-        if (!response.ParseFromString(message)) {
-            LOG_FMT_ERROR(biz_logger, "failed to parse receive msg: %s", message.c_str());
+    /**
+     * @brief 发送一个请求
+     *
+     * @param intended 请求计划发出的时间，延迟从此时开始计算
+     */
+    void sendRequest(Timestamp intended) {
+        if (!conn_ || !conn_->connected()) {
+            if (!(intended < measureStart_)) {
+                ++stats_.errors;
+            }
             return;
         }
 
-        // 判断数据内容是否一致
-        if (response.content() == "Hello apollo!!!") {
-            // 服务器请求响应成功一次
-            qps_.succ_cnt++;
+        qps_test::EchoMessage request;
+        request.set_id(nextId_++);
+        request.set_content(std::string(payload_.next(rng_), 'x'));
+
+        std::string body;
+        request.SerializeToString(&body);
+
+        Buffer frame;
+        frame.appendInt32(static_cast<int32_t>(body.size()));
+        frame.append(body);
+        stats_.bytesOut += frame.readableBytes();
+
+        inflight_.push_back(intended);
+        conn_->send(frame.retrieveAllAsString());
+    }
+
+    static void ignoreConnection(const TcpConnectionPtr& conn) { }
+
+    static void ignoreMessage(const TcpConnectionPtr& conn, Buffer* buffer, Timestamp receiveTime) {
+        buffer->retrieveAll();
+    }
+
+private:
+    EventLoop*                 loop_;         // 所属的事件循环
+    TcpClient                  client_;       // 客户端
+    const Options&             opts_;         // 压测参数
+    const PayloadDistribution& payload_;      // 请求内容长度的分布
+    std::mt19937               rng_;          // 随机数生成器
+    Timestamp                  measureStart_; // 开始统计的时间
+    std::atomic<int64_t>*      progress_;     // 所有连接完成的请求数
+
+    TcpConnectionPtr      conn_;        // 当前的连接
+    std::deque<Timestamp> inflight_;    // 未完成请求的计划发出时间
+    uint32_t              nextId_;      // 下一个请求ID
+    double                arrivalRate_; // 开环模式下每秒的请求数
+    Timestamp             nextArrival_; // 开环模式下下一个请求的计划发出时间
+    TimerId               tickTimer_;   // 开环模式下产生请求的定时器
+    Stats                 stats_;       // 统计结果
+};
+
+/**
+ * @brief 压测客户端，管理所有的连接并汇总统计结果
+ *
+ */
+class LoadGenerator {
+public:
+    LoadGenerator(EventLoop* loop, const Options& opts, const PayloadDistribution& payload)
+        : loop_(loop)
+        , opts_(opts)
+        , payload_(payload)
+        , threadPool_(loop, "LoadGenerator")
+        , progress_(0)
+        , lastProgress_(0) {
+        threadPool_.setThreadNum(opts.threads);
+    }
+
+    void start() {
+        threadPool_.start();
+        startTime_    = Timestamp::now();
+        measureStart_ = addTime(startTime_, opts_.warmup);
+
+        // 所有连接共用一次解析结果
+        for (int i = 0; i < opts_.connections; ++i) {
+            EventLoop* ioLoop = threadPool_.getNextLoop();
+            sessions_.emplace_back(new Session(ioLoop, &resolver_, "LoadGenerator#" + std::to_string(i),
+                opts_, payload_, measureStart_, &progress_));
+            ioLoop->runInLoop(std::bind(&Session::start, sessions_.back().get()));
         }
 
-        long curr_time = time(nullptr);
-        if (curr_time - qps_.last_time >= 1) {
-            std::cout << ">>> QPS = " << qps_.succ_cnt << " <<<\n";
-            qps_.last_time = curr_time;
-            qps_.succ_cnt  = 0;
+        loop_->runEvery(1.0, std::bind(&LoadGenerator::report, this));
+        loop_->runAfter(opts_.warmup + opts_.duration, std::bind(&LoadGenerator::finish, this));
+    }
+
+private:
+    // 每秒输出一次吞吐量
+    void report() {
+        int64_t progress = progress_.load(std::memory_order_relaxed);
+        if (!opts_.json) {
+            std::cerr << ">>> " << progress - lastProgress_ << " req/s <<<\n";
         }
+        lastProgress_ = progress;
+    }
 
-        // 给服务端发送新的请求
-        request.set_id(response.id() + 1);
-        request.set_content(response.content());
+    // 在各个连接所属的事件循环中停止压测并汇总结果
+    void finish() {
+        Stats                          total;
+        std::mutex                     mtx;
+        std::vector<std::future<void>> done;
+        for (auto& session : sessions_) {
+            std::shared_ptr<std::promise<void>> promise(new std::promise<void>);
+            done.push_back(promise->get_future());
+            Session* s = session.release();
+            s->loop()->runInLoop([s, promise, &total, &mtx]() {
+                {
+                    std::lock_guard<std::mutex> locker(mtx);
+                    total.merge(s->stop());
+                }
+                delete s;
+                promise->set_value();
+            });
+        }
+        for (auto& future : done) {
+            future.wait();
+        }
+        sessions_.clear();
 
-        std::string requestStr;
-        request.SerializeToString(&requestStr);
-        conn->send(requestStr);
+        print(total);
+        loop_->quit();
+    }
 
-        // LOG_FMT_INFO(biz_logger, "reve message: %s", message.c_str());
-        // client->disconnect();
+    void print(const Stats& stats) {
+        double             seconds = opts_.duration;
+        const Histogram&   latency = stats.latency;
+        std::ostringstream out;
+        if (opts_.json) {
+            out << "{\n"
+                << "  \"mode\": \"" << (opts_.rate > 0 ? "open" : "closed") << "\",\n"
+                << "  \"connections\": " << opts_.connections << ",\n"
+                << "  \"depth\": " << opts_.depth << ",\n"
+                << "  \"rate\": " << opts_.rate << ",\n"
+                << "  \"duration\": " << seconds << ",\n"
+                << "  \"completed\": " << stats.completed << ",\n"
+                << "  \"errors\": " << stats.errors << ",\n"
+                << "  \"throughput\": " << stats.completed / seconds << ",\n"
+                << "  \"bytes_out\": " << stats.bytesOut << ",\n"
+                << "  \"bytes_in\": " << stats.bytesIn << ",\n"
+                << "  \"latency_us\": {\"min\": " << latency.min()
+                << ", \"mean\": " << latency.mean()
+                << ", \"p50\": " << latency.percentile(50)
+                << ", \"p90\": " << latency.percentile(90)
+                << ", \"p99\": " << latency.percentile(99)
+                << ", \"p999\": " << latency.percentile(99.9)
+                << ", \"max\": " << latency.max() << "}\n"
+                << "}\n";
+        } else {
+            out << "mode:        " << (opts_.rate > 0 ? "open-loop" : "closed-loop") << "\n"
+                << "completed:   " << stats.completed << "\n"
+                << "errors:      " << stats.errors << "\n"
+                << "throughput:  " << stats.completed / seconds << " req/s\n"
+                << "latency(us): " << latency.toString() << "\n";
+        }
+        std::cout << out.str();
     }
 
 private:
-    EventLoop* loop_;   // 事件循环
-    TcpClient  client_; // 客户端
-    Qps        qps_;
+    EventLoop*                 loop_;       // 主事件循环
+    const Options&             opts_;       // 压测参数
+    const PayloadDistribution& payload_;    // 请求内容长度的分布
+    EventLoopThreadPool        threadPool_; // 线程池
+    Resolver                   resolver_;   // 域名解析器 需要比所有连接晚销毁
+
+    std::vector<std::unique_ptr<Session>> sessions_;     // 所有连接
+    std::atomic<int64_t>                  progress_;     // 完成的请求数
+    int64_t                               lastProgress_; // 上一次输出时完成的请求数
+    Timestamp                             startTime_;    // 开始压测的时间
+    Timestamp                             measureStart_; // 开始统计的时间
 };
 
-void threadFunc(int idx) {
-    EventLoop   loop;
-    InetAddress serverAddr(8000);
-    TestClinet  client(&loop, serverAddr, "TestClient#" + to_string(idx));
-    client.connect();
-    loop.loop();
+static void usage() {
+    std::cout << "Usage: ./client [-a host] [-p port] [-c connections] [-t threads] [-d depth]\n"
+              << "                [-s payload] [-r rate] [-D duration] [-w warmup] [-j]\n"
+              << "  payload: fixed:N | uniform:MIN:MAX | exp:MEAN (bytes)\n"
+              << "  rate:    total requests per second, 0 for closed-loop\n";
 }
 
 int main(int argc, char* argv[]) {
-    if (argc == 1) {
-        std::cout << "Usage: ./client [threadNum]\n";
-        return 1;
-    }
-
-    int threadNum = atoi(argv[1]);
-
-    vector<thread> threads;
-    for (int i = 0; i < threadNum; ++i) {
-        threads.push_back(thread(threadFunc, i));
+    Options opts;
+    int     opt;
+    while ((opt = ::getopt(argc, argv, "a:p:c:t:d:s:r:D:w:jh")) != -1) {
+        switch (opt) {
+        case 'a': opts.host = optarg; break;
+        case 'p': opts.port = static_cast<uint16_t>(atoi(optarg)); break;
+        case 'c': opts.connections = std::max(1, atoi(optarg)); break;
+        case 't': opts.threads = std::max(0, atoi(optarg)); break;
+        case 'd': opts.depth = std::max(1, atoi(optarg)); break;
+        case 's': opts.payload = optarg; break;
+        case 'r': opts.rate = atof(optarg); break;
+        case 'D': opts.duration = atof(optarg); break;
+        case 'w': opts.warmup = atof(optarg); break;
+        case 'j': opts.json = true; break;
+        default: usage(); return 1;
+        }
     }
 
-    for (auto& th : threads) {
-        th.join();
+    PayloadDistribution payload;
+    if (!payload.parse(opts.payload)) {
+        std::cerr << "invalid payload distribution: " << opts.payload << "\n";
+        usage();
+        return 1;
     }
 
-    // EventLoop   loop;
-    // InetAddress serverAddr(8000);
-    // TestClinet  client(&loop, serverAddr, "TestClient");
-    // client.connect();
-    // loop.loop();
+    EventLoop     loop;
+    LoadGenerator generator(&loop, opts, payload);
+    generator.start();
+    loop.loop();
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,393 @@
+/**
+ * @file connscale.cc
+ * @brief 连接规模测试：测量大量空闲连接下每个连接的内存与CPU开销
+ * @details 子进程通过非阻塞connect从多个127.0.0.x源地址向TcpServer建立N个连接，
+ * 父进程作为服务端统计连接建立速率、每个连接占用的RSS以及空闲时每个事件循环的CPU占用，
+ * 最终以JSON格式输出到标准输出，便于比较不同版本之间的内存开销。
+ *
+ * Usage: ./connscale [-n conns] [-t threads] [-i source ips] [-p port] [-s idle seconds]
+ * 建立大量连接前需要调大文件描述符上限，例如 ulimit -n 2100000
+ */
+#include "buffer.h"
+#include "channel.h"
+#include "log.h"
+#include "socket.h"
+#include "tcpconnection.h"
+#include "tcpserver.h"
+#include <arpa/inet.h>
+#include <atomic>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <netinet/in.h>
+#include <sstream>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+using namespace apollo;
+
+#ifndef IP_BIND_ADDRESS_NO_PORT
+#define IP_BIND_ADDRESS_NO_PORT 24
+#endif
+
+// 测试参数
+struct Options {
+    int    conns       = 10000; // 连接数目
+    int    threads     = 4;     // 服务端SubLoop数目
+    int    sourceIps   = 16;    // 客户端使用的源地址数目 每个源地址最多约28000个连接
+    int    port        = 9100;  // 服务端端口
+    double idleSeconds = 5.0;   // 测量空闲CPU占用的时长
+};
+
+// 客户端建立连接的结果
+struct DialResult {
+    int32_t established; // 建立成功的连接数
+    int32_t failed;      // 建立失败的连接数
+};
+
+// 读取进程当前的RSS 单位为字节
+static size_t residentBytes() {
+    std::ifstream statm("/proc/self/statm");
+    size_t        size = 0, resident = 0;
+    statm >> size >> resident;
+    return resident * static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+}
+
+// 读取线程累计消耗的CPU时间 单位为时钟周期
+static long threadCpuTicks(pid_t tid) {
+    std::ostringstream path;
+    path << "/proc/self/task/" << tid << "/stat";
+    std::ifstream stat(path.str());
+    std::string   line;
+    std::getline(stat, line);
+
+    // 线程名称中可能包含空格 从右括号之后开始解析
+    size_t pos = line.rfind(')');
+    if (pos == std::string::npos) {
+        return 0;
+    }
+    std::istringstream fields(line.substr(pos + 2));
+    std::string        field;
+    long               utime = 0, stime = 0;
+    // 右括号之后的第12、13个字段分别为utime与stime
+    for (int i = 1; i <= 13 && fields >> field; ++i) {
+        if (i == 12) {
+            utime = atol(field.c_str());
+        } else if (i == 13) {
+            stime = atol(field.c_str());
+        }
+    }
+    return utime + stime;
+}
+
+// 调大文件描述符上限
+static rlim_t raiseFdLimit() {
+    rlimit limit;
+    ::getrlimit(RLIMIT_NOFILE, &limit);
+    limit.rlim_cur = limit.rlim_max;
+    ::setrlimit(RLIMIT_NOFILE, &limit);
+    ::getrlimit(RLIMIT_NOFILE, &limit);
+    return limit.rlim_cur;
+}
+
+/**
+ * @brief 客户端进程：等待父进程的通知后建立连接，并保持连接直到父进程关闭管道
+ *
+ * @param opts 测试参数
+ * @param goFd 父进程通知开始的管道
+ * @param resultFd 回传结果的管道
+ */
+static void runDialer(const Options& opts, int goFd, int resultFd) {
+    char go = 0;
+    if (::read(goFd, &go, sizeof(go)) != sizeof(go)) {
+        return;
+    }
+
+    const int kWindow = 1024; // 同时进行中的连接数目 避免服务端的全连接队列溢出
+
+    sockaddr_in server;
+    ::memset(&server, 0, sizeof(server));
+    server.sin_family      = AF_INET;
+    server.sin_port        = htons(static_cast<uint16_t>(opts.port));
+    server.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    int                      epfd = ::epoll_create1(EPOLL_CLOEXEC);
+    std::vector<epoll_event> events(kWindow);
+    std::vector<int>         sockets;
+    sockets.reserve(opts.conns);
+
+    DialResult result = { 0, 0 };
+    int        opened = 0, inflight = 0;
+    while (result.established + result.failed < opts.conns) {
+        while (inflight < kWindow && opened < opts.conns) {
+            int sockfd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            ++opened;
+            if (sockfd < 0) {
+                ++result.failed;
+                continue;
+            }
+
+            // 源地址在127.0.0.2 ~ 127.0.0.(sourceIps + 1)之间轮转 突破单个源地址的端口数量限制
+            int one = 1;
+            ::setsockopt(sockfd, IPPROTO_IP, IP_BIND_ADDRESS_NO_PORT, &one, sizeof(one));
+            sockaddr_in local;
+            ::memset(&local, 0, sizeof(local));
+            local.sin_family      = AF_INET;
+            local.sin_addr.s_addr = htonl(INADDR_LOOPBACK + 1 + opened % opts.sourceIps);
+            ::bind(sockfd, reinterpret_cast<sockaddr*>(&local), sizeof(local));
+
+            int ret = ::connect(sockfd, reinterpret_cast<sockaddr*>(&server), sizeof(server));
+            if (ret < 0 && errno != EINPROGRESS) {
+                ::close(sockfd);
+                ++result.failed;
+                continue;
+            }
+
+            epoll_event ev;
+            ev.events  = EPOLLOUT;
+            ev.data.fd = sockfd;
+            ::epoll_ctl(epfd, EPOLL_CTL_ADD, sockfd, &ev);
+            ++inflight;
+        }
+
+        int n = ::epoll_wait(epfd, events.data(), kWindow, 1000);
+        for (int i = 0; i < n; ++i) {
+            int       sockfd = events[i].data.fd;
+            int       err    = 0;
+            socklen_t len    = sizeof(err);
+            ::getsockopt(sockfd, SOL_SOCKET, SO_ERROR, &err, &len);
+            ::epoll_ctl(epfd, EPOLL_CTL_DEL, sockfd, nullptr);
+            --inflight;
+            if (err == 0) {
+                ++result.established;
+                sockets.push_back(sockfd);
+            } else {
+                ++result.failed;
+                ::close(sockfd);
+            }
+        }
+    }
+
+    if (::write(resultFd, &result, sizeof(result)) != sizeof(result)) {
+        return;
+    }
+    // 保持所有连接 直到父进程关闭管道
+    ::read(goFd, &go, sizeof(go));
+}
+
+/**
+ * @brief 服务端：统计连接建立的速率与空闲连接的开销
+ *
+ */
+class ConnScaleServer {
+public:
+    ConnScaleServer(EventLoop* loop, const Options& opts)
+        : loop_(loop)
+        , opts_(opts)
+        , server_(loop, InetAddress(static_cast<uint16_t>(opts.port)), "ConnScale")
+        , connected_(0) {
+        server_.setThreadNum(opts.threads);
+        server_.setThreadInitCallback(std::bind(&ConnScaleServer::onThreadInit,
+            this, std::placeholders::_1));
+        server_.setConnectionCallback(std::bind(&ConnScaleServer::onConnection,
+            this, std::placeholders::_1));
+        server_.setMessageCallback(std::bind(&ConnScaleServer::onMessage,
+            this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+    }
+
+    void start() {
+        server_.start();
+        // 没有SubLoop时 线程初始化回调已经在MainLoop中执行过了
+        if (opts_.threads > 0) {
+            std::lock_guard<std::mutex> locker(mtx_);
+            loopThreads_.push_back(ThreadHelper::ThreadId());
+        }
+    }
+
+    int connected() const { return connected_; }
+
+    Timestamp firstAccept() {
+        std::lock_guard<std::mutex> locker(mtx_);
+        return firstAccept_;
+    }
+
+    Timestamp lastAccept() {
+        std::lock_guard<std::mutex> locker(mtx_);
+        return lastAccept_;
+    }
+
+    std::vector<pid_t> loopThreads() {
+        std::lock_guard<std::mutex> locker(mtx_);
+        return loopThreads_;
+    }
+
+private:
+    // 记录每个SubLoop的线程ID 用于统计CPU占用
+    void onThreadInit(EventLoop* loop) {
+        std::lock_guard<std::mutex> locker(mtx_);
+        loopThreads_.push_back(ThreadHelper::ThreadId());
+    }
+
+    void onConnection(const TcpConnectionPtr& conn) {
+        if (conn->connected()) {
+            Timestamp now(Timestamp::now());
+            std::lock_guard<std::mutex> locker(mtx_);
+            if (!firstAccept_.valid()) {
+                firstAccept_ = now;
+            }
+            lastAccept_ = now;
+            ++connected_;
+        } else {
+            --connected_;
+        }
+    }
+
+    void onMessage(const TcpConnectionPtr& conn, Buffer* buffer, Timestamp receiveTime) {
+        buffer->retrieveAll();
+    }
+
+private:
+    EventLoop*       loop_;      // 事件循环
+    Options          opts_;      // 测试参数
+    TcpServer        server_;    // 服务器对象
+    std::atomic_int  connected_; // 当前建立的连接数
+
+    std::mutex         mtx_;         // 保护以下成员
+    std::vector<pid_t> loopThreads_; // 所有事件循环所在的线程
+    Timestamp          firstAccept_; // 第一个连接建立的时间
+    Timestamp          lastAccept_;  // 最后一个连接建立的时间
+};
+
+static void usage() {
+    std::cout << "Usage: ./connscale [-n conns] [-t threads] [-i source ips] [-p port] [-s idle seconds]\n";
+}
+
+int main(int argc, char* argv[]) {
+    Options opts;
+    int     opt;
+    while ((opt = ::getopt(argc, argv, "n:t:i:p:s:h")) != -1) {
+        switch (opt) {
+        case 'n': opts.conns = atoi(optarg); break;
+        case 't': opts.threads = atoi(optarg); break;
+        case 'i': opts.sourceIps = std::max(1, atoi(optarg)); break;
+        case 'p': opts.port = atoi(optarg); break;
+        case 's': opts.idleSeconds = atof(optarg); break;
+        default: usage(); return 1;
+        }
+    }
+
+    // 关闭连接级别的日志 避免日志输出影响测量结果
+    g_logger->setLevel(LogLevel::WARN);
+
+    rlim_t fdLimit = raiseFdLimit();
+    if (static_cast<rlim_t>(opts.conns) + 64 > fdLimit) {
+        std::cerr << "fd limit " << fdLimit << " is too small for " << opts.conns << " connections\n";
+        return 1;
+    }
+
+    // 在创建任何线程之前派生客户端进程
+    int goPipe[2], resultPipe[2];
+    if (::pipe2(goPipe, O_CLOEXEC) < 0 || ::pipe2(resultPipe, O_CLOEXEC) < 0) {
+        std::cerr << "pipe error: " << errno << "\n";
+        return 1;
+    }
+    pid_t dialer = ::fork();
+    if (dialer == 0) {
+        ::close(goPipe[1]);
+        ::close(resultPipe[0]);
+        runDialer(opts, goPipe[0], resultPipe[1]);
+        ::_exit(0);
+    }
+    ::close(goPipe[0]);
+    ::close(resultPipe[1]);
+
+    EventLoop       loop;
+    ConnScaleServer server(&loop, opts);
+    server.start();
+
+    size_t baseline = 0;
+    loop.runAfter(0.5, [&]() {
+        // 服务端启动完成后记录基准RSS 然后通知客户端开始建立连接
+        baseline = residentBytes();
+        char go  = 1;
+        if (::write(goPipe[1], &go, sizeof(go)) != sizeof(go)) {
+            loop.quit();
+        }
+    });
+
+    DialResult result = { 0, 0 };
+    Channel    resultChannel(&loop, resultPipe[0]);
+    resultChannel.setReadCallback([&](Timestamp) {
+        if (::read(resultPipe[0], &result, sizeof(result)) != sizeof(result)) {
+            result.established = 0;
+        }
+        resultChannel.disableAll();
+        loop.quit();
+    });
+    resultChannel.enableReading();
+    loop.loop();
+    resultChannel.remove();
+
+    // 等待所有连接被SubLoop接管
+    Timestamp deadline(addTime(Timestamp::now(), 10.0));
+    while (server.connected() < result.established && Timestamp::now() < deadline) {
+        ::usleep(10 * 1000);
+    }
+    ::usleep(500 * 1000);
+    size_t loaded = residentBytes();
+
+    // 测量空闲期间每个事件循环的CPU占用
+    std::vector<pid_t> threads = server.loopThreads();
+    std::vector<long>  before;
+    for (pid_t tid : threads) {
+        before.push_back(threadCpuTicks(tid));
+    }
+    loop.runAfter(opts.idleSeconds, [&]() { loop.quit(); });
+    loop.loop();
+
+    int    connected   = server.connected();
+    double acceptSecs  = timeDifference(server.lastAccept(), server.firstAccept());
+    double ticksPerSec = static_cast<double>(::sysconf(_SC_CLK_TCK));
+
+    std::ostringstream json;
+    json << "{\n"
+         << "  \"connections\": " << connected << ",\n"
+         << "  \"dial_failed\": " << result.failed << ",\n"
+         << "  \"loops\": " << threads.size() << ",\n"
+         << "  \"accept_seconds\": " << acceptSecs << ",\n"
+         << "  \"accept_rate\": " << (acceptSecs > 0 ? connected / acceptSecs : 0) << ",\n"
+         << "  \"rss_baseline_bytes\": " << baseline << ",\n"
+         << "  \"rss_loaded_bytes\": " << loaded << ",\n"
+         << "  \"rss_per_connection_bytes\": "
+         << (connected > 0 ? static_cast<double>(loaded - baseline) / connected : 0) << ",\n"
+         << "  \"sizeof\": {\n"
+         << "    \"TcpConnection\": " << sizeof(TcpConnection) << ",\n"
+         << "    \"Channel\": " << sizeof(Channel) << ",\n"
+         << "    \"Socket\": " << sizeof(Socket) << ",\n"
+         << "    \"Buffer\": " << sizeof(Buffer) << ",\n"
+         << "    \"buffer_initial_capacity\": " << Buffer::kCheapPrepend + Buffer::kInitialSize << ",\n"
+         << "    \"estimated_heap_per_connection\": "
+         << sizeof(TcpConnection) + sizeof(Channel) + sizeof(Socket)
+                + 2 * (Buffer::kCheapPrepend + Buffer::kInitialSize)
+         << "\n"
+         << "  },\n"
+         << "  \"idle_seconds\": " << opts.idleSeconds << ",\n"
+         << "  \"idle_cpu_percent_per_loop\": [";
+    for (size_t i = 0; i < threads.size(); ++i) {
+        double ticks = static_cast<double>(threadCpuTicks(threads[i]) - before[i]);
+        json << (i == 0 ? "" : ", ") << 100.0 * ticks / ticksPerSec / opts.idleSeconds;
+    }
+    json << "]\n}\n";
+    std::cout << json.str();
+
+    // 通知客户端关闭所有连接
+    ::close(goPipe[1]);
+    ::close(resultPipe[0]);
+    ::waitpid(dialer, nullptr, 0);
+    return 0;
+}
@@ -0,0 +1,104 @@
+/**
+ * @file coroutine.cc
+ * @brief 以协程方式编写的回显服务器，消息格式与server示例相同，可以用client示例进行压测
+ * @details 每个连接由一个协程按顺序处理：读取长度前缀的消息，可选地在计算线程池中处理或者延迟一段时间，
+ * 再原样写回。需要以 -DAPOLLO_COROUTINE=ON 构建
+ *
+ * Usage: ./coroutine [-p port] [-t io threads] [-c compute threads] [-d delay ms]
+ */
+#include "coroutine.h"
+#include "log.h"
+#include "tcpserver.h"
+#include <arpa/inet.h>
+#include <unistd.h>
+using namespace apollo;
+
+// 服务器参数
+struct Options {
+    uint16_t port          = 8000; // 监听端口
+    int      ioThreads     = 4;    // IO线程数目
+    int      computeThreads = 0;   // 计算线程数目 为0时在IO线程中处理消息
+    double   delay         = 0;    // 回复前的延迟 单位为秒
+};
+
+class CoEchoServer {
+public:
+    CoEchoServer(EventLoop* loop, const Options& opts)
+        : server_(loop, InetAddress(opts.port), "CoEchoServer")
+        , pool_("CoEchoCompute")
+        , opts_(opts) {
+        server_.setConnectionCallback(std::bind(&CoEchoServer::onConnection, this, std::placeholders::_1));
+        server_.setThreadNum(opts.ioThreads);
+        pool_.setThreadNum(opts.computeThreads);
+    }
+
+    void start() {
+        pool_.start();
+        server_.start();
+    }
+
+private:
+    // 新连接到来时为其启动一个协程 协程接管连接之后的所有回调
+    void onConnection(const TcpConnectionPtr& conn) {
+        if (conn->connected()) {
+            coSpawn(conn->getLoop(), session(conn));
+        }
+    }
+
+    Task<> session(TcpConnectionPtr conn) {
+        CoConnection c(conn);
+        EventLoop*   loop = conn->getLoop();
+
+        for (;;) {
+            std::optional<std::string> message = co_await c.readFrame();
+            if (!message) {
+                break;
+            }
+
+            if (opts_.computeThreads > 0) {
+                // 模拟耗时的业务处理 期间同一事件循环上的其他连接不受影响
+                // 捕获了字符串的lambda需要先保存为局部变量 见offload的说明
+                auto work = [m = std::move(*message)] { return m; };
+                *message  = co_await offload(pool_, loop, std::move(work));
+            }
+            if (opts_.delay > 0) {
+                co_await sleepFor(loop, opts_.delay);
+            }
+
+            Buffer frame;
+            frame.appendInt32(static_cast<int32_t>(message->size()));
+            frame.append(*message);
+            if (!co_await c.write(frame.retrieveAllAsString())) {
+                break;
+            }
+        }
+        LOG_FMT_INFO(g_logger, "session %s finished", conn->name().c_str());
+    }
+
+private:
+    TcpServer         server_; // 服务器对象
+    ComputeThreadPool pool_;   // 计算线程池
+    Options           opts_;   // 服务器参数
+};
+
+int main(int argc, char* argv[]) {
+    Options opts;
+    int     opt;
+    while ((opt = ::getopt(argc, argv, "p:t:c:d:h")) != -1) {
+        switch (opt) {
+        case 'p': opts.port = static_cast<uint16_t>(atoi(optarg)); break;
+        case 't': opts.ioThreads = atoi(optarg); break;
+        case 'c': opts.computeThreads = atoi(optarg); break;
+        case 'd': opts.delay = atof(optarg) / 1000; break;
+        default:
+            fprintf(stderr, "Usage: %s [-p port] [-t io threads] [-c compute threads] [-d delay ms]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    EventLoop    loop;
+    CoEchoServer server(&loop, opts);
+    server.start();
+    loop.loop();
+    return 0;
+}
@@ -0,0 +1,92 @@
+/**
+ * @file proxy.cc
+ * @brief 四层TCP转发代理：将每个客户端连接转发到后端服务器
+ * @details 每个客户端连接在同一个事件循环中建立一个到后端的连接，两个方向都通过TcpConnection::forwardTo
+ * 以splice在内核中转发，数据不经过用户态缓冲区。后端连接建立之前客户端发来的数据保留在输入缓冲区中，
+ * 开始转发时一并发出。可以在server示例前部署，用client示例进行压测
+ *
+ * Usage: ./proxy [-p listen port] [-b backend ip] [-P backend port] [-t io threads]
+ */
+#include "log.h"
+#include "looplocal.h"
+#include "tcpclient.h"
+#include "tcpserver.h"
+#include <map>
+#include <memory>
+#include <unistd.h>
+using namespace apollo;
+
+// 代理参数
+struct Options {
+    uint16_t    port        = 9000;        // 监听端口
+    std::string backendIp   = "127.0.0.1"; // 后端地址
+    uint16_t    backendPort = 8000;        // 后端端口
+    int         ioThreads   = 4;           // IO线程数目
+};
+
+class Proxy {
+public:
+    Proxy(EventLoop* loop, const Options& opts)
+        : server_(loop, InetAddress(opts.port), "Proxy")
+        , backend_(opts.backendPort, opts.backendIp) {
+        server_.setConnectionCallback(std::bind(&Proxy::onConnection, this, std::placeholders::_1));
+        server_.setThreadNum(opts.ioThreads);
+    }
+
+    void start() {
+        server_.start();
+        // 每个事件循环只访问自己的后端连接表 不需要加锁
+        clients_.reset(new LoopLocal<ClientMap>(*server_.threadPool()));
+    }
+
+private:
+    using ClientMap = std::map<std::string, std::shared_ptr<TcpClient>>;
+
+    void onConnection(const TcpConnectionPtr& conn) {
+        ClientMap& clients = clients_->get();
+        if (!conn->connected()) {
+            clients.erase(conn->name());
+            return;
+        }
+
+        // 后端连接与客户端连接属于同一个事件循环 才能在两者之间splice
+        std::shared_ptr<TcpClient> client = std::make_shared<TcpClient>(conn->getLoop(), backend_, conn->name() + "-backend");
+        client->setConnectionCallback([conn](const TcpConnectionPtr& upstream) {
+            if (upstream->connected()) {
+                conn->forwardTo(upstream);
+                upstream->forwardTo(conn);
+            } else {
+                conn->shutdown();
+            }
+        });
+        clients[conn->name()] = client;
+        client->connect();
+    }
+
+private:
+    TcpServer                            server_;  // 服务器对象
+    InetAddress                          backend_; // 后端地址
+    std::unique_ptr<LoopLocal<ClientMap>> clients_; // 每个事件循环中的后端连接
+};
+
+int main(int argc, char* argv[]) {
+    Options opts;
+    int     opt;
+    while ((opt = ::getopt(argc, argv, "p:b:P:t:h")) != -1) {
+        switch (opt) {
+        case 'p': opts.port = static_cast<uint16_t>(atoi(optarg)); break;
+        case 'b': opts.backendIp = optarg; break;
+        case 'P': opts.backendPort = static_cast<uint16_t>(atoi(optarg)); break;
+        case 't': opts.ioThreads = atoi(optarg); break;
+        default:
+            fprintf(stderr, "Usage: %s [-p listen port] [-b backend ip] [-P backend port] [-t io threads]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    EventLoop loop;
+    Proxy     proxy(&loop, opts);
+    proxy.start();
+    loop.loop();
+    return 0;
+}
@@ -41,28 +41,55 @@ private:
     }
 
     // 可读写事件的回调函数
+    // 每条消息由4字节网络字节序的长度与EchoMessage组成 一次可读事件中可能包含多条消息或者半条消息
     void onMessage(const TcpConnectionPtr& conn,
         Buffer* buffer, Timestamp receiveTime) {
-        std::string message = buffer->retrieveAllAsString();
-        LOG_FMT_INFO(biz_logger, "reveive message: %s", message.c_str());
-        qps_test::EchoMessage request, response;
+        std::string output;
+        while (buffer->readableBytes() >= kHeaderLen) {
+            int32_t len = buffer->peekInt32();
+            if (len < 0 || len > kMaxMessageLen) {
+                LOG_FMT_ERROR(biz_logger, "invalid message length: %d", len);
+                conn->shutdown();
+                break;
+            }
+            if (buffer->readableBytes() < kHeaderLen + len) {
+                break;
+            }
+            buffer->retrieve(kHeaderLen);
+            std::string message = buffer->retrieveAsString(len);
+            LOG_FMT_DEBUG(biz_logger, "reveive message: %d bytes", len);
 
-        // 解包
-        request.ParseFromString(message);
+            qps_test::EchoMessage request, response;
 
-        response.set_id(request.id());
-        response.set_content(request.content());
+            // 解包
+            if (!request.ParseFromString(message)) {
+                LOG_ERROR(biz_logger) << "failed to parse request";
+                continue;
+            }
 
-        // 序列化
-        std::string responseStr;
-        response.SerializeToString(&responseStr);
+            response.set_id(request.id());
+            response.set_content(request.content());
 
-        conn->send(responseStr);
-        // conn->shutdown();
-        // LOG_INFO(biz_logger) << "close write";
+            // 序列化
+            std::string responseStr;
+            response.SerializeToString(&responseStr);
+
+            Buffer frame;
+            frame.appendInt32(static_cast<int32_t>(responseStr.size()));
+            frame.append(responseStr);
+            output += frame.retrieveAllAsString();
+        }
+
+        // 流水线中的多个请求合并为一次发送
+        if (!output.empty()) {
+            conn->send(output);
+        }
     }
 
 private:
+    static const size_t  kHeaderLen     = sizeof(int32_t);  // 消息头长度
+    static const int32_t kMaxMessageLen = 64 * 1024 * 1024; // 消息的最大长度
+
     TcpServer  server_; // 服务器对象
     EventLoop* loop_;   // 事件循环
 };